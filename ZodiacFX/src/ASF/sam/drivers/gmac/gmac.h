@@ -97,6 +97,7 @@ extern "C" {
 #define GMAC_FRAME_LENTGH_MAX   1536
 
 #define GMAC_RX_UNITSIZE        128     /**< Fixed size for RX buffer  */
+#define GMAC_RX_FRAME_BUFSIZE   GMAC_FRAME_LENTGH_MAX  /**< RX buffer for a whole frame, with a VLAN tag and the tail tag */
 #define GMAC_TX_UNITSIZE        1518    /**< Size for ETH frame length */
 
 /** GMAC clock speed */
@@ -63,6 +63,15 @@
 #include "gmac_raw.h"
 #include <string.h>
 #include "conf_eth.h"
+#include "config_zodiac.h"
+
+/** RX buffer size, the DMA takes it in units of 64 bytes */
+#ifndef GMAC_RX_BUFSIZE
+#define GMAC_RX_BUFSIZE  GMAC_RX_UNITSIZE
+#endif
+#if (GMAC_RX_BUFSIZE % 64) != 0 || GMAC_RX_BUFSIZE > (255 * 64)
+#error "GMAC_RX_BUFSIZE must be a multiple of 64 bytes, up to 16320"
+#endif
 
 /// @cond 0
 /**INDENT-OFF**/
@@ -92,6 +101,10 @@ COMPILER_ALIGNED(8)
 static gmac_tx_descriptor_t gs_tx_desc[GMAC_TX_BUFFERS];
 /** TX callback lists */
 static gmac_dev_tx_cb_t gs_tx_callback[GMAC_TX_BUFFERS];
+/** Number of TDs used by each frame */
+static uint8_t gs_tx_frags[GMAC_TX_BUFFERS];
+/** Contexts of scatter-gather frames */
+static void *gs_tx_context[GMAC_TX_BUFFERS];
 /** RX descriptors lists */
 COMPILER_ALIGNED(8)
 static gmac_rx_descriptor_t gs_rx_desc[GMAC_RX_BUFFERS];
@@ -99,19 +112,24 @@ static gmac_rx_descriptor_t gs_rx_desc[GMAC_RX_BUFFERS];
  * 1K Boundaries. Receive buffer manager write operations are burst of 2 words => 3 lsb bits
  * of the address shall be set to 0.
  */
+#ifndef GMAC_TX_NO_COPY
 COMPILER_ALIGNED(8)
 static uint8_t gs_uc_tx_buffer[GMAC_TX_BUFFERS * GMAC_TX_UNITSIZE];
+#else
+/** Frames are only sent with gmac_dev_write_sg(), TDs have no buffer of their own */
+#define gs_uc_tx_buffer NULL
+#endif
 
 /** Receive Buffer */
 COMPILER_ALIGNED(8)
-static uint8_t gs_uc_rx_buffer[GMAC_RX_BUFFERS * GMAC_RX_UNITSIZE];
+static uint8_t gs_uc_rx_buffer[GMAC_RX_BUFFERS * GMAC_RX_BUFSIZE];
 
 /**
  * GMAC device memory management struct.
  */
 typedef struct gmac_dev_mem {
 	/* Pointer to allocated buffer for RX. The address should be 8-byte aligned
-	and the size should be GMAC_RX_UNITSIZE * wRxSize. */
+	and the size should be GMAC_RX_BUFSIZE * wRxSize. */
 	uint8_t *p_rx_buffer;
 	/* Pointer to allocated RX descriptor list. */
 	gmac_rx_descriptor_t *p_rx_dscr;
@@ -126,8 +144,8 @@ typedef struct gmac_dev_mem {
 	uint16_t us_tx_size;
 } gmac_dev_mem_t;
 
-/** Return count in buffer */
-#define CIRC_CNT(head,tail,size) (((head) - (tail)) % (size))
+/** Return count in buffer, head and tail are unsigned so add size before the modulo */
+#define CIRC_CNT(head,tail,size) (((head) + (size) - (tail)) % (size))
 
 /*
  * Return space available, from 0 to size-1.
@@ -176,9 +194,10 @@ static void gmac_reset_tx_mem(gmac_device_t* p_dev)
 	/* Set up the TX descriptors */
 	CIRC_CLEAR(p_dev->us_tx_head, p_dev->us_tx_tail);
 	for (ul_index = 0; ul_index < p_dev->us_tx_list_size; ul_index++) {
-		ul_address = (uint32_t) (&(p_tx_buff[ul_index * GMAC_TX_UNITSIZE]));
+		ul_address = p_tx_buff ? (uint32_t) (&(p_tx_buff[ul_index * GMAC_TX_UNITSIZE])) : 0;
 		p_td[ul_index].addr = ul_address;
 		p_td[ul_index].status.val = GMAC_TXD_USED;
+		p_dev->p_tx_frags[ul_index] = 1;
 	}
 	p_td[p_dev->us_tx_list_size - 1].status.val =
 			GMAC_TXD_USED | GMAC_TXD_WRAP;
@@ -204,10 +223,13 @@ static void gmac_reset_rx_mem(gmac_device_t* p_dev)
 	/* Disable RX */
 	gmac_enable_receive(p_hw, 0);
 
+	/* Size of the buffers the DMA writes frames into */
+	gmac_set_rx_bufsize(p_hw, GMAC_RX_BUFSIZE / 64);
+
 	/* Set up the RX descriptors */
 	p_dev->us_rx_idx = 0;
 	for (ul_index = 0; ul_index < p_dev->us_rx_list_size; ul_index++) {
-		ul_address = (uint32_t) (&(p_rx_buff[ul_index * GMAC_RX_UNITSIZE]));
+		ul_address = (uint32_t) (&(p_rx_buff[ul_index * GMAC_RX_BUFSIZE]));
 		pRd[ul_index].addr.val = ul_address & GMAC_RXD_ADDR_MASK;
 		pRd[ul_index].status.val = 0;
 	}
@@ -250,6 +272,7 @@ static uint8_t gmac_init_mem(Gmac* p_gmac, gmac_device_t* p_gmac_dev,
 			(gmac_rx_descriptor_t *) ((uint32_t) p_dev_mm->p_rx_dscr
 			& 0xFFFFFFF8);
 	p_gmac_dev->us_rx_list_size = p_dev_mm->us_rx_size;
+	p_gmac_dev->us_rx_buf_size = GMAC_RX_BUFSIZE;
 
 	/* Assign TX buffers */
 	if (((uint32_t) p_dev_mm->p_tx_buffer & 0x7)
@@ -263,6 +286,8 @@ static uint8_t gmac_init_mem(Gmac* p_gmac, gmac_device_t* p_gmac_dev,
 			& 0xFFFFFFF8);
 	p_gmac_dev->us_tx_list_size = p_dev_mm->us_tx_size;
 	p_gmac_dev->func_tx_cb_list = p_tx_cb;
+	p_gmac_dev->p_tx_frags = gs_tx_frags;
+	p_gmac_dev->p_tx_context = gs_tx_context;
 
 	/* Reset TX & RX */
 	gmac_reset_rx_mem(p_gmac_dev);
@@ -382,6 +407,7 @@ uint32_t gmac_dev_rx_buf_used(gmac_device_t* p_gmac_dev)
  *
  * \return GMAC_OK if receiving frame successfully, otherwise failed.
  */
+HOT_PATH
 uint32_t gmac_dev_read(gmac_device_t* p_gmac_dev, uint8_t* p_frame,
 		uint32_t ul_frame_size, uint32_t* p_rcv_size)
 {
@@ -399,6 +425,17 @@ uint32_t gmac_dev_read(gmac_device_t* p_gmac_dev, uint8_t* p_frame,
 	/* Set the default return value */
 	*p_rcv_size = 0;
 
+	/* A frame in a single buffer, every frame with GMAC_RX_FRAME_BUFSIZE buffers */
+	if ((p_rx_td->addr.val & GMAC_RXD_OWNERSHIP) == GMAC_RXD_OWNERSHIP
+			&& (p_rx_td->status.val & (GMAC_RXD_SOF | GMAC_RXD_EOF)) == (GMAC_RXD_SOF | GMAC_RXD_EOF)) {
+		*p_rcv_size = (p_rx_td->status.val & GMAC_RXD_LEN_MASK);
+		tmp_ul_frame_size = (*p_rcv_size < ul_frame_size) ? *p_rcv_size : ul_frame_size;
+		memcpy(p_frame, (void *)(p_rx_td->addr.val & GMAC_RXD_ADDR_MASK), tmp_ul_frame_size);
+		p_rx_td->addr.val &= ~(GMAC_RXD_OWNERSHIP);
+		circ_inc(&p_gmac_dev->us_rx_idx, p_gmac_dev->us_rx_list_size);
+		return (tmp_ul_frame_size < *p_rcv_size) ? GMAC_SIZE_TOO_SMALL : GMAC_OK;
+	}
+
 	/* Process received RX descriptor */
 	while ((p_rx_td->addr.val & GMAC_RXD_OWNERSHIP) == GMAC_RXD_OWNERSHIP) {
 		/* A start of frame has been received, discard previous fragments */
@@ -433,8 +470,12 @@ uint32_t gmac_dev_read(gmac_device_t* p_gmac_dev, uint8_t* p_frame,
 
 				return GMAC_RX_ERROR;
 			}
-			/* Copy the buffer into the application frame */
-			us_buffer_length = GMAC_RX_UNITSIZE;
+			/* Copy the buffer into the application frame, only the rest of the frame from the last one */
+			us_buffer_length = p_gmac_dev->us_rx_buf_size;
+			if ((p_rx_td->status.val & GMAC_RXD_EOF) == GMAC_RXD_EOF
+					&& (p_rx_td->status.val & GMAC_RXD_LEN_MASK) - tmp_ul_frame_size < us_buffer_length) {
+				us_buffer_length = (p_rx_td->status.val & GMAC_RXD_LEN_MASK) - tmp_ul_frame_size;
+			}
 			if ((tmp_ul_frame_size + us_buffer_length) > ul_frame_size) {
 				us_buffer_length = ul_frame_size - tmp_ul_frame_size;
 			}
@@ -497,6 +538,138 @@ uint32_t gmac_dev_tx_buf_used(gmac_device_t* p_gmac_dev)
 	return used;
 }
 
+/**
+ * \brief Point a TD back at its own transmit buffer after it has been
+ * used for a scatter-gather fragment.
+ *
+ * \param p_gmac_dev Pointer to the GMAC device instance.
+ * \param us_index Index of the TD.
+ */
+HOT_PATH
+static void gmac_tx_own_buffer(gmac_device_t* p_gmac_dev, uint16_t us_index)
+{
+	if (p_gmac_dev->p_tx_buffer == NULL) {
+		return;
+	}
+	p_gmac_dev->p_tx_dscr[us_index].addr =
+			(uint32_t) (&(p_gmac_dev->p_tx_buffer[us_index * GMAC_TX_UNITSIZE]));
+	p_gmac_dev->p_tx_frags[us_index] = 1;
+}
+
+/**
+ * \brief Release the contexts of scatter-gather frames that have been sent.
+ *
+ * The interrupt handler only moves the tail, contexts are released here
+ * so the free callback never runs in interrupt context. Called from the
+ * write functions, and may also be called from the main loop.
+ *
+ * \param p_gmac_dev Pointer to the GMAC device instance.
+ */
+HOT_PATH
+void gmac_dev_tx_reclaim(gmac_device_t* p_gmac_dev)
+{
+	uint16_t us_head = p_gmac_dev->us_tx_head;
+	uint16_t us_tail = p_gmac_dev->us_tx_tail;
+	uint16_t us_size = p_gmac_dev->us_tx_list_size;
+	uint16_t us_in_flight = CIRC_CNT(us_head, us_tail, us_size);
+	void *p_context;
+
+	for (uint16_t i = 0; i < us_size; i++) {
+		p_context = p_gmac_dev->p_tx_context[i];
+		if (p_context == NULL || CIRC_CNT(i, us_tail, us_size) < us_in_flight)
+			continue;
+		p_gmac_dev->p_tx_context[i] = NULL;
+		if (p_gmac_dev->func_tx_free_cb) {
+			p_gmac_dev->func_tx_free_cb(p_context);
+		}
+	}
+}
+
+/**
+ * \brief Register the callback that releases the context of a sent
+ * scatter-gather frame.
+ *
+ * \param p_gmac_dev Pointer to the GMAC device instance.
+ * \param func_tx_free_cb Release callback function.
+ */
+void gmac_dev_set_tx_free_callback(gmac_device_t* p_gmac_dev,
+		gmac_dev_tx_free_cb_t func_tx_free_cb)
+{
+	p_gmac_dev->func_tx_free_cb = func_tx_free_cb;
+}
+
+/**
+ * \brief Send a frame made of several fragments without copying it.
+ *
+ * Each fragment gets its own TD pointing at the caller's buffer, only
+ * the last one is marked GMAC_TXD_LAST. The first TD is handed to the
+ * GMAC last so transmission cannot start on a partial frame. The
+ * context is passed to the free callback once the frame has been sent.
+ *
+ * \param p_gmac_dev Pointer to the GMAC device instance.
+ * \param p_frags Pointer to the fragment list.
+ * \param ul_count Number of fragments.
+ * \param p_context Context released once the frame has been sent.
+ *
+ * \return GMAC_OK, GMAC_PARAM or GMAC_TX_BUSY if there are not enough free TDs.
+ */
+HOT_PATH
+uint32_t gmac_dev_write_sg(gmac_device_t* p_gmac_dev,
+		const gmac_tx_frag_t *p_frags, uint32_t ul_count, void *p_context)
+{
+	volatile gmac_tx_descriptor_t *p_tx_td;
+	uint16_t us_first = p_gmac_dev->us_tx_head;
+	uint16_t us_index = us_first;
+	uint32_t ul_status;
+
+	if (ul_count == 0 || ul_count >= p_gmac_dev->us_tx_list_size) {
+		return GMAC_PARAM;
+	}
+
+	gmac_dev_tx_reclaim(p_gmac_dev);
+
+	if ((uint32_t) CIRC_SPACE(p_gmac_dev->us_tx_head, p_gmac_dev->us_tx_tail,
+			p_gmac_dev->us_tx_list_size) < ul_count) {
+		return GMAC_TX_BUSY;
+	}
+
+	for (uint32_t i = 0; i < ul_count; i++) {
+		p_tx_td = &p_gmac_dev->p_tx_dscr[us_index];
+		p_tx_td->addr = (uint32_t) p_frags[i].p_buffer;
+		p_gmac_dev->func_tx_cb_list[us_index] = NULL;
+		p_gmac_dev->p_tx_frags[us_index] = 0;
+
+		ul_status = p_frags[i].ul_size & GMAC_TXD_LEN_MASK;
+		if (i == ul_count - 1) {
+			ul_status |= GMAC_TXD_LAST;
+		}
+		if (us_index == p_gmac_dev->us_tx_list_size - 1) {
+			ul_status |= GMAC_TXD_WRAP;
+		}
+		if (i == 0) {
+			/* Keep the first TD owned by software until the rest are ready */
+			ul_status |= GMAC_TXD_USED;
+		}
+		p_tx_td->status.val = ul_status;
+
+		circ_inc(&us_index, p_gmac_dev->us_tx_list_size);
+	}
+
+	p_gmac_dev->p_tx_frags[us_first] = ul_count;
+	p_gmac_dev->p_tx_context[us_first] = p_context;
+
+	/* Hand the frame to the GMAC before the interrupt handler can see it,
+	   a TD still marked USED inside head would be taken as already sent */
+	__DMB();
+	p_gmac_dev->p_tx_dscr[us_first].status.val &= ~GMAC_TXD_USED;
+	__DMB();
+	p_gmac_dev->us_tx_head = us_index;
+
+	gmac_start_transmission(p_gmac_dev->p_hw);
+
+	return GMAC_OK;
+}
+
 /**
  * \brief Send ulLength bytes from pcFrom. This copies the buffer to one of the
  * GMAC Tx buffers, and then indicates to the GMAC that the buffer is ready.
@@ -520,23 +693,29 @@ uint32_t gmac_dev_write(gmac_device_t* p_gmac_dev, void *p_buffer,
 
 
 	/* Check parameter */
-	if (ul_size > GMAC_TX_UNITSIZE) {
+	if (ul_size > GMAC_TX_UNITSIZE || p_gmac_dev->p_tx_buffer == NULL) {
 		return GMAC_PARAM;
 	}
 
+	/* Release the contexts of sent scatter-gather frames */
+	gmac_dev_tx_reclaim(p_gmac_dev);
+
 	/* Pointers to the current transmit descriptor */
 	p_tx_td = &p_gmac_dev->p_tx_dscr[p_gmac_dev->us_tx_head];
 
 	/* If no free TxTd, buffer can't be sent, schedule the wakeup callback */
 	if (CIRC_SPACE(p_gmac_dev->us_tx_head, p_gmac_dev->us_tx_tail,
 					p_gmac_dev->us_tx_list_size) == 0) {
-		if (p_tx_td[p_gmac_dev->us_tx_head].status.val & GMAC_TXD_USED)
+		if (p_tx_td->status.val & GMAC_TXD_USED)
 			return GMAC_TX_BUSY;
 	}
 
 	/* Pointers to the current Tx callback */
 	p_func_tx_cb = &p_gmac_dev->func_tx_cb_list[p_gmac_dev->us_tx_head];
 
+	/* The TD may still point at a fragment of a scatter-gather frame */
+	gmac_tx_own_buffer(p_gmac_dev, p_gmac_dev->us_tx_head);
+
 	/* Set up/copy data to transmission buffer */
 	if (p_buffer && ul_size) {
 		/* Driver manages the ring buffer */
@@ -577,7 +756,7 @@ uint32_t gmac_dev_write_nocopy(gmac_device_t* p_gmac_dev,
 
 
 	/* Check parameter */
-	if (ul_size > GMAC_TX_UNITSIZE) {
+	if (ul_size > GMAC_TX_UNITSIZE || p_gmac_dev->p_tx_buffer == NULL) {
 		return GMAC_PARAM;
 	}
 
@@ -615,16 +794,21 @@ uint8_t *gmac_dev_get_tx_buffer(gmac_device_t* p_gmac_dev)
 {
 	volatile gmac_tx_descriptor_t *p_tx_td;
 
+	if (p_gmac_dev->p_tx_buffer == NULL)
+		return 0;
+
 	/* Pointers to the current transmit descriptor */
 	p_tx_td = &p_gmac_dev->p_tx_dscr[p_gmac_dev->us_tx_head];
 
 	/* If no free TxTd, forget it */
 	if (CIRC_SPACE(p_gmac_dev->us_tx_head, p_gmac_dev->us_tx_tail,
 					p_gmac_dev->us_tx_list_size) == 0) {
-		if (p_tx_td[p_gmac_dev->us_tx_head].status.val & GMAC_TXD_USED)
+		if (p_tx_td->status.val & GMAC_TXD_USED)
 			return 0;
 	}
 
+	gmac_dev_tx_reclaim(p_gmac_dev);
+	gmac_tx_own_buffer(p_gmac_dev, p_gmac_dev->us_tx_head);
 	return (uint8_t *)p_tx_td->addr;
 }
 
@@ -742,6 +926,7 @@ void gmac_handler(gmac_device_t* p_gmac_dev)
 	volatile uint32_t ul_tsr;
 	uint32_t ul_rx_status_flag;
 	uint32_t ul_tx_status_flag;
+	uint32_t ul_frags;
 #ifdef FREERTOS_USED
 	portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
 #endif
@@ -811,6 +996,13 @@ void gmac_handler(gmac_device_t* p_gmac_dev)
 					(*p_tx_cb) (ul_tx_status_flag);
 				}
 
+				/* The GMAC only sets the used bit in the first TD of a frame,
+				   skip the rest of a scatter-gather frame */
+				ul_frags = p_gmac_dev->p_tx_frags[p_gmac_dev->us_tx_tail];
+				while (ul_frags-- > 1) {
+					circ_inc(&p_gmac_dev->us_tx_tail, p_gmac_dev->us_tx_list_size);
+					p_gmac_dev->p_tx_dscr[p_gmac_dev->us_tx_tail].status.val |= GMAC_TXD_USED;
+				}
 				circ_inc(&p_gmac_dev->us_tx_tail, p_gmac_dev->us_tx_list_size);
 			} while (CIRC_CNT(p_gmac_dev->us_tx_head, p_gmac_dev->us_tx_tail,
 							p_gmac_dev->us_tx_list_size));
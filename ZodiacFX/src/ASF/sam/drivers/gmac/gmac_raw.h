@@ -73,6 +73,17 @@ typedef struct gmac_options {
 typedef void (*gmac_dev_tx_cb_t) (uint32_t ul_status);
 /** Wakeup callback */
 typedef void (*gmac_dev_wakeup_cb_t) (void);
+/** Release callback for the context of a scatter-gather frame */
+typedef void (*gmac_dev_tx_free_cb_t) (void *p_context);
+
+/**
+ * One fragment of a scatter-gather frame. The buffer must stay valid
+ * until the frame has been sent.
+ */
+typedef struct gmac_tx_frag {
+	void *p_buffer;
+	uint32_t ul_size;
+} gmac_tx_frag_t;
 
 /**
  * GMAC driver structure.
@@ -101,8 +112,16 @@ typedef struct gmac_device {
 	gmac_dev_wakeup_cb_t func_wakeup_cb;
 	/** Optional callback list to be invoked once TD has been processed */
 	gmac_dev_tx_cb_t *func_tx_cb_list;
+	/** Number of TDs used by the frame starting at each TD */
+	uint8_t *p_tx_frags;
+	/** Context of the scatter-gather frame starting at each TD */
+	void **p_tx_context;
+	/** Optional callback to release the context of a sent frame */
+	gmac_dev_tx_free_cb_t func_tx_free_cb;
 	/** RX TD list size */
 	uint16_t us_rx_list_size;
+	/** Size of each RX buffer, GMAC_RX_BUFSIZE */
+	uint16_t us_rx_buf_size;
 	/** RX index for current processing TD */
 	uint16_t us_rx_idx;
 	/** TX TD list size */
@@ -127,6 +146,11 @@ uint32_t gmac_dev_read(gmac_device_t* p_gmac_dev, uint8_t* p_frame,
 uint32_t gmac_dev_tx_buf_used(gmac_device_t* p_gmac_dev);
 uint32_t gmac_dev_write(gmac_device_t* p_gmac_dev, void *p_buffer,
 		uint32_t ul_size, gmac_dev_tx_cb_t func_tx_cb);
+uint32_t gmac_dev_write_sg(gmac_device_t* p_gmac_dev,
+		const gmac_tx_frag_t *p_frags, uint32_t ul_count, void *p_context);
+void gmac_dev_set_tx_free_callback(gmac_device_t* p_gmac_dev,
+		gmac_dev_tx_free_cb_t func_tx_free_cb);
+void gmac_dev_tx_reclaim(gmac_device_t* p_gmac_dev);
 uint32_t gmac_dev_write_nocopy(gmac_device_t* p_gmac_dev,
 		uint32_t ul_size, gmac_dev_tx_cb_t func_tx_cb);
 uint8_t *gmac_dev_get_tx_buffer(gmac_device_t* p_gmac_dev);
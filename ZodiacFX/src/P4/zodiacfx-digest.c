@@ -0,0 +1,175 @@
+/**
+ * @file
+ * zodiacfx-digest.c
+ *
+ * This file contains the P4 digest extern, learn events from the dataplane to the controller
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX P4 firmware.
+ * Copyright (c) 2019 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Paul Zanna <paul@northboundnetworks.com>
+ *
+ */
+
+#include <asf.h>
+#include <string.h>
+#include "zodiacfx-digest.h"
+#include "zodiacfx-hash.h"
+#include "zodiacfx-tables.h"
+#include "controller.h"
+#include "timers.h"
+#include "lwip/def.h"
+
+/* Duplicate filter entry */
+struct digest_filter {
+	uint8_t mac[6];
+	uint8_t port;
+	uint8_t valid;
+	uint32_t time;
+};
+
+// Global variables
+struct digest_stats digest_stats;
+
+// Local variables
+static struct digest_learn digest_ring[DIGEST_RING_SIZE];
+static volatile uint16_t digest_head = 0;	// Written by the dataplane only
+static volatile uint16_t digest_tail = 0;	// Written by the main loop only
+static struct digest_filter digest_filter[DIGEST_FILTER_SIZE];
+static uint32_t digest_last_flush = 0;
+static bool digest_subscribed = false;	// Set by the controller with CTRL_DIGEST_SUBSCRIBE
+static uint8_t digest_buffer[sizeof(struct digest_msg) + (DIGEST_BATCH_MAX * sizeof(struct digest_learn))];
+
+/*
+*	P4 digest extern for MAC learning
+*
+*	Queues a learn event for the controller unless the same MAC and port
+*	was queued within DIGEST_FILTER_TIMEOUT. The ring has a single
+*	producer and a single consumer so no locking is needed.
+*
+*	@param mac - the source MAC address, as extracted into struct Headers_t.
+*	@param port - the ingress port.
+*
+*/
+void p4_digest_learn(uint64_t mac, uint8_t port)
+{
+	struct digest_learn *event;
+	struct digest_filter *filter;
+	uint8_t addr[6];
+	uint32_t now = sys_get_ms();
+	uint16_t head = digest_head;
+
+	addr[0] = mac >> 40;
+	addr[1] = mac >> 32;
+	addr[2] = mac >> 24;
+	addr[3] = mac >> 16;
+	addr[4] = mac >> 8;
+	addr[5] = mac;
+
+	/* Drop repeats of an event that was recently queued */
+	filter = &digest_filter[hash_mult(addr, 6) & (DIGEST_FILTER_SIZE - 1)];
+	if (filter->valid && filter->port == port && memcmp(filter->mac, addr, 6) == 0 && (now - filter->time) < DIGEST_FILTER_TIMEOUT)
+	{
+		digest_stats.filtered++;
+		return;
+	}
+
+	if ((uint16_t)(head - digest_tail) >= DIGEST_RING_SIZE)
+	{
+		digest_stats.ring_full++;
+		return;
+	}
+
+	event = &digest_ring[head & (DIGEST_RING_SIZE - 1)];
+	memcpy(event->mac, addr, 6);
+	event->port = port;
+	event->reserved = 0;
+	digest_head = head + 1;	// Publish after the entry is written
+	digest_stats.queued++;
+
+	memcpy(filter->mac, addr, 6);
+	filter->port = port;
+	filter->valid = 1;
+	filter->time = now;
+	return;
+}
+
+/*
+*	Send the queued learn events to the controller
+*
+*	Called from the main loop. Events are batched into one message every
+*	DIGEST_INTERVAL ms, or sooner when a full batch is waiting. If the TCP
+*	send buffer is full the events stay in the ring, which pushes back on
+*	the dataplane through the ring_full counter.
+*
+*/
+void digest_flush(void)
+{
+	struct digest_msg *msg = (struct digest_msg*)digest_buffer;
+	uint16_t tail = digest_tail;
+	uint16_t count = digest_head - tail;
+	uint32_t now = sys_get_ms();
+
+	if (count == 0) return;
+	if (count < DIGEST_BATCH_MAX && (now - digest_last_flush) < DIGEST_INTERVAL) return;
+	digest_last_flush = now;
+
+	if (count > DIGEST_BATCH_MAX) count = DIGEST_BATCH_MAX;
+
+	if (!digest_subscribed || !controller_connected())
+	{
+		digest_stats.no_controller += count;
+		digest_tail = tail + count;
+		return;
+	}
+
+	for (int x=0;x<count;x++)
+	{
+		memcpy(digest_buffer + sizeof(struct digest_msg) + (x * sizeof(struct digest_learn)), &digest_ring[(tail + x) & (DIGEST_RING_SIZE - 1)], sizeof(struct digest_learn));
+	}
+	msg->digest_id = htons(DIGEST_ID_LEARN);
+	msg->count = htons(count);
+
+	if (controller_send(CTRL_DIGEST, 0, digest_buffer, sizeof(struct digest_msg) + (count * sizeof(struct digest_learn))) != ERR_OK)
+	{
+		digest_stats.deferred++;
+		return;
+	}
+
+	digest_tail = tail + count;
+	digest_stats.sent += count;
+	digest_stats.messages++;
+	return;
+}
+
+/*
+*	Turn sending of a digest list to the controller on or off
+*
+*	@param digest_id - the digest list ID.
+*	@param enable - true to send the digest to the controller.
+*
+*	Returns P4_OK, or P4_ERR_NOT_FOUND for an unknown digest list.
+*
+*/
+int digest_subscribe(uint16_t digest_id, bool enable)
+{
+	if (digest_id != DIGEST_ID_LEARN) return P4_ERR_NOT_FOUND;
+	digest_subscribed = enable;
+	return P4_OK;
+}
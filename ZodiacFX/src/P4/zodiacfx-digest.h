@@ -0,0 +1,76 @@
+/**
+ * @file
+ * zodiacfx-digest.h
+ *
+ * This file contains the declarations for the P4 digest extern
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX P4 firmware.
+ * Copyright (c) 2019 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Paul Zanna <paul@northboundnetworks.com>
+ *
+ */
+
+#ifndef ZODIACFX_DIGEST_H_
+#define ZODIACFX_DIGEST_H_
+
+#include <asf.h>
+#include <arch/cc.h>
+
+#define DIGEST_RING_SIZE	64	// Learn events queued between the dataplane and the main loop, power of 2
+#define DIGEST_FILTER_SIZE	64	// Entries in the duplicate filter, power of 2
+#define DIGEST_FILTER_TIMEOUT	1000	// Time a learn event is suppressed after being sent (ms)
+#define DIGEST_INTERVAL		20	// Time between digest messages to the controller (ms)
+#define DIGEST_BATCH_MAX	64	// Learn events per digest message
+
+#define DIGEST_ID_LEARN		1	// Digest list ID of MAC learning events
+
+/* One learn event, as carried in the digest message */
+struct digest_learn {
+	uint8_t mac[6];
+	uint8_t port;
+	uint8_t reserved;
+};
+
+/* Body of a CTRL_DIGEST message, followed by count struct digest_learn entries */
+PACK_STRUCT_BEGIN
+struct digest_msg {
+	uint16_t digest_id;
+	uint16_t count;
+} PACK_STRUCT_STRUCT;
+PACK_STRUCT_END
+
+/* Digest counters */
+struct digest_stats {
+	uint32_t queued;	// Events added to the ring
+	uint32_t filtered;	// Events suppressed as duplicates
+	uint32_t ring_full;	// Events dropped because the ring was full
+	uint32_t sent;		// Events sent to the controller
+	uint32_t messages;	// Digest messages sent
+	uint32_t deferred;	// Flushes held back by a full TCP send buffer
+	uint32_t no_controller;	// Events discarded with no controller subscribed
+};
+
+extern struct digest_stats digest_stats;
+
+void p4_digest_learn(uint64_t mac, uint8_t port);
+void digest_flush(void);
+int digest_subscribe(uint16_t digest_id, bool enable);
+
+#endif /* ZODIACFX_DIGEST_H_ */
@@ -0,0 +1,98 @@
+/**
+ * @file
+ * zodiacfx-externs.c
+ *
+ * This file contains the P4 externs provided by the firmware
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX P4 firmware.
+ * Copyright (c) 2019 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Paul Zanna <paul@northboundnetworks.com>
+ *
+ */
+
+#include <asf.h>
+#include <string.h>
+#include "zodiacfx-externs.h"
+
+// Global variables
+struct ff_group ff_groups[MAX_FF_GROUPS];
+
+/*
+*	Set the members of a fast failover group
+*
+*	@param group_id - the group to set.
+*	@param *ports - pointer to the ports in order of preference.
+*	@param count - the number of ports.
+*
+*	Returns 0 on success, -1 if the group or a port is invalid.
+*
+*/
+int ff_group_set(uint8_t group_id, const uint8_t *ports, uint8_t count)
+{
+	struct ff_group *group;
+
+	if (group_id >= MAX_FF_GROUPS || count > FF_GROUP_MAX_MEMBERS) return -1;
+	for (int x=0;x<count;x++)
+	{
+		if (ports[x] < 1 || ports[x] > TOTAL_PORTS) return -1;
+	}
+
+	group = &ff_groups[group_id];
+	memcpy(group->members, ports, count);
+	group->member_count = count;
+	group->active_port = 0;
+	return 0;
+}
+
+/*
+*	Fast failover group lookup
+*
+*	Picks the first member of the group that has link. Link state is kept
+*	up to date by update_port_status() so this never touches the switch.
+*
+*	@param group_id - the group to select from.
+*
+*	Returns the selected port, or 0 if no member has link (drop).
+*
+*/
+uint8_t ff_group_select(uint8_t group_id)
+{
+	struct ff_group *group;
+	uint8_t port = 0;
+
+	if (group_id >= MAX_FF_GROUPS) return 0;
+	group = &ff_groups[group_id];
+
+	for (int x=0;x<group->member_count;x++)
+	{
+		if (port_is_live(group->members[x]))
+		{
+			port = group->members[x];
+			break;
+		}
+	}
+
+	if (port != group->active_port)
+	{
+		if (group->active_port != 0) group->failovers++;
+		group->active_port = port;
+	}
+	return port;
+}
@@ -0,0 +1,63 @@
+/**
+ * @file
+ * zodiacfx-externs.h
+ *
+ * This file contains the declarations for the P4 externs provided by the firmware
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX P4 firmware.
+ * Copyright (c) 2019 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Paul Zanna <paul@northboundnetworks.com>
+ *
+ */
+
+#ifndef ZODIACFX_EXTERNS_H_
+#define ZODIACFX_EXTERNS_H_
+
+#include <asf.h>
+#include "config_zodiac.h"
+
+#define MAX_FF_GROUPS		16	// Number of fast failover groups
+#define FF_GROUP_MAX_MEMBERS	TOTAL_PORTS	// Ports per fast failover group
+
+/* Fast failover group, the first member with link up is used */
+struct ff_group {
+	uint8_t member_count;
+	uint8_t members[FF_GROUP_MAX_MEMBERS];	// Ports in order of preference
+	uint8_t active_port;	// Port selected by the last lookup
+	uint32_t failovers;	// Number of times the selected port has changed
+};
+
+extern uint8_t port_status[TOTAL_PORTS];
+
+/*
+*	Check if a port has link
+*
+*	@param port - the port number (1 - TOTAL_PORTS).
+*
+*/
+static inline uint8_t port_is_live(uint8_t port)
+{
+	return (port >= 1 && port <= TOTAL_PORTS) ? port_status[port-1] : 0;
+}
+
+int ff_group_set(uint8_t group_id, const uint8_t *ports, uint8_t count);
+uint8_t ff_group_select(uint8_t group_id);
+
+#endif /* ZODIACFX_EXTERNS_H_ */
@@ -0,0 +1,379 @@
+/**
+ * @file
+ * zodiacfx-flow.c
+ *
+ * This file contains the flow cache and IPFIX exporter
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX P4 firmware.
+ * Copyright (c) 2019 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Paul Zanna <paul@northboundnetworks.com>
+ *
+ */
+
+#include <asf.h>
+#include <string.h>
+#include "zodiacfx-flow.h"
+#include "timers.h"
+#include "wheel.h"
+#include "command.h"
+#include "lwip/udp.h"
+#include "lwip/def.h"
+
+/* One flow cache slot */
+struct flow_entry {
+	struct flow_record record;
+	struct wheel_timer timer;	// Next inactive or active timeout
+};
+
+/* IPFIX template, field ID and length pairs */
+static const uint16_t ipfix_template[] = {
+	8, 4,		// sourceIPv4Address
+	12, 4,		// destinationIPv4Address
+	7, 2,		// sourceTransportPort
+	11, 2,		// destinationTransportPort
+	4, 1,		// protocolIdentifier
+	10, 4,		// ingressInterface
+	2, 4,		// packetDeltaCount
+	1, 4,		// octetDeltaCount
+	22, 4,		// flowStartSysUpTime
+	21, 4,		// flowEndSysUpTime
+	136, 1		// flowEndReason
+};
+
+#define IPFIX_HEADER_LEN	16
+#define IPFIX_SET_HEADER_LEN	4
+#define IPFIX_FIELD_COUNT	(sizeof(ipfix_template) / 4)
+#define IPFIX_TEMPLATE_LEN	(IPFIX_SET_HEADER_LEN + 4 + sizeof(ipfix_template))
+#define IPFIX_RECORD_LEN	34
+
+// Global variables
+extern struct zodiac_config Zodiac_Config;
+struct flow_stats flow_stats;
+
+// Local variables
+static struct flow_entry flow_cache[FLOW_CACHE_SIZE];
+static struct flow_record flow_queue[FLOW_EXPORT_QUEUE];
+static uint16_t flow_queue_head = 0;
+static uint16_t flow_queue_tail = 0;
+static uint32_t flow_last_export = 0;
+static uint32_t flow_last_template = 0;
+static uint32_t flow_sequence = 0;
+static bool flow_template_due = true;
+static struct udp_pcb *flow_pcb = NULL;
+static ip_addr_t flow_collector;
+static uint16_t flow_collector_port = 0;	// 0 = no collector
+
+/*
+*	Create the UDP socket used for export and set the saved collector
+*
+*/
+void flow_init(void)
+{
+	flow_pcb = udp_new();
+	IP4_ADDR(&flow_collector, Zodiac_Config.flow_collector[0], Zodiac_Config.flow_collector[1], Zodiac_Config.flow_collector[2], Zodiac_Config.flow_collector[3]);
+	flow_collector_port = Zodiac_Config.flow_collector_port;
+	return;
+}
+
+/*
+*	Set the IPFIX collector
+*
+*	@param *addr - pointer to the collector address.
+*	@param port - the collector UDP port, 0 to stop exporting.
+*
+*/
+void flow_set_collector(ip_addr_t *addr, uint16_t port)
+{
+	ip_addr_copy(flow_collector, *addr);
+	flow_collector_port = port;
+	flow_template_due = true;
+	return;
+}
+
+/*
+*	Get the IPFIX collector
+*
+*	Returns false if no collector is set.
+*
+*/
+bool flow_get_collector(ip_addr_t *addr, uint16_t *port)
+{
+	ip_addr_copy(*addr, flow_collector);
+	*port = flow_collector_port;
+	return (flow_collector_port != 0);
+}
+
+/*
+*	Count the flows in the cache
+*
+*/
+uint16_t flow_active_count(void)
+{
+	uint16_t count = 0;
+
+	for (int x=0;x<FLOW_CACHE_SIZE;x++)
+	{
+		if (flow_cache[x].record.valid) count++;
+	}
+	return count;
+}
+
+/*
+*	Queue a record for export
+*
+*	@param *record - pointer to the cache entry.
+*	@param reason - the IPFIX flowEndReason.
+*
+*/
+static void flow_export(struct flow_record *record, uint8_t reason)
+{
+	struct flow_record *queued;
+
+	if (flow_collector_port == 0) return;
+	if ((uint16_t)(flow_queue_head - flow_queue_tail) >= FLOW_EXPORT_QUEUE)
+	{
+		flow_stats.lost++;
+		return;
+	}
+	queued = &flow_queue[flow_queue_head & (FLOW_EXPORT_QUEUE - 1)];
+	memcpy(queued, record, sizeof(struct flow_record));
+	queued->end_reason = reason;
+	flow_queue_head++;
+	return;
+}
+
+/*
+*	Expire or export a flow when its timer runs out
+*
+*	Packets only update last_ms, so when the timer runs out the flow may
+*	have been busy since. The timer is then started again for whichever
+*	timeout is next, so each flow costs one timer run per timeout rather
+*	than one timer update per packet.
+*
+*	@param *timer - pointer to the timer of the cache entry.
+*
+*/
+static void flow_timeout(struct wheel_timer *timer)
+{
+	struct flow_record *record = &WHEEL_ENTRY(timer, struct flow_entry, timer)->record;
+	uint32_t now = sys_get_ms();
+	uint32_t idle = record->last_ms + FLOW_INACTIVE_TIMEOUT;
+	uint32_t active = record->first_ms + FLOW_ACTIVE_TIMEOUT;
+
+	if ((int32_t)(now - idle) >= 0)
+	{
+		flow_stats.idle++;
+		flow_export(record, FLOW_END_IDLE);
+		record->valid = 0;
+		return;
+	}
+
+	if ((int32_t)(now - active) >= 0)
+	{
+		/* Export the counts so far and keep the flow */
+		flow_stats.active++;
+		flow_export(record, FLOW_END_ACTIVE);
+		record->packets = 0;
+		record->bytes = 0;
+		record->first_ms = now;
+		active = now + FLOW_ACTIVE_TIMEOUT;
+	}
+
+	wheel_add(timer, (((int32_t)(active - idle) < 0) ? active : idle) - now, flow_timeout);
+	return;
+}
+
+/*
+*	P4 flow accounting extern
+*
+*	The cache is direct mapped, so each packet costs one hash and one
+*	slot compare. A new flow that hashes to a busy slot pushes the old
+*	flow out to the exporter, counted as a collision.
+*
+*	@param src_ip - the IPv4 source address.
+*	@param dst_ip - the IPv4 destination address.
+*	@param protocol - the IP protocol.
+*	@param src_port - the L4 source port, 0 if not parsed.
+*	@param dst_port - the L4 destination port, 0 if not parsed.
+*	@param port - the ingress port.
+*	@param bytes - size of the packet.
+*
+*/
+HOT_PATH_TABLES
+void p4_flow_update(uint32_t src_ip, uint32_t dst_ip, uint8_t protocol, uint16_t src_port, uint16_t dst_port, uint8_t port, uint16_t bytes)
+{
+	struct flow_entry *entry;
+	struct flow_record *record;
+	uint32_t hash = src_ip ^ (dst_ip * 0x9E3779B1) ^ ((((uint32_t)src_port << 16) | dst_port) * 0x85EBCA6B) ^ protocol;
+	uint32_t now = sys_get_ms();
+
+	hash ^= hash >> 15;
+	entry = &flow_cache[(hash * 0x9E3779B1) >> (32 - FLOW_CACHE_BITS)];
+	record = &entry->record;
+
+	if (record->valid && record->src_ip == src_ip && record->dst_ip == dst_ip && record->src_port == src_port
+		&& record->dst_port == dst_port && record->protocol == protocol && record->port == port)
+	{
+		record->packets++;
+		record->bytes += bytes;
+		record->last_ms = now;
+		return;
+	}
+
+	if (record->valid)
+	{
+		flow_stats.collisions++;
+		flow_export(record, FLOW_END_LACK_OF_RESOURCES);
+	}
+
+	record->src_ip = src_ip;
+	record->dst_ip = dst_ip;
+	record->src_port = src_port;
+	record->dst_port = dst_port;
+	record->protocol = protocol;
+	record->port = port;
+	record->packets = 1;
+	record->bytes = bytes;
+	record->first_ms = now;
+	record->last_ms = now;
+	record->valid = 1;
+	flow_stats.created++;
+	wheel_add(&entry->timer, FLOW_INACTIVE_TIMEOUT, flow_timeout);	// Restarts the timer of a flow pushed out
+	return;
+}
+
+/*
+*	Write a 16 or 32 bit value in network byte order
+*
+*/
+static uint8_t *put16(uint8_t *p, uint16_t value)
+{
+	p[0] = value >> 8;
+	p[1] = value;
+	return p + 2;
+}
+
+static uint8_t *put32(uint8_t *p, uint32_t value)
+{
+	p[0] = value >> 24;
+	p[1] = value >> 16;
+	p[2] = value >> 8;
+	p[3] = value;
+	return p + 4;
+}
+
+/*
+*	Send one IPFIX message with the template (when due) and queued records
+*
+*/
+static void flow_send(void)
+{
+	struct pbuf *p;
+	struct flow_record *record;
+	uint16_t count = flow_queue_head - flow_queue_tail;
+	uint16_t len = IPFIX_HEADER_LEN;
+	uint32_t now = sys_get_ms();
+	uint8_t *msg, *set;
+
+	if (count > FLOW_RECORDS_PER_MSG) count = FLOW_RECORDS_PER_MSG;
+	if ((now - flow_last_template) >= FLOW_TEMPLATE_INTERVAL) flow_template_due = true;
+	if (flow_template_due) len += IPFIX_TEMPLATE_LEN;
+	if (count > 0) len += IPFIX_SET_HEADER_LEN + (count * IPFIX_RECORD_LEN);
+
+	p = pbuf_alloc(PBUF_TRANSPORT, len, PBUF_RAM);
+	if (p == NULL)
+	{
+		flow_stats.send_errors++;
+		return;
+	}
+	msg = p->payload;
+
+	/* Message header */
+	set = put16(msg, 10);
+	set = put16(set, len);
+	set = put32(set, now / 1000);
+	set = put32(set, flow_sequence);
+	set = put32(set, 0);
+
+	if (flow_template_due)
+	{
+		set = put16(set, 2);
+		set = put16(set, IPFIX_TEMPLATE_LEN);
+		set = put16(set, IPFIX_TEMPLATE_ID);
+		set = put16(set, IPFIX_FIELD_COUNT);
+		for (unsigned int x=0;x<IPFIX_FIELD_COUNT*2;x++) set = put16(set, ipfix_template[x]);
+	}
+
+	if (count > 0)
+	{
+		set = put16(set, IPFIX_TEMPLATE_ID);
+		set = put16(set, IPFIX_SET_HEADER_LEN + (count * IPFIX_RECORD_LEN));
+		for (int x=0;x<count;x++)
+		{
+			record = &flow_queue[(flow_queue_tail + x) & (FLOW_EXPORT_QUEUE - 1)];
+			set = put32(set, record->src_ip);
+			set = put32(set, record->dst_ip);
+			set = put16(set, record->src_port);
+			set = put16(set, record->dst_port);
+			*set++ = record->protocol;
+			set = put32(set, record->port);
+			set = put32(set, record->packets);
+			set = put32(set, record->bytes);
+			set = put32(set, record->first_ms);
+			set = put32(set, record->last_ms);
+			*set++ = record->end_reason;
+		}
+	}
+
+	if (udp_sendto(flow_pcb, p, &flow_collector, flow_collector_port) != ERR_OK)
+	{
+		flow_stats.send_errors++;
+	} else {
+		if (flow_template_due) flow_last_template = now;
+		flow_template_due = false;
+		flow_queue_tail += count;
+		flow_sequence += count;
+		flow_stats.exported += count;
+		flow_stats.messages++;
+	}
+	pbuf_free(p);
+	return;
+}
+
+/*
+*	Export records, called from the main loop
+*
+*	Flows are expired by their timers, see flow_timeout().
+*
+*/
+void flow_task(void)
+{
+	uint32_t now = sys_get_ms();
+	uint16_t queued;
+
+	if (flow_collector_port == 0 || flow_pcb == NULL) return;
+	queued = flow_queue_head - flow_queue_tail;
+	if (queued >= FLOW_RECORDS_PER_MSG || ((queued > 0 || flow_template_due) && (now - flow_last_export) >= FLOW_EXPORT_INTERVAL))
+	{
+		flow_last_export = now;
+		flow_send();
+	}
+	return;
+}
@@ -0,0 +1,92 @@
+/**
+ * @file
+ * zodiacfx-flow.h
+ *
+ * This file contains the declarations for the flow cache and IPFIX exporter
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX P4 firmware.
+ * Copyright (c) 2019 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Paul Zanna <paul@northboundnetworks.com>
+ *
+ */
+
+#ifndef ZODIACFX_FLOW_H_
+#define ZODIACFX_FLOW_H_
+
+#include <asf.h>
+#include "lwip/ip_addr.h"
+
+#define FLOW_CACHE_BITS		7
+#define FLOW_CACHE_SIZE		(1 << FLOW_CACHE_BITS)	// Direct mapped, one slot per hash
+#define FLOW_EXPORT_QUEUE	32	// Records waiting to be exported, power of 2
+#define FLOW_INACTIVE_TIMEOUT	15000	// Export a flow with no packets for this long (ms)
+#define FLOW_ACTIVE_TIMEOUT	60000	// Export a long lived flow this often (ms)
+#define FLOW_EXPORT_INTERVAL	1000	// Longest time a record waits to be exported (ms)
+#define FLOW_TEMPLATE_INTERVAL	60000	// Time between IPFIX template resends (ms)
+#define FLOW_RECORDS_PER_MSG	30
+#define IPFIX_PORT		4739
+#define IPFIX_TEMPLATE_ID	256
+
+/* IPFIX flowEndReason values */
+enum flow_end_reason {
+	FLOW_END_IDLE = 1,
+	FLOW_END_ACTIVE = 2,
+	FLOW_END_FORCED = 4,
+	FLOW_END_LACK_OF_RESOURCES = 5	// Pushed out by another flow with the same hash
+};
+
+/* One flow cache entry */
+struct flow_record {
+	uint32_t src_ip;
+	uint32_t dst_ip;
+	uint16_t src_port;
+	uint16_t dst_port;
+	uint8_t protocol;
+	uint8_t port;
+	uint8_t valid;
+	uint8_t end_reason;
+	uint32_t packets;
+	uint32_t bytes;
+	uint32_t first_ms;
+	uint32_t last_ms;
+};
+
+/* Flow cache counters */
+struct flow_stats {
+	uint32_t created;	// Flows added to the cache
+	uint32_t collisions;	// Flows pushed out by a new flow with the same hash
+	uint32_t idle;		// Flows expired by the inactive timeout
+	uint32_t active;	// Records exported by the active timeout
+	uint32_t exported;	// Records sent to the collector
+	uint32_t lost;		// Records dropped because the export queue was full
+	uint32_t messages;	// IPFIX messages sent
+	uint32_t send_errors;
+};
+
+extern struct flow_stats flow_stats;
+
+void flow_init(void);
+void flow_set_collector(ip_addr_t *addr, uint16_t port);
+bool flow_get_collector(ip_addr_t *addr, uint16_t *port);
+uint16_t flow_active_count(void);
+void p4_flow_update(uint32_t src_ip, uint32_t dst_ip, uint8_t protocol, uint16_t src_port, uint16_t dst_port, uint8_t port, uint16_t bytes);
+void flow_task(void);
+
+#endif /* ZODIACFX_FLOW_H_ */
@@ -0,0 +1,115 @@
+/**
+ * @file
+ * zodiacfx-hash.h
+ *
+ * This file contains the declarations for the P4 hash extern and action selectors
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX P4 firmware.
+ * Copyright (c) 2019 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Paul Zanna <paul@northboundnetworks.com>
+ *
+ */
+
+#ifndef ZODIACFX_HASH_H_
+#define ZODIACFX_HASH_H_
+
+#include <asf.h>
+
+/* Hash algorithms supported by p4_hash, the values are local to this firmware */
+enum hash_algorithm {
+	HASH_ALGO_CRC32,
+	HASH_ALGO_CRC16,
+	HASH_ALGO_MULT
+};
+
+#define HASH_MAX_INPUT	40	// Largest field list that can be hashed, in bytes
+
+/*
+*	Field list for the hash extern. The generated code appends the header
+*	fields in network byte order, exactly as they appear on the wire.
+*/
+struct hash_input {
+	uint8_t len;
+	uint8_t buf[HASH_MAX_INPUT];
+};
+
+static inline void hash_add_u8(struct hash_input *in, uint8_t val)
+{
+	in->buf[in->len++] = val;
+}
+
+static inline void hash_add_u16(struct hash_input *in, uint16_t val)
+{
+	in->buf[in->len++] = val >> 8;
+	in->buf[in->len++] = val;
+}
+
+static inline void hash_add_u32(struct hash_input *in, uint32_t val)
+{
+	in->buf[in->len++] = val >> 24;
+	in->buf[in->len++] = val >> 16;
+	in->buf[in->len++] = val >> 8;
+	in->buf[in->len++] = val;
+}
+
+static inline void hash_add_u48(struct hash_input *in, uint64_t val)
+{
+	hash_add_u16(in, val >> 32);
+	hash_add_u32(in, val);
+}
+
+#define MAX_ACTION_SELECTORS	4	// Number of action selectors
+#define SELECTOR_MAX_MEMBERS	32	// Members per action selector
+#define SELECTOR_MAX_GROUPS	8	// Groups per action selector
+#define SELECTOR_GROUP_SIZE	8	// Members per group
+#define SELECTOR_DATA_LEN	4	// Bytes of action data per member
+
+/* Action selector member, an action and its data */
+struct selector_member {
+	uint8_t valid;
+	uint8_t action_id;
+	uint8_t data[SELECTOR_DATA_LEN];
+};
+
+/* Action selector group, the members a flow hash is spread over */
+struct selector_group {
+	uint8_t member_count;
+	uint8_t members[SELECTOR_GROUP_SIZE];
+};
+
+struct action_selector {
+	uint8_t algo;	// enum hash_algorithm
+	struct selector_member members[SELECTOR_MAX_MEMBERS];
+	struct selector_group groups[SELECTOR_MAX_GROUPS];
+};
+
+extern struct action_selector action_selectors[MAX_ACTION_SELECTORS];
+
+uint32_t hash_crc32(const uint8_t *data, uint16_t len);
+uint32_t hash_crc32_update(uint32_t crc, const uint8_t *data, uint16_t len);
+uint16_t hash_crc16(const uint8_t *data, uint16_t len);
+uint32_t hash_mult(const uint8_t *data, uint16_t len);
+uint32_t p4_hash(uint8_t algo, uint32_t base, const struct hash_input *in, uint32_t max);
+
+int selector_set_member(uint8_t selector_id, uint8_t member_id, uint8_t action_id, const uint8_t *data);
+int selector_set_group(uint8_t selector_id, uint8_t group_id, const uint8_t *members, uint8_t count);
+const struct selector_member *selector_select(uint8_t selector_id, uint8_t group_id, const struct hash_input *in);
+
+#endif /* ZODIACFX_HASH_H_ */
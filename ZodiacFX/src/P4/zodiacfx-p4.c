@@ -11,7 +11,54 @@
 #define ZODIACFX_MASK(t, w) ((((t)(1)) << (w)) - (t)1)
 #define BYTES(w) ((w) / 8)
 
+static struct p4_table_entry forward_entries[P4_FORWARD_SIZE];
+static struct p4_table_entry forward_shadow[P4_FORWARD_SIZE];
+static struct p4_table forward = {
+    .key_len = 6,
+    .size = P4_FORWARD_SIZE,
+    .entries = forward_entries,
+    .shadow = forward_shadow,
+    .default_action = FORWARD_ACTION_CROSSOVER,
+};
 
+static struct p4_table_entry smac_entries[P4_SMAC_SIZE];
+static struct p4_table smac = {
+    .key_len = 6,
+    .size = P4_SMAC_SIZE,
+    .entries = smac_entries,
+};
+
+static struct p4_counter_cell ingress_port_cells[TOTAL_PORTS + 1];
+static struct p4_counter ingress_port = {
+    .size = TOTAL_PORTS + 1,
+    .cells = ingress_port_cells,
+};
+
+static uint32_t port_vlan_cells[P4_PORT_VLAN_SIZE];
+static struct p4_register port_vlan = {
+    .size = P4_PORT_VLAN_SIZE,
+    .cells = port_vlan_cells,
+};
+
+static inline void zodiacfx_mac_key(uint8_t *key, uint64_t mac)
+{
+    key[0] = mac >> 40;
+    key[1] = mac >> 32;
+    key[2] = mac >> 24;
+    key[3] = mac >> 16;
+    key[4] = mac >> 8;
+    key[5] = mac;
+}
+
+void pipeline_init(void){
+    p4_add_table(P4_TABLE_FORWARD, &forward);
+    p4_add_table(P4_TABLE_SMAC, &smac);
+    p4_add_counter(P4_COUNTER_INGRESS, &ingress_port);
+    p4_add_register(P4_REGISTER_PORT_VLAN, &port_vlan);
+}
+
+
+HOT_PATH
 void packet_in(uint8_t *p_uc_data, uint16_t zodiacfx_ul_size, uint8_t port){
 
     struct Headers_t headers = {
@@ -21,6 +68,9 @@ void packet_in(uint8_t *p_uc_data, uint16_t zodiacfx_ul_size, uint8_t port){
         .ipv4 = {
             .zodiacfx_valid = 0
         },
+        .ports = {
+            .zodiacfx_valid = 0
+        },
     };
 
     uint16_t zodiacfx_packetOffsetInBits = 0;
@@ -28,6 +78,9 @@ void packet_in(uint8_t *p_uc_data, uint16_t zodiacfx_ul_size, uint8_t port){
     struct zodiacfx_output fxout;
     struct zodiacfx_input fxin;
     fxin.input_port = port;
+    fxin.ingress_timestamp = switch_rx_ns;
+    fxout.vlan_action = VLAN_ACTION_NONE;
+    fxout.vlan_tci = 0;
 
     goto start;
 
@@ -113,6 +166,28 @@ void packet_in(uint8_t *p_uc_data, uint16_t zodiacfx_ul_size, uint8_t port){
         zodiacfx_packetOffsetInBits += 32;
 
         headers.ipv4.zodiacfx_valid = 1;
+        if (headers.ipv4.ihl != 5 || headers.ipv4.fragOffset != 0) goto accept;
+        switch (headers.ipv4.protocol) {
+            case 6: goto ports;
+            case 17: goto ports;
+            default: goto accept;
+        }
+    }
+    ports: {
+/* extract(headers.ports)*/
+        if (zodiacfx_ul_size < BYTES(zodiacfx_packetOffsetInBits + 32)) {
+            
+            goto accept;
+        }
+        memcpy(&headers.ports.srcPort, zodiacfx_packetStart + BYTES(zodiacfx_packetOffsetInBits), BYTES(16));
+        headers.ports.srcPort = htons(headers.ports.srcPort);
+        zodiacfx_packetOffsetInBits += 16;
+
+        memcpy(&headers.ports.dstPort, zodiacfx_packetStart + BYTES(zodiacfx_packetOffsetInBits), BYTES(16));
+        headers.ports.dstPort = htons(headers.ports.dstPort);
+        zodiacfx_packetOffsetInBits += 16;
+
+        headers.ports.zodiacfx_valid = 1;
         goto accept;
     }
 
@@ -121,16 +196,88 @@ void packet_in(uint8_t *p_uc_data, uint16_t zodiacfx_ul_size, uint8_t port){
 
 // Start of Pipeline
     accept:
+    p4_counter_count(&ingress_port, fxin.input_port, zodiacfx_ul_size);
+    if (headers.ipv4.zodiacfx_valid) {
+        p4_flow_update(headers.ipv4.srcAddr, headers.ipv4.dstAddr, headers.ipv4.protocol, headers.ports.srcPort, headers.ports.dstPort, fxin.input_port, zodiacfx_ul_size);
+    }
     {
-        {
+        uint8_t smac_key[P4_KEY_MAX] = {0};
+        uint8_t forward_key[P4_KEY_MAX] = {0};
+        struct p4_table_entry *forward_entry = NULL;
+        uint8_t forward_action = forward.default_action;
+        const uint8_t *forward_data = forward.default_data;
+        uint32_t port_vlan_cell;
+        uint8_t live_port;
+        struct hash_input select_key;
+        const struct selector_member *member;
+
+/* smac.apply(), an unknown source address is sent to the controller to learn */
+        if (headers.ethernet.zodiacfx_valid) {
+            zodiacfx_mac_key(smac_key, headers.ethernet.srcAddr);
+            if (p4_table_lookup(&smac, smac_key) == NULL) {
+                p4_digest_learn(headers.ethernet.srcAddr, fxin.input_port);
+            }
+        }
+
+/* forward.apply() */
+        if (headers.ethernet.zodiacfx_valid) {
+            zodiacfx_mac_key(forward_key, headers.ethernet.dstAddr);
+            forward_entry = p4_table_lookup(&forward, forward_key);
+        }
+        if (forward_entry != NULL) {
+            forward_entry->packets++;
+            forward_entry->bytes += zodiacfx_ul_size;
+            forward_action = forward_entry->action_id;
+            forward_data = forward_entry->data;
+        }
+        switch (forward_action) {
+            case FORWARD_ACTION_CROSSOVER:
 if ((fxin.input_port == 1)) 
                 fxout.output_port = 2;
             else 
                 fxout.output_port = 1;
+            break;
+            case FORWARD_ACTION_OUTPUT:
+                fxout.output_port = forward_data[0];
+                break;
+            case FORWARD_ACTION_FAILOVER:
+                live_port = ff_group_select(forward_data[0]);
+                fxout.output_port = (live_port != 0) ? (1 << (live_port - 1)) : 0;
+                break;
+            case FORWARD_ACTION_SELECT:
+/* 5-tuple, or the MAC addresses of a frame that is not IPv4 */
+                select_key.len = 0;
+                if (headers.ipv4.zodiacfx_valid) {
+                    hash_add_u32(&select_key, headers.ipv4.srcAddr);
+                    hash_add_u32(&select_key, headers.ipv4.dstAddr);
+                    hash_add_u16(&select_key, headers.ports.srcPort);
+                    hash_add_u16(&select_key, headers.ports.dstPort);
+                    hash_add_u8(&select_key, headers.ipv4.protocol);
+                } else {
+                    hash_add_u48(&select_key, headers.ethernet.srcAddr);
+                    hash_add_u48(&select_key, headers.ethernet.dstAddr);
+                }
+                member = selector_select(forward_data[0], forward_data[1], &select_key);
+                fxout.output_port = (member != NULL && member->action_id == FORWARD_ACTION_OUTPUT) ? member->data[0] : 0;
+                break;
+            default:
+                fxout.output_port = 0;
+                break;
+        }
+
+/* port_vlan.read(port_vlan_cell, fxout.output_port) */
+        port_vlan_cell = (fxout.output_port < P4_PORT_VLAN_SIZE) ? port_vlan_cells[fxout.output_port] : 0;
+        if (port_vlan_cell & PORT_VLAN_PUSH) {
+            fxout.vlan_action = VLAN_ACTION_PUSH;
+            fxout.vlan_tci = port_vlan_cell & 0xFFFF;
+        } else if (port_vlan_cell & PORT_VLAN_POP) {
+            fxout.vlan_action = VLAN_ACTION_POP;
         }
     }
 
 // Start of Deparser
-    
-gmac_write(p_uc_data, zodiacfx_ul_size, fxout.output_port);
+    if (fxout.output_port == 0) return;
+fxout.egress_timestamp = sys_get_ns();
+gmac_write_vlan(p_uc_data, zodiacfx_ul_size, fxout.output_port, fxout.vlan_action, fxout.vlan_tci);
+switch_latency(fxin.ingress_timestamp, fxout.egress_timestamp);
 }
@@ -7,16 +7,48 @@
 #include <stdlib.h>
 #include "common.h"
 #include "switch.h"
+#include "timers.h"
+#include "zodiacfx-externs.h"
+#include "zodiacfx-hash.h"
+#include "zodiacfx-digest.h"
+#include "zodiacfx-tables.h"
+#include "zodiacfx-punt.h"
+#include "zodiacfx-flow.h"
 
+/* Tables, counters and registers, by the ID the control plane uses */
+#define P4_TABLE_FORWARD 0 /* forward, exact match on ethernet.dstAddr */
+#define P4_TABLE_SMAC 1 /* smac, exact match on ethernet.srcAddr, a miss sends a learn digest */
+#define P4_COUNTER_INGRESS 0 /* ingress_port, packets and bytes per ingress port */
+#define P4_REGISTER_PORT_VLAN 0 /* port_vlan, tag action per output port bitmap */
 
+#define P4_FORWARD_SIZE 128 /* power of 2, the table also has a shadow for RCU updates */
+#define P4_SMAC_SIZE 128 /* power of 2 */
+#define P4_PORT_VLAN_SIZE 16 /* one cell per output port bitmap */
+
+/* forward actions */
+#define FORWARD_ACTION_CROSSOVER 0 /* port 1 to port 2, every other port to port 1, the default action */
+#define FORWARD_ACTION_OUTPUT 1 /* byte 0 of the action data is the output port bitmap */
+#define FORWARD_ACTION_DROP 2
+#define FORWARD_ACTION_FAILOVER 3 /* byte 0 is a fast failover group, its first member with link is used */
+#define FORWARD_ACTION_SELECT 4 /* bytes 0 and 1 are an action selector and group, the member is picked by a 5-tuple hash and runs its own output action */
+
+/* port_vlan cells, the TCI is in the low 16 bits */
+#define PORT_VLAN_PUSH 0x10000
+#define PORT_VLAN_POP 0x20000
+
+void pipeline_init(void);
 void packet_in(uint8_t *p_uc_data, uint16_t zodiacfx_ul_size, uint8_t port);
 
 struct zodiacfx_input {
     uint32_t input_port; /* bit<32> */
+    uint64_t ingress_timestamp; /* bit<64>, sys_get_ns() */
 };
 
 struct zodiacfx_output {
     uint32_t output_port; /* bit<32> */
+    uint64_t egress_timestamp; /* bit<64>, sys_get_ns() */
+    uint8_t vlan_action; /* VLAN_ACTION_NONE, VLAN_ACTION_PUSH or VLAN_ACTION_POP */
+    uint16_t vlan_tci; /* bit<16>, tag to push */
 };
 
 struct ethernet_t {
@@ -42,9 +74,16 @@ struct ipv4_t {
     uint8_t zodiacfx_valid;
 };
 
+struct ports_t {
+    uint16_t srcPort; /* bit<16> */
+    uint16_t dstPort; /* bit<16> */
+    uint8_t zodiacfx_valid;
+};
+
 struct Headers_t {
     struct ethernet_t ethernet; /* ethernet_t */
     struct ipv4_t ipv4; /* ipv4_t */
+    struct ports_t ports; /* ports_t, TCP or UDP */
 };
 
 #endif
@@ -0,0 +1,557 @@
+/**
+ * @file
+ * zodiacfx-persist.c
+ *
+ * This file contains the snapshot and restore of runtime table contents in internal flash
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX P4 firmware.
+ * Copyright (c) 2019 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Paul Zanna <paul@northboundnetworks.com>
+ *
+ */
+
+#include <asf.h>
+#include <string.h>
+#include "zodiacfx-persist.h"
+#include "zodiacfx-tables.h"
+#include "zodiacfx-hash.h"
+#include "timers.h"
+#include "cache.h"
+
+#define PERSIST_PAGE_UP(a)	(((a) + IFLASH_PAGE_SIZE - 1) & ~(IFLASH_PAGE_SIZE - 1))
+
+/* Steps of a save, each pass of persist_task() does one erase or writes one page */
+enum persist_state {
+	PERSIST_IDLE,
+	PERSIST_ERASE,		// Erasing the other bank for the snapshot to start
+	PERSIST_WRITE
+};
+
+/* A snapshot being written, one flash page is built up in RAM at a time */
+struct persist_writer {
+	uint8_t state;		// enum persist_state
+	uint32_t bank;		// Bank the snapshot goes in
+	uint32_t erase;		// Next block to erase
+	uint32_t addr;		// Flash page the buffer is written to
+	uint32_t end;		// End of the bank
+	uint32_t length;	// Bytes of the snapshot so far, before the trailer
+	uint32_t crc;
+	uint32_t seq;
+	uint32_t start_ms;
+	uint8_t table;		// Table being written, P4_MAX_TABLES once the trailer is queued
+	int16_t entry;		// Next entry of the table to look at, -1 before its header
+	uint16_t count;		// Entries the table had when its header was written
+	uint16_t written;	// Entries of the table written so far
+	uint16_t fill;		// Bytes in the page buffer
+	uint16_t item_len;	// Bytes in the item buffer
+	uint16_t item_pos;	// Bytes of the item copied to the page
+	uint8_t item[sizeof(struct persist_table) + sizeof(struct persist_entry) + P4_KEY_MAX + P4_DATA_MAX];
+	uint8_t page[IFLASH_PAGE_SIZE];
+};
+
+// Global variables
+struct persist_stats persist_stats;
+
+// Local variables
+static uint32_t persist_bank = PERSIST_ADDR;	// Bank snapshots are appended to
+static uint32_t persist_free = PERSIST_ADDR;	// Where the next snapshot goes
+static uint32_t persist_seq = 0;
+static bool persist_dirty = false;
+static uint32_t persist_changed_ms = 0;
+static struct persist_writer persist_w;
+
+// Internal Functions
+static uint32_t persist_check(uint32_t addr, uint32_t limit);
+static uint32_t persist_scan(uint32_t bank, uint32_t *newest, uint32_t *seq);
+static void persist_load(uint32_t addr);
+static uint32_t persist_size(void);
+static uint8_t persist_data_len(const uint8_t *data);
+static void persist_item(const void *data, uint16_t len);
+static bool persist_next_item(void);
+static void persist_write_page(void);
+static void persist_fail(int error);
+
+/*
+*	Restore the newest snapshot into the registered tables. Called once
+*	at start up, after the tables have been added and before the first
+*	packet is switched.
+*
+*/
+void persist_restore(void)
+{
+	uint32_t newest = 0;
+	uint32_t seq = 0;
+	uint32_t free_a = persist_scan(PERSIST_ADDR, &newest, &seq);
+	uint32_t free_b = persist_scan(PERSIST_ADDR + PERSIST_BANK_SIZE, &newest, &seq);
+
+	if (newest >= PERSIST_ADDR + PERSIST_BANK_SIZE)
+	{
+		persist_bank = PERSIST_ADDR + PERSIST_BANK_SIZE;
+		persist_free = free_b;
+	} else {
+		persist_bank = PERSIST_ADDR;
+		persist_free = free_a;
+	}
+	persist_seq = seq;
+	if (newest == 0) return;
+
+	persist_stats.seq = seq;
+	persist_stats.addr = newest;
+	persist_stats.length = persist_check(newest, persist_bank + PERSIST_BANK_SIZE);
+	persist_load(newest);
+	return;
+}
+
+/*
+*	Start a snapshot of every registered table, persist_task() writes it
+*
+*	The snapshot is appended to the current bank. When it does not fit
+*	the other bank is erased and the snapshot starts it, so the previous
+*	snapshot survives until the new one is complete. Each pass of the
+*	main loop erases one block or programs one page, so the dataplane is
+*	never held off for more than one flash operation. Updates to the live
+*	tables are refused while the save runs, see persist_busy().
+*
+*	Returns P4_OK, P4_ERR_BUSY during an RCU update or another save,
+*	P4_ERR_FULL if the tables do not fit in a bank.
+*
+*/
+int persist_save(void)
+{
+	struct persist_writer *w = &persist_w;
+	struct persist_header header;
+
+	if (w->state != PERSIST_IDLE || p4_tables_busy()) return P4_ERR_BUSY;
+	if (persist_size() > PERSIST_BANK_SIZE)
+	{
+		persist_stats.errors++;
+		return P4_ERR_FULL;
+	}
+
+	w->start_ms = sys_get_ms();
+	w->bank = persist_bank;
+	w->addr = persist_free;
+	w->state = PERSIST_WRITE;
+	if (persist_free + persist_size() > persist_bank + PERSIST_BANK_SIZE)
+	{
+		w->bank = (persist_bank == PERSIST_ADDR) ? PERSIST_ADDR + PERSIST_BANK_SIZE : PERSIST_ADDR;
+		w->addr = w->bank;
+		w->erase = w->bank;
+		w->state = PERSIST_ERASE;
+	}
+	w->end = w->bank + PERSIST_BANK_SIZE;
+	w->length = 0;
+	w->crc = 0xFFFFFFFF;
+	w->seq = persist_seq + 1;
+	w->table = 0;
+	w->entry = -1;
+	w->fill = 0;
+	w->item_len = 0;
+	w->item_pos = 0;
+
+	header.magic = PERSIST_MAGIC;
+	header.seq = w->seq;
+	header.version = PERSIST_VERSION;
+	header.tables = 0;
+	header.reserved = 0;
+	for (int x=0;x<P4_MAX_TABLES;x++)
+	{
+		if (p4_get_table(x) != NULL) header.tables++;
+	}
+	persist_item(&header, sizeof(header));
+	return P4_OK;
+}
+
+/*
+*	Returns true while a save is being written
+*
+*/
+bool persist_busy(void)
+{
+	return persist_w.state != PERSIST_IDLE;
+}
+
+/*
+*	Note that the tables have changed, they are saved once they have
+*	been left alone for PERSIST_DELAY ms.
+*
+*/
+void persist_changed(void)
+{
+	persist_dirty = true;
+	persist_changed_ms = sys_get_ms();
+}
+
+/*
+*	Advance a save, or start one once the tables have been left alone,
+*	called from the main loop
+*
+*/
+void persist_task(void)
+{
+	struct persist_writer *w = &persist_w;
+
+	switch (w->state)
+	{
+		case PERSIST_ERASE:
+		if (cache_flash_erase(w->erase, IFLASH_ERASE_PAGES_32) != FLASH_RC_OK)
+		{
+			persist_fail(P4_ERR_INVALID);
+			return;
+		}
+		w->erase += PERSIST_ERASE_SIZE;
+		if (w->erase >= w->end)
+		{
+			persist_stats.erases++;
+			w->state = PERSIST_WRITE;	// The old bank stays current until the snapshot is complete
+		}
+		return;
+
+		case PERSIST_WRITE:
+		persist_write_page();
+		return;
+
+		default:
+		if (!persist_dirty || p4_tables_busy()) return;
+		if (sys_get_ms() - persist_changed_ms < PERSIST_DELAY) return;
+		persist_dirty = false;
+		persist_save();
+		return;
+	}
+}
+
+/*
+*	Check a snapshot is complete and its CRC matches
+*
+*	@param addr - address of the snapshot header.
+*	@param limit - end of the bank.
+*
+*	Returns the length of the snapshot including the trailer, or 0.
+*
+*/
+static uint32_t persist_check(uint32_t addr, uint32_t limit)
+{
+	struct persist_header header;
+	struct persist_table tbl;
+	struct persist_entry entry;
+	struct persist_trailer trailer;
+	uint32_t pos = addr + sizeof(header);
+
+	if (pos > limit) return 0;
+	memcpy(&header, (const void *)addr, sizeof(header));
+	if (header.magic != PERSIST_MAGIC || header.version != PERSIST_VERSION) return 0;
+
+	for (int t=0;t<header.tables;t++)
+	{
+		if (pos + sizeof(tbl) > limit) return 0;
+		memcpy(&tbl, (const void *)pos, sizeof(tbl));
+		if (tbl.key_len > P4_KEY_MAX || tbl.default_len > P4_DATA_MAX) return 0;
+		pos += sizeof(tbl) + tbl.default_len;
+		for (int n=0;n<tbl.count;n++)
+		{
+			if (pos + sizeof(entry) > limit) return 0;
+			memcpy(&entry, (const void *)pos, sizeof(entry));
+			if (entry.data_len > P4_DATA_MAX) return 0;
+			pos += sizeof(entry) + tbl.key_len + entry.data_len;
+		}
+	}
+
+	if (pos + sizeof(trailer) > limit) return 0;
+	memcpy(&trailer, (const void *)pos, sizeof(trailer));
+	if (trailer.magic != PERSIST_END_MAGIC || trailer.length != pos - addr) return 0;
+	if (hash_crc32((const uint8_t *)addr, pos - addr) != trailer.crc) return 0;
+	return pos + sizeof(trailer) - addr;
+}
+
+/*
+*	Walk the snapshots in a bank
+*
+*	@param bank - address of the bank.
+*	@param *newest - set to the address of the newest snapshot found so far.
+*	@param *seq - sequence number of the newest snapshot found so far.
+*
+*	Returns where the next snapshot can be appended, the end of the bank
+*	if a write was interrupted part way.
+*
+*/
+static uint32_t persist_scan(uint32_t bank, uint32_t *newest, uint32_t *seq)
+{
+	struct persist_header header;
+	uint32_t end = bank + PERSIST_BANK_SIZE;
+	uint32_t addr = bank;
+	uint32_t len;
+
+	while (addr < end)
+	{
+		memcpy(&header, (const void *)addr, sizeof(header));
+		if (header.magic == 0xFFFFFFFF) return addr;	// Erased, the rest of the bank is free
+		len = persist_check(addr, end);
+		if (len == 0) return end;
+		if (header.seq > *seq)
+		{
+			*seq = header.seq;
+			*newest = addr;
+		}
+		addr = PERSIST_PAGE_UP(addr + len);
+	}
+	return end;
+}
+
+/*
+*	Add the entries of a snapshot to the tables. A table that is no
+*	longer registered, or has a different key length, is left out.
+*
+*	@param addr - address of a checked snapshot.
+*
+*/
+static void persist_load(uint32_t addr)
+{
+	struct persist_header header;
+	struct persist_table tbl;
+	struct persist_entry entry;
+	struct p4_table *table;
+	const uint8_t *pos = (const uint8_t *)addr;
+	const uint8_t *key;
+
+	memcpy(&header, pos, sizeof(header));
+	pos += sizeof(header);
+	for (int t=0;t<header.tables;t++)
+	{
+		memcpy(&tbl, pos, sizeof(tbl));
+		pos += sizeof(tbl);
+		table = p4_get_table(tbl.id);
+		if (table != NULL && table->key_len != tbl.key_len) table = NULL;
+		if (table != NULL)
+		{
+			p4_table_clear(table);
+			table->default_action = tbl.default_action;
+			memset(table->default_data, 0, P4_DATA_MAX);
+			memcpy(table->default_data, pos, tbl.default_len);
+		}
+		pos += tbl.default_len;
+
+		for (int n=0;n<tbl.count;n++)
+		{
+			memcpy(&entry, pos, sizeof(entry));
+			key = pos + sizeof(entry);
+			pos = key + tbl.key_len + entry.data_len;
+			if (table != NULL && p4_table_add(table, key, entry.action_id, key + tbl.key_len, entry.data_len) == P4_OK)
+			{
+				persist_stats.restored++;
+			} else {
+				persist_stats.skipped++;
+			}
+		}
+	}
+	return;
+}
+
+/*
+*	Space a snapshot of the tables would take, including the trailer
+*
+*/
+static uint32_t persist_size(void)
+{
+	struct p4_table *table;
+	uint32_t size = sizeof(struct persist_header) + sizeof(struct persist_trailer);
+
+	for (int x=0;x<P4_MAX_TABLES;x++)
+	{
+		table = p4_get_table(x);
+		if (table == NULL) continue;
+		size += sizeof(struct persist_table) + persist_data_len(table->default_data);
+		for (int i=0;i<table->size;i++)
+		{
+			if (!table->entries[i].used) continue;
+			size += sizeof(struct persist_entry) + table->key_len + persist_data_len(table->entries[i].data);
+		}
+	}
+	return size;
+}
+
+/*
+*	Length of action data without its trailing zero bytes
+*
+*	@param *data - pointer to P4_DATA_MAX bytes of action data.
+*
+*/
+static uint8_t persist_data_len(const uint8_t *data)
+{
+	uint8_t len = P4_DATA_MAX;
+
+	while (len > 0 && data[len - 1] == 0) len--;
+	return len;
+}
+
+/*
+*	Queue the next piece of the snapshot and add it to the CRC
+*
+*	@param *data - pointer to the bytes.
+*	@param len - number of bytes, at most the size of the item buffer.
+*
+*/
+static void persist_item(const void *data, uint16_t len)
+{
+	struct persist_writer *w = &persist_w;
+
+	if (data != w->item) memcpy(w->item, data, len);
+	w->item_len = len;
+	w->item_pos = 0;
+	w->crc = hash_crc32_update(w->crc, w->item, len);
+	w->length += len;
+	return;
+}
+
+/*
+*	Queue the next table header, entry or the trailer
+*
+*	Returns false if a table changed while it was being written.
+*
+*/
+static bool persist_next_item(void)
+{
+	struct persist_writer *w = &persist_w;
+	struct persist_table tbl;
+	struct persist_entry entry;
+	struct persist_trailer trailer;
+	struct p4_table *table;
+	struct p4_table_entry *e;
+
+	while (w->table < P4_MAX_TABLES)
+	{
+		table = p4_get_table(w->table);
+		if (table == NULL)
+		{
+			w->table++;
+			continue;
+		}
+		if (w->entry < 0)
+		{
+			tbl.id = w->table;
+			tbl.key_len = table->key_len;
+			tbl.count = table->count;
+			tbl.default_action = table->default_action;
+			tbl.default_len = persist_data_len(table->default_data);
+			memcpy(w->item, &tbl, sizeof(tbl));
+			memcpy(w->item + sizeof(tbl), table->default_data, tbl.default_len);
+			persist_item(w->item, sizeof(tbl) + tbl.default_len);
+			w->count = tbl.count;
+			w->written = 0;
+			w->entry = 0;
+			return true;
+		}
+		while (w->entry < table->size)
+		{
+			e = &table->entries[w->entry++];
+			if (!e->used) continue;
+			entry.action_id = e->action_id;
+			entry.data_len = persist_data_len(e->data);
+			memcpy(w->item, &entry, sizeof(entry));
+			memcpy(w->item + sizeof(entry), e->key, table->key_len);
+			memcpy(w->item + sizeof(entry) + table->key_len, e->data, entry.data_len);
+			persist_item(w->item, sizeof(entry) + table->key_len + entry.data_len);
+			w->written++;
+			return w->written <= w->count;
+		}
+		if (w->written != w->count) return false;
+		w->table++;
+		w->entry = -1;
+	}
+
+	trailer.magic = PERSIST_END_MAGIC;
+	trailer.length = w->length;
+	trailer.crc = ~w->crc;
+	persist_item(&trailer, sizeof(trailer));
+	w->table = P4_MAX_TABLES + 1;
+	return true;
+}
+
+/*
+*	Fill the page buffer and program it, finishing the save after the trailer
+*
+*/
+static void persist_write_page(void)
+{
+	struct persist_writer *w = &persist_w;
+	uint16_t chunk;
+
+	while (w->fill < IFLASH_PAGE_SIZE)
+	{
+		if (w->item_pos == w->item_len)
+		{
+			if (w->table > P4_MAX_TABLES) break;	// The trailer is in
+			if (!persist_next_item())
+			{
+				/* The tables were changed some other way, save them again later */
+				persist_fail(P4_ERR_BUSY);
+				persist_changed();
+				return;
+			}
+		}
+		chunk = IFLASH_PAGE_SIZE - w->fill;
+		if (chunk > w->item_len - w->item_pos) chunk = w->item_len - w->item_pos;
+		memcpy(&w->page[w->fill], &w->item[w->item_pos], chunk);
+		w->fill += chunk;
+		w->item_pos += chunk;
+	}
+
+	if (w->addr + IFLASH_PAGE_SIZE > w->end)
+	{
+		persist_fail(P4_ERR_FULL);
+		return;
+	}
+	memset(&w->page[w->fill], 0xFF, IFLASH_PAGE_SIZE - w->fill);
+	if (cache_flash_write(w->addr, w->page, IFLASH_PAGE_SIZE) != FLASH_RC_OK || memcmp((const void *)w->addr, w->page, IFLASH_PAGE_SIZE) != 0)
+	{
+		persist_fail(P4_ERR_INVALID);
+		return;
+	}
+	w->addr += IFLASH_PAGE_SIZE;
+	w->fill = 0;
+	if (w->table <= P4_MAX_TABLES || w->item_pos != w->item_len) return;
+
+	persist_stats.seq = w->seq;
+	persist_stats.addr = (w->bank == persist_bank) ? persist_free : w->bank;
+	persist_stats.length = w->length;
+	persist_stats.saves++;
+	persist_stats.save_ms = sys_get_ms() - w->start_ms;
+	persist_seq = w->seq;
+	persist_bank = w->bank;
+	persist_free = w->addr;
+	w->state = PERSIST_IDLE;
+	return;
+}
+
+/*
+*	Give up on a save, the next one starts the other bank
+*
+*	@param error - why, P4_ERR_BUSY if the tables changed.
+*
+*/
+static void persist_fail(int error)
+{
+	struct persist_writer *w = &persist_w;
+
+	/* Part of a snapshot may be in flash, a new bank is erased again next time */
+	if (w->state == PERSIST_WRITE && w->bank == persist_bank) persist_free = persist_bank + PERSIST_BANK_SIZE;
+	if (error != P4_ERR_BUSY) persist_stats.errors++;
+	w->state = PERSIST_IDLE;
+	return;
+}
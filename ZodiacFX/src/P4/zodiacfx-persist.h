@@ -0,0 +1,98 @@
+/**
+ * @file
+ * zodiacfx-persist.h
+ *
+ * This file contains the declarations for saving runtime table contents in internal flash
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX P4 firmware.
+ * Copyright (c) 2019 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Paul Zanna <paul@northboundnetworks.com>
+ *
+ */
+
+#ifndef ZODIACFX_PERSIST_H_
+#define ZODIACFX_PERSIST_H_
+
+#include <asf.h>
+
+#define PERSIST_ADDR		0x00460000	// 64 KB sector reserved for table snapshots
+#define PERSIST_BANK_SIZE	0x8000		// Two banks, one is erased only when the other is full
+#define PERSIST_ERASE_SIZE	(32 * IFLASH_PAGE_SIZE)	// Largest page erase the EFC supports
+#define PERSIST_MAGIC		0x53543450	// "P4TS", start of a snapshot
+#define PERSIST_END_MAGIC	0x45543450	// "P4TE", start of the trailer
+#define PERSIST_VERSION		1
+#define PERSIST_DELAY		5000		// Quiet time after a table update before it is saved (ms)
+
+/*
+*	A snapshot is a header, then for each table a persist_table followed
+*	by its default action data and entries, then a trailer. Each entry is
+*	a persist_entry followed by the key and the action data without
+*	trailing zero bytes. Snapshots are appended to a bank, each starting
+*	on a new flash page, and the one with the highest sequence number wins.
+*/
+struct persist_header {
+	uint32_t magic;
+	uint32_t seq;
+	uint8_t version;
+	uint8_t tables;
+	uint16_t reserved;
+};
+
+struct persist_table {
+	uint8_t id;
+	uint8_t key_len;
+	uint16_t count;
+	uint8_t default_action;
+	uint8_t default_len;
+};
+
+struct persist_entry {
+	uint8_t action_id;
+	uint8_t data_len;
+};
+
+struct persist_trailer {
+	uint32_t magic;
+	uint32_t length;	// Bytes from the start of the header to the trailer
+	uint32_t crc;		// CRC-32 of those bytes
+};
+
+/* Snapshot counters */
+struct persist_stats {
+	uint32_t seq;		// Sequence number of the newest snapshot, 0 if there is none
+	uint32_t addr;		// Where the newest snapshot is
+	uint32_t length;
+	uint32_t restored;	// Entries restored at boot
+	uint32_t skipped;	// Entries not restored because their table has changed
+	uint32_t saves;
+	uint32_t erases;
+	uint32_t errors;	// Failed saves
+	uint32_t save_ms;	// Time the last save took, from start to the last page
+};
+
+extern struct persist_stats persist_stats;
+
+void persist_restore(void);
+int persist_save(void);
+bool persist_busy(void);
+void persist_changed(void);
+void persist_task(void);
+
+#endif /* ZODIACFX_PERSIST_H_ */
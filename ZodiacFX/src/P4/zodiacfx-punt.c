@@ -0,0 +1,221 @@
+/**
+ * @file
+ * zodiacfx-punt.c
+ *
+ * This file contains the packet-in extern, which sends frames to the controller
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX P4 firmware.
+ * Copyright (c) 2019 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Paul Zanna <paul@northboundnetworks.com>
+ *
+ */
+
+#include <asf.h>
+#include <string.h>
+#include "zodiacfx-punt.h"
+#include "zodiacfx-tables.h"
+#include "controller.h"
+#include "timers.h"
+#include "lwip/def.h"
+
+/* One queued frame */
+struct punt_slot {
+	uint8_t reason;
+	uint8_t port;
+	uint16_t orig_len;
+	uint16_t cap_len;
+	uint8_t data[PUNT_SNAP_MAX];
+};
+
+// Global variables
+struct punt_reason punt_reasons[PUNT_MAX_REASONS];
+uint32_t punt_deferred = 0;	// Flushes held back by a full TCP send buffer
+
+// Local variables
+static struct punt_slot punt_ring[PUNT_RING_SIZE];
+static volatile uint16_t punt_head = 0;	// Written by the dataplane only
+static volatile uint16_t punt_tail = 0;	// Written by the main loop only
+static uint16_t punt_dropped = 0;	// Drops to report in the next message
+static uint32_t punt_last_flush = 0;
+static uint8_t punt_buffer[PUNT_BATCH_BYTES];
+
+/*
+*	Set every punt reason to the defaults
+*
+*/
+void punt_init(void)
+{
+	for (int x=0;x<PUNT_MAX_REASONS;x++)
+	{
+		memset(&punt_reasons[x], 0, sizeof(struct punt_reason));
+		punt_configure(x, PUNT_DEFAULT_SAMPLE, PUNT_DEFAULT_RATE, PUNT_DEFAULT_BURST, PUNT_DEFAULT_SNAP);
+	}
+	return;
+}
+
+/*
+*	Set the limits for a punt reason
+*
+*	@param reason - the punt reason.
+*	@param sample - send 1 in sample frames, 0 to turn the reason off.
+*	@param rate - frames per second.
+*	@param burst - frames that can be sent back to back.
+*	@param snaplen - bytes kept from each frame, at most PUNT_SNAP_MAX.
+*
+*	Returns P4_OK, or P4_ERR_INVALID.
+*
+*/
+int punt_configure(uint8_t reason, uint16_t sample, uint16_t rate, uint16_t burst, uint16_t snaplen)
+{
+	struct punt_reason *limits;
+
+	if (reason >= PUNT_MAX_REASONS || burst == 0 || snaplen == 0 || snaplen > PUNT_SNAP_MAX) return P4_ERR_INVALID;
+
+	limits = &punt_reasons[reason];
+	limits->sample = sample;
+	limits->rate = rate;
+	limits->burst = burst;
+	limits->snaplen = snaplen;
+	limits->sample_count = 0;
+	limits->tokens = burst;
+	limits->last_refill = sys_get_ms();
+	return P4_OK;
+}
+
+/*
+*	P4 packet-in extern
+*
+*	Queues the start of a frame for the controller. Sampling and a token
+*	bucket per reason are checked before anything is copied, so the cost
+*	to the dataplane is bounded whatever the program punts. The ring has
+*	a single producer and a single consumer so no locking is needed.
+*
+*	@param reason - why the program punted the frame.
+*	@param *p_frame - pointer to the frame.
+*	@param ul_size - size of the frame.
+*	@param port - the ingress port.
+*
+*/
+void p4_packet_in(uint8_t reason, const uint8_t *p_frame, uint16_t ul_size, uint8_t port)
+{
+	struct punt_reason *limits;
+	struct punt_slot *slot;
+	uint16_t head = punt_head;
+	uint32_t now, refill;
+
+	if (reason >= PUNT_MAX_REASONS) return;
+	limits = &punt_reasons[reason];
+	limits->seen++;
+
+	if (limits->sample == 0 || ++limits->sample_count < limits->sample)
+	{
+		limits->sampled_out++;
+		return;
+	}
+	limits->sample_count = 0;
+
+	/* Token bucket */
+	if (limits->tokens == 0)
+	{
+		now = sys_get_ms();
+		refill = ((now - limits->last_refill) * limits->rate) / 1000;
+		if (refill == 0)
+		{
+			limits->rate_limited++;
+			return;
+		}
+		limits->tokens = (refill > limits->burst) ? limits->burst : refill;
+		limits->last_refill = now;
+	}
+
+	if (!controller_connected() || (uint16_t)(head - punt_tail) >= PUNT_RING_SIZE)
+	{
+		limits->ring_full++;
+		punt_dropped++;
+		return;
+	}
+	limits->tokens--;
+
+	slot = &punt_ring[head & (PUNT_RING_SIZE - 1)];
+	slot->reason = reason;
+	slot->port = port;
+	slot->orig_len = ul_size;
+	slot->cap_len = (ul_size < limits->snaplen) ? ul_size : limits->snaplen;
+	memcpy(slot->data, p_frame, slot->cap_len);
+	punt_head = head + 1;	// Publish after the slot is written
+	return;
+}
+
+/*
+*	Send the queued frames to the controller
+*
+*	Called from the main loop. Frames are batched into one message every
+*	PUNT_INTERVAL ms, or sooner when the ring is half full. If the TCP
+*	send buffer is full the frames stay in the ring and new ones are
+*	dropped, so a busy controller connection never delays forwarding.
+*
+*/
+void punt_flush(void)
+{
+	struct punt_msg *msg = (struct punt_msg*)punt_buffer;
+	struct punt_record *record;
+	struct punt_slot *slot;
+	uint16_t tail = punt_tail;
+	uint16_t queued = punt_head - tail;
+	uint16_t count = 0;
+	uint16_t len = sizeof(struct punt_msg);
+	uint32_t now = sys_get_ms();
+
+	if (queued == 0) return;
+	if (queued < PUNT_RING_SIZE/2 && (now - punt_last_flush) < PUNT_INTERVAL) return;
+	punt_last_flush = now;
+
+	while (count < queued)
+	{
+		slot = &punt_ring[(tail + count) & (PUNT_RING_SIZE - 1)];
+		if (len + sizeof(struct punt_record) + slot->cap_len > PUNT_BATCH_BYTES) break;
+		record = (struct punt_record*)(punt_buffer + len);
+		record->reason = slot->reason;
+		record->port = slot->port;
+		record->orig_len = htons(slot->orig_len);
+		record->cap_len = htons(slot->cap_len);
+		len += sizeof(struct punt_record);
+		memcpy(punt_buffer + len, slot->data, slot->cap_len);
+		len += slot->cap_len;
+		count++;
+	}
+	msg->count = htons(count);
+	msg->dropped = htons(punt_dropped);
+
+	if (controller_send(CTRL_PACKET_IN, 0, punt_buffer, len) != ERR_OK)
+	{
+		if (!controller_connected()) punt_tail = tail + queued;	// Nobody to send them to
+		punt_deferred++;
+		return;
+	}
+
+	for (int x=0;x<count;x++)
+	{
+		punt_reasons[punt_ring[(tail + x) & (PUNT_RING_SIZE - 1)].reason].sent++;
+	}
+	punt_dropped = 0;
+	punt_tail = tail + count;
+	return;
+}
@@ -0,0 +1,102 @@
+/**
+ * @file
+ * zodiacfx-punt.h
+ *
+ * This file contains the declarations for the packet-in extern
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX P4 firmware.
+ * Copyright (c) 2019 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Paul Zanna <paul@northboundnetworks.com>
+ *
+ */
+
+#ifndef ZODIACFX_PUNT_H_
+#define ZODIACFX_PUNT_H_
+
+#include <asf.h>
+#include <arch/cc.h>
+
+#define PUNT_RING_SIZE		16	// Frames queued between the dataplane and the main loop, power of 2
+#define PUNT_SNAP_MAX		128	// Largest number of bytes kept from each frame
+#define PUNT_MAX_REASONS	8
+#define PUNT_INTERVAL		10	// Time between packet-in messages to the controller (ms)
+#define PUNT_BATCH_BYTES	1024	// Largest packet-in message body
+
+/* Defaults for a reason the controller has not configured */
+#define PUNT_DEFAULT_SAMPLE	1	// Every frame
+#define PUNT_DEFAULT_RATE	50	// Frames per second
+#define PUNT_DEFAULT_BURST	10
+#define PUNT_DEFAULT_SNAP	PUNT_SNAP_MAX
+
+/* Limits for one punt reason */
+struct punt_reason {
+	uint16_t sample;	// Send 1 in sample frames, 0 = off
+	uint16_t rate;		// Frames per second
+	uint16_t burst;		// Frames sent back to back
+	uint16_t snaplen;
+	uint16_t sample_count;
+	uint16_t tokens;
+	uint32_t last_refill;
+	uint32_t seen;		// Frames punted by the program
+	uint32_t sampled_out;	// Frames skipped by sampling
+	uint32_t rate_limited;	// Frames dropped by the rate limit
+	uint32_t ring_full;	// Frames dropped because the ring was full
+	uint32_t sent;		// Frames sent to the controller
+};
+
+/* Frame header in a CTRL_PACKET_IN message, followed by cap_len bytes of the frame */
+PACK_STRUCT_BEGIN
+struct punt_record {
+	uint8_t reason;
+	uint8_t port;
+	uint16_t orig_len;
+	uint16_t cap_len;
+} PACK_STRUCT_STRUCT;
+PACK_STRUCT_END
+
+/* Body of a CTRL_PACKET_IN message, followed by count records */
+PACK_STRUCT_BEGIN
+struct punt_msg {
+	uint16_t count;
+	uint16_t dropped;	// Frames dropped since the last message
+} PACK_STRUCT_STRUCT;
+PACK_STRUCT_END
+
+/* Body of a CTRL_PUNT_CONFIG message */
+PACK_STRUCT_BEGIN
+struct punt_config {
+	uint8_t reason;
+	uint8_t reserved;
+	uint16_t sample;
+	uint16_t rate;
+	uint16_t burst;
+	uint16_t snaplen;
+} PACK_STRUCT_STRUCT;
+PACK_STRUCT_END
+
+extern struct punt_reason punt_reasons[PUNT_MAX_REASONS];
+extern uint32_t punt_deferred;
+
+void punt_init(void);
+int punt_configure(uint8_t reason, uint16_t sample, uint16_t rate, uint16_t burst, uint16_t snaplen);
+void p4_packet_in(uint8_t reason, const uint8_t *p_frame, uint16_t ul_size, uint8_t port);
+void punt_flush(void);
+
+#endif /* ZODIACFX_PUNT_H_ */
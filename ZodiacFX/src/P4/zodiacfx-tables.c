@@ -0,0 +1,409 @@
+/**
+ * @file
+ * zodiacfx-tables.c
+ *
+ * This file contains the runtime P4 tables, counters and registers
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX P4 firmware.
+ * Copyright (c) 2019 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Paul Zanna <paul@northboundnetworks.com>
+ *
+ */
+
+#include <asf.h>
+#include <string.h>
+#include "zodiacfx-tables.h"
+#include "zodiacfx-hash.h"
+#include "timers.h"
+#include "config_zodiac.h"
+
+// Global variables
+uint32_t p4_epoch = 0;
+struct p4_rcu_stats p4_rcu_stats;
+
+// Local variables
+static struct p4_table *p4_tables[P4_MAX_TABLES];
+static struct p4_counter *p4_counters[P4_MAX_COUNTERS];
+static struct p4_register *p4_registers[P4_MAX_REGISTERS];
+
+/*
+*	Make a table, counter array or register array addressable by the control plane
+*
+*	@param id - the ID the control plane uses.
+*	@param *table - pointer to the table, NULL to remove it.
+*
+*	Returns P4_OK, or P4_ERR_INVALID if the ID is out of range.
+*
+*/
+int p4_add_table(uint8_t id, struct p4_table *table)
+{
+	if (id >= P4_MAX_TABLES) return P4_ERR_INVALID;
+	if (table != NULL && (table->key_len > P4_KEY_MAX || table->size == 0 || (table->size & (table->size - 1)))) return P4_ERR_INVALID;
+	p4_tables[id] = table;
+	return P4_OK;
+}
+
+int p4_add_counter(uint8_t id, struct p4_counter *counter)
+{
+	if (id >= P4_MAX_COUNTERS) return P4_ERR_INVALID;
+	p4_counters[id] = counter;
+	return P4_OK;
+}
+
+int p4_add_register(uint8_t id, struct p4_register *reg)
+{
+	if (id >= P4_MAX_REGISTERS) return P4_ERR_INVALID;
+	p4_registers[id] = reg;
+	return P4_OK;
+}
+
+struct p4_table *p4_get_table(uint8_t id)
+{
+	return (id < P4_MAX_TABLES) ? p4_tables[id] : NULL;
+}
+
+struct p4_counter *p4_get_counter(uint8_t id)
+{
+	return (id < P4_MAX_COUNTERS) ? p4_counters[id] : NULL;
+}
+
+struct p4_register *p4_get_register(uint8_t id)
+{
+	return (id < P4_MAX_REGISTERS) ? p4_registers[id] : NULL;
+}
+
+/*
+*	Find the slot a key belongs in, or the empty slot it would go in
+*
+*	@param *table - pointer to the table.
+*	@param *entries - pointer to the entry array to search.
+*	@param *key - pointer to the key.
+*
+*/
+HOT_PATH_TABLES
+static uint16_t p4_table_find(struct p4_table *table, struct p4_table_entry *entries, const uint8_t *key)
+{
+	uint16_t mask = table->size - 1;
+	uint16_t slot = hash_mult(key, table->key_len) & mask;
+
+	while (entries[slot].used)
+	{
+		if (memcmp(entries[slot].key, key, table->key_len) == 0) break;
+		slot = (slot + 1) & mask;
+	}
+	return slot;
+}
+
+/*
+*	Get the entry array control plane updates go to
+*
+*	@param *table - pointer to the table.
+*	@param **count - set to the entry count that goes with the array.
+*
+*/
+static struct p4_table_entry *p4_table_writer(struct p4_table *table, uint16_t **count)
+{
+	if (table->state == P4_RCU_OPEN)
+	{
+		*count = &table->shadow_count;
+		return table->shadow;
+	}
+	*count = &table->count;
+	return table->entries;
+}
+
+/*
+*	Table lookup, the match stage of the pipeline
+*
+*	@param *table - pointer to the table.
+*	@param *key - pointer to the key, key_len bytes in network byte order.
+*
+*	Returns the matching entry, or NULL to run the default action.
+*	The entry stays valid until the next quiescent state.
+*
+*/
+HOT_PATH_TABLES
+struct p4_table_entry *p4_table_lookup(struct p4_table *table, const uint8_t *key)
+{
+	struct p4_table_entry *entries = table->entries;
+	struct p4_table_entry *entry = &entries[p4_table_find(table, entries, key)];
+
+	if (entry->used)
+	{
+		table->hits++;
+		return entry;
+	}
+	table->misses++;
+	return NULL;
+}
+
+/*
+*	Add an entry to a table
+*
+*	The table is kept at most 3/4 full so probe sequences stay short.
+*	Inside an RCU update the entry is added to the shadow.
+*
+*	@param *table - pointer to the table.
+*	@param *key - pointer to the key.
+*	@param action_id - the action to run on a match.
+*	@param *data - pointer to the action data.
+*	@param data_len - length of the action data.
+*
+*/
+int p4_table_add(struct p4_table *table, const uint8_t *key, uint8_t action_id, const uint8_t *data, uint8_t data_len)
+{
+	struct p4_table_entry *entries;
+	struct p4_table_entry *entry;
+	uint16_t *count;
+
+	if (data_len > P4_DATA_MAX) return P4_ERR_INVALID;
+	if (table->state == P4_RCU_COPY) return P4_ERR_BUSY;
+
+	entries = p4_table_writer(table, &count);
+	entry = &entries[p4_table_find(table, entries, key)];
+	if (entry->used) return P4_ERR_EXISTS;
+	if (*count >= table->size - (table->size >> 2)) return P4_ERR_FULL;
+
+	memcpy(entry->key, key, table->key_len);
+	memset(entry->data, 0, P4_DATA_MAX);
+	memcpy(entry->data, data, data_len);
+	entry->action_id = action_id;
+	entry->packets = 0;
+	entry->bytes = 0;
+	entry->used = 1;
+	(*count)++;
+	if (table->state == P4_RCU_OPEN) p4_rcu_stats.updates++;
+	return P4_OK;
+}
+
+/*
+*	Change the action of an existing table entry
+*
+*	@param *table - pointer to the table.
+*	@param *key - pointer to the key.
+*	@param action_id - the action to run on a match.
+*	@param *data - pointer to the action data.
+*	@param data_len - length of the action data.
+*
+*/
+int p4_table_modify(struct p4_table *table, const uint8_t *key, uint8_t action_id, const uint8_t *data, uint8_t data_len)
+{
+	struct p4_table_entry *entries;
+	struct p4_table_entry *entry;
+	uint16_t *count;
+
+	if (data_len > P4_DATA_MAX) return P4_ERR_INVALID;
+	if (table->state == P4_RCU_COPY) return P4_ERR_BUSY;
+
+	entries = p4_table_writer(table, &count);
+	entry = &entries[p4_table_find(table, entries, key)];
+	if (!entry->used) return P4_ERR_NOT_FOUND;
+
+	memset(entry->data, 0, P4_DATA_MAX);
+	memcpy(entry->data, data, data_len);
+	entry->action_id = action_id;
+	if (table->state == P4_RCU_OPEN) p4_rcu_stats.updates++;
+	return P4_OK;
+}
+
+/*
+*	Delete an entry from a table
+*
+*	Later entries in the same probe sequence are shifted back into the
+*	hole so lookups never need tombstones.
+*
+*	@param *table - pointer to the table.
+*	@param *key - pointer to the key.
+*
+*/
+int p4_table_delete(struct p4_table *table, const uint8_t *key)
+{
+	struct p4_table_entry *entries;
+	uint16_t *count;
+	uint16_t mask = table->size - 1;
+	uint16_t hole, slot, home;
+
+	if (table->state == P4_RCU_COPY) return P4_ERR_BUSY;
+
+	entries = p4_table_writer(table, &count);
+	hole = p4_table_find(table, entries, key);
+	slot = hole;
+	if (!entries[hole].used) return P4_ERR_NOT_FOUND;
+
+	while (1)
+	{
+		slot = (slot + 1) & mask;
+		if (!entries[slot].used) break;
+		home = hash_mult(entries[slot].key, table->key_len) & mask;
+		/* Move the entry if its home slot is not between the hole and its slot */
+		if (((slot - home) & mask) >= ((slot - hole) & mask))
+		{
+			memcpy(&entries[hole], &entries[slot], sizeof(struct p4_table_entry));
+			hole = slot;
+		}
+	}
+	entries[hole].used = 0;
+	(*count)--;
+	if (table->state == P4_RCU_OPEN) p4_rcu_stats.updates++;
+	return P4_OK;
+}
+
+/*
+*	Remove all the entries from a table
+*
+*	Inside an RCU update only the shadow is cleared, so a full reload
+*	can be published without the dataplane ever seeing an empty table.
+*
+*	@param *table - pointer to the table.
+*
+*/
+void p4_table_clear(struct p4_table *table)
+{
+	uint16_t *count;
+	struct p4_table_entry *entries = p4_table_writer(table, &count);
+
+	memset(entries, 0, table->size * sizeof(struct p4_table_entry));
+	*count = 0;
+	return;
+}
+
+/*
+*	Start an RCU update of a table
+*
+*	The live entries are copied into the shadow P4_RCU_COPY_CHUNK at a
+*	time by p4_tables_task(). Updates are refused with P4_ERR_BUSY until
+*	the copy is done, then go to the shadow until p4_table_commit().
+*
+*	@param *table - pointer to the table.
+*
+*/
+int p4_table_begin(struct p4_table *table)
+{
+	if (table->shadow == NULL) return P4_ERR_INVALID;
+	if (table->state != P4_RCU_IDLE) return P4_ERR_BUSY;
+
+	table->copied = 0;
+	table->shadow_count = table->count;
+	table->state = P4_RCU_COPY;
+	p4_rcu_stats.updates = 0;
+	p4_rcu_stats.max_stall_cycles = 0;
+	p4_rcu_stats.start_ms = sys_get_ms();
+	return P4_OK;
+}
+
+/*
+*	Publish the shadow of a table with a single pointer swap
+*
+*	The old entries become the shadow again once every packet that
+*	could have looked them up has finished, marked by p4_quiescent().
+*	Direct counter updates made to the old entries during the update
+*	are not carried over.
+*
+*	@param *table - pointer to the table.
+*
+*/
+int p4_table_commit(struct p4_table *table)
+{
+	struct p4_table_entry *old = table->entries;
+
+	if (table->state != P4_RCU_OPEN) return (table->state == P4_RCU_COPY) ? P4_ERR_BUSY : P4_ERR_INVALID;
+
+	table->entries = table->shadow;	// The dataplane sees the new version from its next lookup
+	table->count = table->shadow_count;
+	table->shadow = old;
+	table->version++;
+	table->grace_epoch = p4_epoch;
+	table->state = P4_RCU_GRACE;
+	p4_rcu_stats.commits++;
+	p4_rcu_stats.duration_ms = sys_get_ms() - p4_rcu_stats.start_ms;
+	return P4_OK;
+}
+
+/*
+*	Abandon an RCU update, the live entries are left as they were
+*
+*	@param *table - pointer to the table.
+*
+*/
+void p4_table_abort(struct p4_table *table)
+{
+	if (table->state == P4_RCU_COPY || table->state == P4_RCU_OPEN)
+	{
+		table->state = P4_RCU_IDLE;
+		p4_rcu_stats.aborts++;
+	}
+	return;
+}
+
+/*
+*	Check if any table is filling its shadow or waiting for a grace period
+*
+*/
+bool p4_tables_busy(void)
+{
+	for (int x=0;x<P4_MAX_TABLES;x++)
+	{
+		if (p4_tables[x] != NULL && (p4_tables[x]->state == P4_RCU_COPY || p4_tables[x]->state == P4_RCU_GRACE)) return true;
+	}
+	return false;
+}
+
+/*
+*	Advance RCU updates, called from the main loop
+*
+*	Copies the next chunk of any shadow being filled and ends grace
+*	periods that have passed a quiescent state.
+*
+*/
+void p4_tables_task(void)
+{
+	struct p4_table *table;
+	uint16_t chunk;
+
+	for (int x=0;x<P4_MAX_TABLES;x++)
+	{
+		table = p4_tables[x];
+		if (table == NULL) continue;
+
+		if (table->state == P4_RCU_COPY)
+		{
+			chunk = table->size - table->copied;
+			if (chunk > P4_RCU_COPY_CHUNK) chunk = P4_RCU_COPY_CHUNK;
+			memcpy(&table->shadow[table->copied], &table->entries[table->copied], chunk * sizeof(struct p4_table_entry));
+			table->copied += chunk;
+			if (table->copied == table->size) table->state = P4_RCU_OPEN;
+		} else if (table->state == P4_RCU_GRACE && table->grace_epoch != p4_epoch) {
+			table->state = P4_RCU_IDLE;
+		}
+	}
+	return;
+}
+
+/*
+*	Record the length of a control plane slice that kept the main loop from forwarding
+*
+*	@param cycles - length of the slice in CPU cycles.
+*
+*/
+void p4_rcu_slice(uint32_t cycles)
+{
+	if (cycles > p4_rcu_stats.max_stall_cycles) p4_rcu_stats.max_stall_cycles = cycles;
+	return;
+}
@@ -0,0 +1,174 @@
+/**
+ * @file
+ * zodiacfx-tables.h
+ *
+ * This file contains the declarations for the runtime P4 tables, counters and registers
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX P4 firmware.
+ * Copyright (c) 2019 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Paul Zanna <paul@northboundnetworks.com>
+ *
+ */
+
+#ifndef ZODIACFX_TABLES_H_
+#define ZODIACFX_TABLES_H_
+
+#include <asf.h>
+
+#define P4_MAX_TABLES		8	// Tables the control plane can address
+#define P4_MAX_COUNTERS		8	// Counter arrays the control plane can address
+#define P4_MAX_REGISTERS	8	// Register arrays the control plane can address
+#define P4_KEY_MAX		16	// Largest table key, in bytes
+#define P4_DATA_MAX		8	// Largest action data, in bytes
+#define P4_RCU_COPY_CHUNK	32	// Entries copied into a shadow table per main loop pass
+
+/* Result of a table, counter or register operation, also sent to the controller */
+enum p4_status {
+	P4_OK,
+	P4_ERR_EXISTS,
+	P4_ERR_NOT_FOUND,
+	P4_ERR_FULL,
+	P4_ERR_INVALID,
+	P4_ERR_BUSY
+};
+
+/* Progress of an RCU update of a table */
+enum p4_rcu_state {
+	P4_RCU_IDLE,	// Updates are applied in place
+	P4_RCU_COPY,	// The shadow is being filled from the live entries
+	P4_RCU_OPEN,	// Updates are applied to the shadow
+	P4_RCU_GRACE	// Published, the old entries may still be in use
+};
+
+/* Exact match table entry */
+struct p4_table_entry {
+	uint8_t used;
+	uint8_t action_id;
+	uint8_t key[P4_KEY_MAX];
+	uint8_t data[P4_DATA_MAX];
+	uint32_t packets;	// Direct counter
+	uint32_t bytes;
+};
+
+/*
+*	Exact match table, stored as an open addressed hash table with
+*	linear probing. The generated code declares the entry storage
+*	(size must be a power of 2) and adds the table at start up.
+*
+*	A table with a shadow array can be updated RCU style: a large update
+*	is built in the shadow over many main loop passes while the
+*	dataplane keeps using the live entries, then published by swapping
+*	the pointers.
+*/
+struct p4_table {
+	uint8_t key_len;
+	uint16_t size;
+	uint16_t count;
+	struct p4_table_entry *entries;	// Live entries, the only pointer the dataplane reads
+	struct p4_table_entry *shadow;	// Same size as entries, NULL if only updated in place
+	uint16_t shadow_count;
+	uint16_t copied;
+	uint8_t state;			// enum p4_rcu_state
+	uint32_t grace_epoch;
+	uint32_t version;		// Number of RCU updates published
+	uint8_t default_action;
+	uint8_t default_data[P4_DATA_MAX];
+	uint32_t hits;
+	uint32_t misses;
+};
+
+/* RCU update counters */
+struct p4_rcu_stats {
+	uint32_t commits;
+	uint32_t aborts;
+	uint32_t updates;		// Updates in the last published version
+	uint32_t duration_ms;		// Time from begin to commit of the last version
+	uint32_t max_stall_cycles;	// Longest control plane slice since the last begin
+	uint32_t start_ms;
+};
+
+/* Indirect counter array */
+struct p4_counter_cell {
+	uint32_t packets;
+	uint32_t bytes;
+};
+
+struct p4_counter {
+	uint16_t size;
+	struct p4_counter_cell *cells;
+};
+
+/* Register array, 32 bits per cell */
+struct p4_register {
+	uint16_t size;
+	uint32_t *cells;
+};
+
+int p4_add_table(uint8_t id, struct p4_table *table);
+int p4_add_counter(uint8_t id, struct p4_counter *counter);
+int p4_add_register(uint8_t id, struct p4_register *reg);
+struct p4_table *p4_get_table(uint8_t id);
+struct p4_counter *p4_get_counter(uint8_t id);
+struct p4_register *p4_get_register(uint8_t id);
+
+extern uint32_t p4_epoch;
+extern struct p4_rcu_stats p4_rcu_stats;
+
+struct p4_table_entry *p4_table_lookup(struct p4_table *table, const uint8_t *key);
+int p4_table_add(struct p4_table *table, const uint8_t *key, uint8_t action_id, const uint8_t *data, uint8_t data_len);
+int p4_table_modify(struct p4_table *table, const uint8_t *key, uint8_t action_id, const uint8_t *data, uint8_t data_len);
+int p4_table_delete(struct p4_table *table, const uint8_t *key);
+void p4_table_clear(struct p4_table *table);
+int p4_table_begin(struct p4_table *table);
+int p4_table_commit(struct p4_table *table);
+void p4_table_abort(struct p4_table *table);
+bool p4_tables_busy(void);
+void p4_tables_task(void);
+void p4_rcu_slice(uint32_t cycles);
+
+/*
+*	Mark a quiescent state, called from the main loop between packets.
+*	No table entry is referenced across this point, so entries
+*	replaced before it can be reused.
+*
+*/
+static inline void p4_quiescent(void)
+{
+	p4_epoch++;
+}
+
+/*
+*	Count a packet in an indirect counter
+*
+*	@param *counter - pointer to the counter array.
+*	@param index - the cell to count in.
+*	@param bytes - the size of the packet.
+*
+*/
+static inline void p4_counter_count(struct p4_counter *counter, uint16_t index, uint16_t bytes)
+{
+	if (index < counter->size)
+	{
+		counter->cells[index].packets++;
+		counter->cells[index].bytes += bytes;
+	}
+}
+
+#endif /* ZODIACFX_TABLES_H_ */
@@ -0,0 +1,452 @@
+/**
+ * @file
+ * zodiacfx-vm.c
+ *
+ * This file contains the P4 bytecode verifier and interpreter
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX P4 firmware.
+ * Copyright (c) 2019 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Paul Zanna <paul@northboundnetworks.com>
+ *
+ */
+
+#include <asf.h>
+#include <string.h>
+#include "zodiacfx-vm.h"
+#include "zodiacfx-p4.h"
+
+// Global variables
+const struct vm_insn *vm_active = NULL;
+uint16_t vm_active_len = 0;
+struct vm_stats vm_stats;
+
+// Local variables
+static struct vm_insn vm_programs[2][VM_MAX_INSNS];	// Active program and the one being loaded
+static const uint8_t vm_no_data[P4_DATA_MAX];		// Action data before the first lookup
+
+/*
+*	Equivalent of test_parser.p4, used to compare the interpreter with
+*	the compiled packet_in()
+*
+*/
+static const struct vm_insn vm_bench_program[] = {
+	{ VM_JLT, 1, VM_IMM, 0, 8, 0, 14 },		// Too short for ethernet
+	{ VM_LDP, 2, VM_IMM, 2, 0, 12, 0 },		// etherType
+	{ VM_JNE, 2, VM_IMM, 0, 8, 0, 0x0800 },
+	{ VM_JLT, 1, VM_IMM, 0, 8, 0, 34 },		// Too short for ipv4
+	{ VM_LDP, 4, VM_IMM, 4, 0, 26, 0 },		// srcAddr
+	{ VM_LDP, 5, VM_IMM, 4, 0, 30, 0 },		// dstAddr
+	{ VM_LDP, 6, VM_IMM, 1, 0, 23, 0 },		// protocol
+	{ VM_FLOW, 4, VM_IMM, 0, 0, 0, 0 },		// Ports are r7 and r8, still 0
+	{ VM_JNE, 0, VM_IMM, 0, 10, 0, 1 },		// Output port 2 if the input port is 1
+	{ VM_OUT, 0, VM_IMM, 0, 0, 0, 2 },
+	{ VM_OUT, 0, VM_IMM, 0, 0, 0, 1 }
+};
+
+// Internal Functions
+static inline uint32_t vm_load(const uint8_t *p, uint8_t size)
+{
+	uint32_t value = 0;
+
+	while (size--) value = (value << 8) | *p++;
+	return value;
+}
+
+static inline void vm_store(uint8_t *p, uint8_t size, uint32_t value)
+{
+	while (size--)
+	{
+		p[size] = (uint8_t)value;
+		value >>= 8;
+	}
+	return;
+}
+
+static inline bool vm_size_ok(uint8_t size)
+{
+	return (size == 1 || size == 2 || size == 4);
+}
+
+/*
+*	Check a program before it is allowed to run
+*
+*	Every register, size, table, counter, register array and punt reason
+*	is checked here so the interpreter only has to bounds check packet
+*	offsets and array indexes computed at run time. Branches may only go
+*	forward and the last instruction must end the program, so every
+*	program terminates within count instructions.
+*
+*	@param *insns - pointer to the instructions.
+*	@param count - number of instructions.
+*	@param *bad - set to the index of the first instruction that failed.
+*
+*/
+int vm_verify(const struct vm_insn *insns, uint16_t count, uint16_t *bad)
+{
+	const struct vm_insn *insn;
+	int status = P4_OK;
+	uint16_t pc;
+
+	*bad = 0;
+	if (count == 0) return P4_ERR_INVALID;
+	if (count > VM_MAX_INSNS) return P4_ERR_FULL;
+
+	for (pc=0;pc<count;pc++)
+	{
+		insn = &insns[pc];
+		*bad = pc;
+		if (insn->op >= VM_OPS || insn->dst >= VM_REGS || (insn->src >= VM_REGS && insn->src != VM_IMM)) return P4_ERR_INVALID;
+
+		switch (insn->op)
+		{
+			case VM_JMP:
+			case VM_JEQ:
+			case VM_JNE:
+			case VM_JLT:
+			case VM_JGE:
+			if (insn->jump <= pc || insn->jump >= count) status = P4_ERR_INVALID;
+			break;
+
+			case VM_LDP:
+			case VM_STP:
+			if (!vm_size_ok(insn->size)) status = P4_ERR_INVALID;
+			break;
+
+			case VM_KEY:
+			if (!vm_size_ok(insn->size) || insn->off + insn->size > P4_KEY_MAX) status = P4_ERR_INVALID;
+			break;
+
+			case VM_LDD:
+			if (!vm_size_ok(insn->size) || insn->off + insn->size > P4_DATA_MAX) status = P4_ERR_INVALID;
+			break;
+
+			case VM_LOOKUP:
+			if (p4_get_table(insn->size) == NULL) status = P4_ERR_NOT_FOUND;
+			break;
+
+			case VM_COUNT:
+			if (p4_get_counter(insn->size) == NULL) status = P4_ERR_NOT_FOUND;
+			break;
+
+			case VM_RREAD:
+			case VM_RWRITE:
+			if (p4_get_register(insn->size) == NULL) status = P4_ERR_NOT_FOUND;
+			break;
+
+			case VM_FLOW:
+			if (insn->dst + 4 >= VM_REGS) status = P4_ERR_INVALID;
+			break;
+
+			case VM_PUNT:
+			if (insn->size >= PUNT_MAX_REASONS) status = P4_ERR_INVALID;
+			break;
+		}
+		if (status != P4_OK) return status;
+	}
+
+	*bad = count - 1;
+	if (insns[count-1].op != VM_OUT && insns[count-1].op != VM_DROP) return P4_ERR_INVALID;
+	return P4_OK;
+}
+
+/*
+*	Get the buffer a new program is loaded into
+*
+*	The buffer the dataplane is not running is returned, so it can be
+*	filled while frames are still being forwarded.
+*
+*	@param count - number of instructions to be loaded.
+*
+*/
+struct vm_insn *vm_staging(uint16_t count)
+{
+	if (count == 0 || count > VM_MAX_INSNS) return NULL;
+	return (vm_active == vm_programs[0]) ? vm_programs[1] : vm_programs[0];
+}
+
+/*
+*	Verify the program in the staging buffer and make it the active program
+*
+*	Only called from the main loop, which never runs a frame at the same
+*	time, so the swap always happens between two frames.
+*
+*	@param count - number of instructions loaded.
+*	@param *bad - set to the index of the first instruction that failed.
+*
+*/
+int vm_commit(uint16_t count, uint16_t *bad)
+{
+	struct vm_insn *staging = vm_staging(count);
+	int status;
+
+	*bad = 0;
+	if (staging == NULL)
+	{
+		vm_stats.rejected++;
+		return (count == 0) ? P4_ERR_INVALID : P4_ERR_FULL;
+	}
+	status = vm_verify(staging, count, bad);
+	if (status != P4_OK)
+	{
+		vm_stats.rejected++;
+		return status;
+	}
+
+	vm_active_len = count;
+	vm_active = staging;
+	vm_stats.loads++;
+	return P4_OK;
+}
+
+/*
+*	Go back to the compiled pipeline
+*
+*/
+void vm_unload(void)
+{
+	vm_active = NULL;
+	vm_active_len = 0;
+	return;
+}
+
+/*
+*	Run a verified program on a frame
+*
+*	@param *insns - pointer to the program.
+*	@param *p_frame - pointer to the frame.
+*	@param size - size of the frame.
+*	@param port - the port the frame was received on.
+*
+*/
+HOT_PATH_TABLES
+void vm_run(const struct vm_insn *insns, uint8_t *p_frame, uint16_t size, uint8_t port)
+{
+	uint32_t r[VM_REGS] = {0};
+	uint8_t key[P4_KEY_MAX] = {0};
+	const uint8_t *data = vm_no_data;
+	const struct vm_insn *insn;
+	struct p4_table *table;
+	struct p4_table_entry *entry;
+	struct p4_register *reg;
+	uint32_t operand, offset;
+	uint16_t pc = 0;
+	uint16_t vlan_tci = 0;
+	uint8_t vlan_action = VLAN_ACTION_NONE;
+
+	vm_stats.packets++;
+	r[0] = port;
+	r[1] = size;
+
+	while (1)
+	{
+		insn = &insns[pc++];
+		operand = (insn->src == VM_IMM) ? insn->imm : r[insn->src];
+
+		switch (insn->op)
+		{
+			case VM_DROP:
+			return;
+
+			case VM_OUT:
+			if (operand >= 1 && operand <= TOTAL_PORTS)
+			{
+				uint64_t egress_ns = sys_get_ns();
+				gmac_write_vlan(p_frame, size, operand, vlan_action, vlan_tci);
+				switch_latency(switch_rx_ns, egress_ns);
+			}
+			return;
+
+			case VM_LDI:
+			r[insn->dst] = insn->imm;
+			break;
+
+			case VM_MOV:
+			r[insn->dst] = operand;
+			break;
+
+			case VM_ADD:
+			r[insn->dst] += operand;
+			break;
+
+			case VM_SUB:
+			r[insn->dst] -= operand;
+			break;
+
+			case VM_AND:
+			r[insn->dst] &= operand;
+			break;
+
+			case VM_OR:
+			r[insn->dst] |= operand;
+			break;
+
+			case VM_XOR:
+			r[insn->dst] ^= operand;
+			break;
+
+			case VM_SHL:
+			r[insn->dst] <<= (operand & 31);
+			break;
+
+			case VM_SHR:
+			r[insn->dst] >>= (operand & 31);
+			break;
+
+			case VM_JMP:
+			pc = insn->jump;
+			break;
+
+			case VM_JEQ:
+			if (r[insn->dst] == operand) pc = insn->jump;
+			break;
+
+			case VM_JNE:
+			if (r[insn->dst] != operand) pc = insn->jump;
+			break;
+
+			case VM_JLT:
+			if (r[insn->dst] < operand) pc = insn->jump;
+			break;
+
+			case VM_JGE:
+			if (r[insn->dst] >= operand) pc = insn->jump;
+			break;
+
+			case VM_LDP:
+			case VM_STP:
+			offset = insn->off;
+			if (insn->src != VM_IMM)
+			{
+				if (r[insn->src] > size) offset = size;	// Past the end, fails below
+				else offset += r[insn->src];
+			}
+			if (offset + insn->size > size)
+			{
+				vm_stats.faults++;
+				return;
+			}
+			if (insn->op == VM_LDP) r[insn->dst] = vm_load(p_frame + offset, insn->size);
+			else vm_store(p_frame + offset, insn->size, r[insn->dst]);
+			break;
+
+			case VM_KEY:
+			vm_store(key + insn->off, insn->size, r[insn->dst]);
+			break;
+
+			case VM_LOOKUP:
+			table = p4_get_table(insn->size);
+			entry = p4_table_lookup(table, key);
+			if (entry != NULL)
+			{
+				entry->packets++;
+				entry->bytes += size;
+				r[insn->dst] = entry->action_id;
+				data = entry->data;
+			} else {
+				r[insn->dst] = table->default_action;
+				data = table->default_data;
+			}
+			if (insn->src != VM_IMM) r[insn->src] = (entry != NULL);
+			break;
+
+			case VM_LDD:
+			r[insn->dst] = vm_load(data + insn->off, insn->size);
+			break;
+
+			case VM_COUNT:
+			p4_counter_count(p4_get_counter(insn->size), operand, size);
+			break;
+
+			case VM_RREAD:
+			reg = p4_get_register(insn->size);
+			r[insn->dst] = (operand < reg->size) ? reg->cells[operand] : 0;
+			break;
+
+			case VM_RWRITE:
+			reg = p4_get_register(insn->size);
+			if (operand < reg->size) reg->cells[operand] = r[insn->dst];
+			break;
+
+			case VM_LIVE:
+			r[insn->dst] = port_is_live(operand);
+			break;
+
+			case VM_FLOW:
+			p4_flow_update(r[insn->dst], r[insn->dst+1], r[insn->dst+2], r[insn->dst+3], r[insn->dst+4], port, size);
+			break;
+
+			case VM_PUNT:
+			p4_packet_in(insn->size, p_frame, size, port);
+			break;
+
+			case VM_PUSH:
+			vlan_action = VLAN_ACTION_PUSH;
+			vlan_tci = operand;
+			break;
+
+			case VM_POP:
+			vlan_action = VLAN_ACTION_POP;
+			break;
+		}
+	}
+}
+
+/*
+*	Time the compiled pipeline and the interpreter on the same frame
+*
+*	The frame is GMAC_FRAME_LENTGH_MAX bytes long, so gmac_write()
+*	discards it and nothing is sent. The flow cache sees one test flow.
+*
+*	@param runs - number of frames to run through each.
+*	@param *compiled - set to the cycles per frame of packet_in().
+*	@param *interpreted - set to the cycles per frame of vm_run().
+*
+*/
+void vm_bench(uint32_t runs, uint32_t *compiled, uint32_t *interpreted)
+{
+	uint8_t frame[GMAC_FRAME_LENTGH_MAX];
+	uint32_t packets = vm_stats.packets;
+	struct latency_stats latency = latency_stats;
+	uint32_t start;
+
+	memset(frame, 0, sizeof(frame));
+	frame[12] = 0x08;		// IPv4
+	frame[14] = 0x45;
+	frame[22] = 64;
+	frame[23] = 17;			// UDP
+	frame[26] = 192;		// 192.0.2.1 to 192.0.2.2
+	frame[28] = 2;
+	frame[29] = 1;
+	frame[30] = 192;
+	frame[32] = 2;
+	frame[33] = 2;
+
+	start = DWT->CYCCNT;
+	for (uint32_t x=0;x<runs;x++) packet_in(frame, sizeof(frame), 1);
+	*compiled = (DWT->CYCCNT - start) / runs;
+
+	start = DWT->CYCCNT;
+	for (uint32_t x=0;x<runs;x++) vm_run(vm_bench_program, frame, sizeof(frame), 1);
+	*interpreted = (DWT->CYCCNT - start) / runs;
+
+	vm_stats.packets = packets;	// Only count forwarded frames
+	latency_stats = latency;
+	return;
+}
@@ -0,0 +1,114 @@
+/**
+ * @file
+ * zodiacfx-vm.h
+ *
+ * This file contains the declarations for the P4 bytecode interpreter
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX P4 firmware.
+ * Copyright (c) 2019 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Paul Zanna <paul@northboundnetworks.com>
+ *
+ */
+
+#ifndef ZODIACFX_VM_H_
+#define ZODIACFX_VM_H_
+
+#include <asf.h>
+
+#define VM_REGS		16	// 32 bit registers, r0 = input port and r1 = frame size on entry
+#define VM_MAX_INSNS	96	// Longest program that can be loaded
+#define VM_IMM		0xFF	// Operand register value that selects the immediate
+
+/*
+*	Bytecode form of a P4 program, loaded by the controller with
+*	CTRL_PROGRAM_LOAD and run in place of the compiled packet_in().
+*	Parser states, table applies and actions all become straight line
+*	code with forward branches, so every program ends after at most
+*	one pass over its instructions.
+*
+*	Instructions. "operand" is r[src], or imm if src is VM_IMM. Packet
+*	offsets are off + r[src], or just off if src is VM_IMM. Multi byte
+*	packet, key and action data fields are big endian.
+*
+*/
+enum vm_op {
+	VM_DROP,	// End, the frame is not sent
+	VM_OUT,		// End, send the frame out of port operand
+	VM_LDI,		// r[dst] = imm
+	VM_MOV,		// r[dst] = r[src]
+	VM_ADD,		// r[dst] = r[dst] + operand
+	VM_SUB,
+	VM_AND,
+	VM_OR,
+	VM_XOR,
+	VM_SHL,
+	VM_SHR,
+	VM_JMP,		// Go to jump
+	VM_JEQ,		// Go to jump if r[dst] == operand
+	VM_JNE,
+	VM_JLT,
+	VM_JGE,
+	VM_LDP,		// r[dst] = size bytes of the frame at the packet offset
+	VM_STP,		// size bytes of the frame at the packet offset = r[dst]
+	VM_KEY,		// size bytes of the lookup key at off = r[dst]
+	VM_LOOKUP,	// Look up the key in table size, r[dst] = action, r[src] = 1 on a hit unless src is VM_IMM
+	VM_LDD,		// r[dst] = size bytes of the action data at off
+	VM_COUNT,	// Count the frame in cell operand of counter array size
+	VM_RREAD,	// r[dst] = cell operand of register array size, 0 if out of range
+	VM_RWRITE,	// Cell operand of register array size = r[dst]
+	VM_LIVE,	// r[dst] = 1 if port operand has link
+	VM_FLOW,	// Flow cache update, r[dst] to r[dst+4] = src, dst, protocol, src port, dst port
+	VM_PUNT,	// Send the frame to the controller with reason size
+	VM_PUSH,	// Push a VLAN tag with TCI operand when the frame is sent
+	VM_POP,		// Pop the outer VLAN tag when the frame is sent
+	VM_OPS
+};
+
+/* One instruction, 12 bytes */
+struct vm_insn {
+	uint8_t op;	// enum vm_op
+	uint8_t dst;
+	uint8_t src;
+	uint8_t size;	// Access size (1, 2 or 4), or a table, counter, register or punt reason
+	uint16_t jump;	// Branch target, only forward branches are allowed
+	uint16_t off;
+	uint32_t imm;
+};
+
+/* Interpreter counters */
+struct vm_stats {
+	uint32_t loads;		// Programs loaded
+	uint32_t rejected;	// Programs that failed verification
+	uint32_t packets;	// Frames run through the loaded program
+	uint32_t faults;	// Frames dropped for a packet access past the end of the frame
+};
+
+extern const struct vm_insn *vm_active;	// Program the dataplane runs, NULL to run the compiled pipeline
+extern uint16_t vm_active_len;
+extern struct vm_stats vm_stats;
+
+struct vm_insn *vm_staging(uint16_t count);
+int vm_verify(const struct vm_insn *insns, uint16_t count, uint16_t *bad);
+int vm_commit(uint16_t count, uint16_t *bad);
+void vm_unload(void);
+void vm_run(const struct vm_insn *insns, uint8_t *p_frame, uint16_t size, uint8_t port);
+void vm_bench(uint32_t runs, uint32_t *compiled, uint32_t *interpreted);
+
+#endif /* ZODIACFX_VM_H_ */
@@ -0,0 +1,91 @@
+/**
+ * @file
+ * boot.c
+ *
+ * This file contains the boot timeline
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX P4 firmware.
+ * Copyright (c) 2019 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Paul Zanna <paul@northboundnetworks.com>
+ *
+ */
+
+#include <asf.h>
+#include "boot.h"
+#include "timers.h"
+
+// Global variables
+struct boot_event boot_events[BOOT_MAX_EVENTS];
+uint8_t boot_event_count = 0;
+
+/*
+*	Start the DWT cycle counter the timeline is measured with.
+*	Called as soon as the clocks are running.
+*
+*/
+void boot_init(void)
+{
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+	boot_mark("Clocks");
+	return;
+}
+
+/*
+*	Record a step in the boot timeline
+*
+*	@param *name - name of the step, must be a string constant.
+*
+*/
+void boot_mark(const char *name)
+{
+	if (boot_event_count >= BOOT_MAX_EVENTS) return;
+	if (sys_get_ms() > BOOT_TIMELINE_MS) return;	// 0 until the 1 ms timer is started
+
+	boot_events[boot_event_count].name = name;
+	boot_events[boot_event_count].cycles = DWT->CYCCNT;
+	boot_event_count++;
+	return;
+}
+
+/*
+*	Time since boot_init() in us, only valid for the first 35 s
+*
+*/
+uint32_t boot_us(void)
+{
+	return DWT->CYCCNT / (sysclk_get_cpu_hz() / 1000000);
+}
+
+/*
+*	Wait for a short time, used where the hardware has nothing to poll
+*
+*	@param us - time to wait in us.
+*
+*/
+void boot_delay_us(uint32_t us)
+{
+	uint32_t start = DWT->CYCCNT;
+	uint32_t cycles = us * (sysclk_get_cpu_hz() / 1000000);
+
+	while ((DWT->CYCCNT - start) < cycles);
+	return;
+}
@@ -0,0 +1,52 @@
+/**
+ * @file
+ * boot.h
+ *
+ * This file contains the declarations for the boot timeline
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX P4 firmware.
+ * Copyright (c) 2019 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Paul Zanna <paul@northboundnetworks.com>
+ *
+ */
+
+#ifndef BOOT_H_
+#define BOOT_H_
+
+#include <asf.h>
+
+#define BOOT_MAX_EVENTS		20	// Events kept in the timeline
+#define BOOT_TIMELINE_MS	30000	// Events after this are not recorded, the cycle counter wraps at 35 s
+
+/* One step in the boot timeline */
+struct boot_event {
+	const char *name;
+	uint32_t cycles;	// CPU cycles since boot_init()
+};
+
+extern struct boot_event boot_events[BOOT_MAX_EVENTS];
+extern uint8_t boot_event_count;
+
+void boot_init(void);
+void boot_mark(const char *name);
+uint32_t boot_us(void);
+void boot_delay_us(uint32_t us);
+
+#endif /* BOOT_H_ */
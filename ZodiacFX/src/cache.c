@@ -0,0 +1,144 @@
+/**
+ * @file
+ * cache.c
+ *
+ * This file contains the flash cache (CMCC) functions
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX P4 firmware.
+ * Copyright (c) 2019 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Paul Zanna <paul@northboundnetworks.com>
+ *
+ */
+
+#include <asf.h>
+#include "cache.h"
+
+/*
+*	Turn on the flash cache, called once the last EFC command of the
+*	boot (the unique ID read) has run
+*
+*/
+void cache_init(void)
+{
+	CMCC->CMCC_MCFG = CMCC_MCFG_MODE_IHIT_COUNT;
+	CMCC->CMCC_MEN = CMCC_MEN_MENABLE;
+	cache_invalidate();
+	cache_enable(true);
+	return;
+}
+
+/*
+*	Turn the flash cache on or off
+*
+*	@param enable - true to cache flash reads.
+*
+*/
+void cache_enable(bool enable)
+{
+	if (enable)
+	{
+		CMCC->CMCC_CTRL = CMCC_CTRL_CEN;
+	} else {
+		CMCC->CMCC_CTRL = 0;
+		while (CMCC->CMCC_SR & CMCC_SR_CSTS);
+	}
+	return;
+}
+
+/*
+*	Is the flash cache on
+*
+*/
+bool cache_enabled(void)
+{
+	return (CMCC->CMCC_SR & CMCC_SR_CSTS) != 0;
+}
+
+/*
+*	Drop every cached line
+*
+*	The CMCC does not see EFC writes, so this must follow every flash
+*	erase or write before the flash is read back.
+*
+*/
+void cache_invalidate(void)
+{
+	CMCC->CMCC_MAINT0 = CMCC_MAINT0_INVALL;
+	return;
+}
+
+/*
+*	Clear the instruction hit counter
+*
+*/
+void cache_monitor_reset(void)
+{
+	CMCC->CMCC_MCTRL = CMCC_MCTRL_SWRST;
+	return;
+}
+
+/*
+*	Instruction fetches served from the cache since cache_monitor_reset()
+*
+*/
+uint32_t cache_monitor_hits(void)
+{
+	return CMCC->CMCC_MSR;
+}
+
+/*
+*	Bytes of SRAM taken by code placed with RAMFUNC or HOT_PATH
+*
+*/
+uint32_t ramfunc_size(void)
+{
+	return (uint32_t)&_eramfunc - (uint32_t)&_sramfunc;
+}
+
+/*
+*	Erase flash pages and drop the stale cached copies
+*
+*	@param addr - address of the first page.
+*	@param pages - IFLASH_ERASE_PAGES_x.
+*
+*/
+uint32_t cache_flash_erase(uint32_t addr, uint8_t pages)
+{
+	uint32_t rc = flash_erase_page(addr, pages);
+
+	cache_invalidate();
+	return rc;
+}
+
+/*
+*	Write flash pages and drop the stale cached copies
+*
+*	@param addr - address to write to.
+*	@param *data - data to write.
+*	@param size - bytes to write.
+*
+*/
+uint32_t cache_flash_write(uint32_t addr, const void *data, uint32_t size)
+{
+	uint32_t rc = flash_write(addr, data, size, 0);
+
+	cache_invalidate();
+	return rc;
+}
@@ -0,0 +1,49 @@
+/**
+ * @file
+ * cache.h
+ *
+ * This file contains the declarations for the flash cache and SRAM code placement
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX P4 firmware.
+ * Copyright (c) 2019 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Paul Zanna <paul@northboundnetworks.com>
+ *
+ */
+
+#ifndef CACHE_H_
+#define CACHE_H_
+
+#include <asf.h>
+
+/* Ends of the .ramfunc code copied into SRAM at startup, set in flash.ld */
+extern uint32_t _sramfunc;
+extern uint32_t _eramfunc;
+
+void cache_init(void);
+void cache_enable(bool enable);
+bool cache_enabled(void);
+void cache_invalidate(void);
+void cache_monitor_reset(void);
+uint32_t cache_monitor_hits(void);
+uint32_t ramfunc_size(void);
+uint32_t cache_flash_erase(uint32_t addr, uint8_t pages);
+uint32_t cache_flash_write(uint32_t addr, const void *data, uint32_t size);
+
+#endif /* CACHE_H_ */
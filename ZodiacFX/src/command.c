@@ -37,16 +37,41 @@
 #include "common.h"
 #include "conf_eth.h"
 #include "eeprom.h"
+#include "config_log.h"
+#include "console.h"
+#include "boot.h"
 #include "switch.h"
+#include "update.h"
+#include "pktbuf.h"
+#include "egress.h"
+#include "sched.h"
+#include "wheel.h"
 #include "lwip/def.h"
 #include "timers.h"
+#include "cache.h"
+#include "memory.h"
 #include "lwip/ip_addr.h"
 #include "lwip/tcp.h"
+#include "P4/zodiacfx-hash.h"
+#include "P4/zodiacfx-digest.h"
+#include "P4/zodiacfx-tables.h"
+#include "P4/zodiacfx-punt.h"
+#include "P4/zodiacfx-flow.h"
+#include "P4/zodiacfx-persist.h"
+#include "P4/zodiacfx-vm.h"
+#include "P4/zodiacfx-p4.h"
+#include "controller.h"
 
 #define RSTC_KEY  0xA5000000
+#define HASH_BENCH_RUNS	1000
+#define VM_BENCH_RUNS	1000
+#define RX_BENCH_RUNS	1000
+#define RCU_BENCH_UPDATES	10000
+#define RCU_BENCH_SLICE		64	// Updates applied between forwarding passes
 
 // Global variables
 extern struct zodiac_config Zodiac_Config;
+extern struct netif gs_net_if;
 
 extern int charcount, charcount_last;
 bool trace = false;
@@ -55,12 +80,20 @@ extern int totaltime;
 extern int32_t ul_temp;
 extern uint32_t uid_buf[4];
 extern bool restart_required_outer;
+extern struct vlan_entry vlan_table[MAX_ACTIVE_VLANS];
+extern uint32_t vlan_hw_offload, vlan_sw_rewrite;
+extern uint32_t port_link_flaps[TOTAL_PORTS];
+extern uint32_t port_failover_ms[TOTAL_PORTS];
+extern uint32_t port_failover_max_ms[TOTAL_PORTS];
+extern gmac_device_t gs_gmac_dev;
 
 // Local Variables
 bool showintro = true;
 uint8_t uCLIContext = 0;
 struct arp_header arp_test;
 uint8_t esc_char = 0;
+static bool cli_busy = false;	// A command is still running as deferred work, the prompt is printed when it finishes
+static uint8_t cli_step = 0;	// Step the running command is on
 
 // Internal Functions
 void saveConfig(void);
@@ -69,24 +102,39 @@ void command_config(char *command, char *param1, char *param2, char *param3);
 void command_debug(char *command, char *param1, char *param2, char *param3);
 void printintro(void);
 void printhelp(void);
+static void print_prompt(void);
+static bool show_ports_step(void *arg);
 
 /*
-*	Load the configuration settings from EEPROM
+*	Load the configuration settings from the configuration log
+*
+*	The first time this firmware runs the log is empty, so the settings
+*	are read from the EEPROM and saved to the log.
 *
 */
 void loadConfig(void)
 {
-	eeprom_read();
+	if (cfglog_load() == 0)
+	{
+		eeprom_read();
+		memset(Zodiac_Config.flow_collector, 0, sizeof(Zodiac_Config.flow_collector));	// Not in the EEPROM layout
+		Zodiac_Config.flow_collector_port = 0;
+		Zodiac_Config.egress_sched = 0;
+		memset(Zodiac_Config.egress_weight, 0, sizeof(Zodiac_Config.egress_weight));
+		Zodiac_Config.egress_aqm = 0;
+		cfglog_save();
+	}
 	return;
 }
 
 /*
-*	Save the configuration settings to EEPROM
+*	Save the configuration settings, written from the main loop by cfglog_task()
 *
 */
 void saveConfig(void)
 {
-	eeprom_write();
+	printf("Saving configuration\r\n");
+	cfglog_save();
 	return;
 }
 
@@ -96,7 +144,8 @@ void saveConfig(void)
 */
 void software_reset(void)
 {
-	for(int x = 0;x<100000;x++);	// Let the above message get sent to the terminal before detaching
+	while (cfglog_busy()) cfglog_task();	// Finish writing a saved configuration
+	console_flush();	// Let the above message get sent to the terminal before detaching
 	udc_detach();	// Detach the USB device before restart
 	rstc_start_software_reset(RSTC);	// Software reset
 	while (1);
@@ -117,6 +166,9 @@ void task_command(char *str, char *str_last)
 	char *param3;
 	char *pch;
 
+	/* Key presses wait in the USB buffer until the running command has finished */
+	if (cli_busy) return;
+
 	while(udi_cdc_is_rx_ready()){
 		ch = udi_cdc_getc();
 
@@ -180,20 +232,7 @@ void task_command(char *str, char *str_last)
 				};
 			}
 
-			switch(uCLIContext)
-			{
-				case CLI_ROOT:
-				printf("%s# ",Zodiac_Config.device_name);
-				break;
-
-				case CLI_CONFIG:
-				printf("%s(config)# ",Zodiac_Config.device_name);
-				break;
-
-				case CLI_DEBUG:
-				printf("%s(debug)# ",Zodiac_Config.device_name);
-				break;
-			};
+			if (!cli_busy) print_prompt();
 			charcount = 0;
 			str[0] = '\0';
 			esc_char = 0;
@@ -223,6 +262,75 @@ void task_command(char *str, char *str_last)
 	}
 }
 
+/*
+*	Print the command prompt for the current context
+*
+*/
+static void print_prompt(void)
+{
+	switch(uCLIContext)
+	{
+		case CLI_ROOT:
+		printf("%s# ",Zodiac_Config.device_name);
+		break;
+
+		case CLI_CONFIG:
+		printf("%s(config)# ",Zodiac_Config.device_name);
+		break;
+
+		case CLI_DEBUG:
+		printf("%s(debug)# ",Zodiac_Config.device_name);
+		break;
+	};
+	return;
+}
+
+/*
+*	Print one port for 'show ports', run as deferred work
+*
+*	@param *arg - not used.
+*
+*	Returns true until every port has been printed.
+*
+*/
+static bool show_ports_step(void *arg)
+{
+	int i = cli_step++;
+
+	if (i == 0) printf("\r\n-------------------------------------------------------------------------\r\n");
+
+	printf("\r\nPort %d\r\n",i+1);
+	if (i > 3)
+	{
+		printf(" VLAN type: Default\r\n");
+		printf(" VLAN ID: n/a\r\n");
+	} else
+	{
+		printf(" Status: %s\r\n", port_status[i] ? "UP" : "DOWN");
+		printf(" Link flaps: %lu\r\n", port_link_flaps[i]);
+		printf(" Link down detection: %lu ms (max %lu ms)\r\n", port_failover_ms[i], port_failover_max_ms[i]);
+		for (int x=0;x<MAX_VLANS;x++)
+		{
+			if (Zodiac_Config.vlan_list[x].portmap[i] == 1)
+			{
+				if (Zodiac_Config.vlan_list[x].uVlanType == 0) printf(" VLAN type: Unassigned\r\n");
+				if (Zodiac_Config.vlan_list[x].uVlanType == 1) printf(" VLAN type: Default\r\n");
+				printf(" VLAN ID: %d\r\n", Zodiac_Config.vlan_list[x].uVlanID);
+			}
+		}
+	}
+
+	if (cli_step < TOTAL_PORTS) return true;
+
+	printf("\r\n-------------------------------------------------------------------------\r\n\n");
+	if (cli_busy)
+	{
+		cli_busy = false;
+		print_prompt();
+	}
+	return false;
+}
+
 /*
 *	Commands within the root context
 *
@@ -260,50 +368,363 @@ void command_root(char *command, char *param1, char *param2, char *param3)
 		return;
 	}
 
-	// Display ports statics
+	// Display ports statics, one port per pass so forwarding carries on between them
 	if (strcmp(command, "show") == 0 && strcmp(param1, "ports") == 0)
 	{
-		int i;
+		cli_step = 0;
+		if (sched_defer(show_ports_step, NULL))
+		{
+			cli_busy = true;
+		} else {
+			while (show_ports_step(NULL));
+		}
+		return;
+	}
+
+	// Display Config
+	if (strcmp(command, "show")==0 && strcmp(param1, "status")==0){
+
+		printf("\r\n-------------------------------------------------------------------------\r\n");
+		printf("Device Status\r\n");
+		printf(" CPU UID: %d-%d-%d-%d\r\n", uid_buf[0], uid_buf[1], uid_buf[2], uid_buf[3]);
+		printf(" Firmware Version: %s\r\n",VERSION);
+		printf(" CPU Temp: %d C\r\n", (int)ul_temp);
+		printf(" Console output: %lu bytes, %lu dropped (ring full %lu times, peak %d of %d bytes)\r\n", console_stats.written, console_stats.dropped, console_stats.overflows, console_stats.peak, CONSOLE_RING_SIZE);
+		printf("\r\n-------------------------------------------------------------------------\r\n\n");
+		return;
+	}
+
+	// Display the controller connection
+	if (strcmp(command, "show")==0 && strcmp(param1, "controller")==0){
 		printf("\r\n-------------------------------------------------------------------------\r\n");
-		for (i=0;i<TOTAL_PORTS;i++)
+		printf("Controller\r\n");
+		printf(" Status: %s\r\n", controller_connected() ? "Connected" : "Disconnected");
+		printf(" Port: %d\r\n", CONTROLLER_PORT);
+		printf(" Connections: %lu\r\n", ctrl_stats.connects);
+		printf(" Messages sent: %lu\r\n", ctrl_stats.tx_msgs);
+		printf(" Requests handled: %lu\r\n", ctrl_stats.rx_msgs);
+		printf(" Table updates: %lu\r\n", ctrl_stats.updates);
+		printf(" Failed requests: %lu\r\n", ctrl_stats.errors);
+		printf(" Send buffer stalls: %lu\r\n", ctrl_stats.stalls);
+		printf(" Split fields copied: %lu\r\n", ctrl_stats.copies);
+		printf("\r\nManagement frames\r\n");
+		printf(" Received: %lu\r\n", mgmt_stats.frames);
+		printf(" ARP requests: %lu\r\n", mgmt_stats.arp);
+		printf(" Copied: %lu\r\n", mgmt_stats.copied);
+		printf(" Dropped: %lu\r\n", mgmt_stats.dropped);
+		printf(" Sent: %lu\r\n", mgmt_stats.tx_frames);
+		printf(" Sent (copied): %lu\r\n", mgmt_stats.tx_copied);
+		printf(" Send drops: %lu\r\n", mgmt_stats.tx_busy);
+		printf("\r\nLearn digests\r\n");
+		printf(" Queued: %lu\r\n", digest_stats.queued);
+		printf(" Filtered: %lu\r\n", digest_stats.filtered);
+		printf(" Sent: %lu in %lu messages\r\n", digest_stats.sent, digest_stats.messages);
+		printf(" Ring full drops: %lu\r\n", digest_stats.ring_full);
+		printf(" Deferred flushes: %lu\r\n", digest_stats.deferred);
+		printf(" Discarded (not subscribed): %lu\r\n", digest_stats.no_controller);
+		printf("\r\nPacket-in\r\n");
+		printf("Reason  Sample  Rate  Burst  Snap  Seen      Sent      Sampled   Limited   Dropped\r\n");
+		for (int x=0;x<PUNT_MAX_REASONS;x++)
 		{
+			struct punt_reason *r = &punt_reasons[x];
+			if (r->seen == 0) continue;
+			printf("%-7d %-7d %-5d %-6d %-5d %-9lu %-9lu %-9lu %-9lu %lu\r\n", x, r->sample, r->rate, r->burst, r->snaplen, r->seen, r->sent, r->sampled_out, r->rate_limited, r->ring_full);
+		}
+		printf(" Deferred flushes: %lu\r\n", punt_deferred);
+		printf("\r\n-------------------------------------------------------------------------\r\n\n");
+		return;
+	}
+
+	// Display the flow cache
+	if (strcmp(command, "show")==0 && strcmp(param1, "flows")==0){
+		ip_addr_t collector;
+		uint16_t collector_port;
 
-			printf("\r\nPort %d\r\n",i+1);
-			if (i > 3)
+		printf("\r\n-------------------------------------------------------------------------\r\n");
+		printf("Flow cache\r\n");
+		printf(" Active flows: %d of %d\r\n", flow_active_count(), FLOW_CACHE_SIZE);
+		printf(" Created: %lu\r\n", flow_stats.created);
+		printf(" Collision evictions: %lu", flow_stats.collisions);
+		if (flow_stats.created > 0) printf(" (%lu%% of new flows)", (flow_stats.collisions * 100) / flow_stats.created);
+		printf("\r\n Inactive timeouts: %lu\r\n", flow_stats.idle);
+		printf(" Active timeouts: %lu\r\n", flow_stats.active);
+		printf(" Timers: %lu running, %lu expired, %lu moved down a level, latest %lu ms late\r\n", wheel_stats.running, wheel_stats.expired, wheel_stats.cascaded, wheel_stats.late_max);
+		printf("\r\nIPFIX export\r\n");
+		if (flow_get_collector(&collector, &collector_port))
+		{
+			printf(" Collector: %d.%d.%d.%d:%d\r\n", ip4_addr1(&collector), ip4_addr2(&collector), ip4_addr3(&collector), ip4_addr4(&collector), collector_port);
+		} else {
+			printf(" Collector: not set\r\n");
+		}
+		printf(" Records exported: %lu in %lu messages\r\n", flow_stats.exported, flow_stats.messages);
+		printf(" Records lost (queue full): %lu\r\n", flow_stats.lost);
+		printf(" Send errors: %lu\r\n", flow_stats.send_errors);
+		printf("\r\n-------------------------------------------------------------------------\r\n\n");
+		return;
+	}
+
+	// Display the pipeline the dataplane is running
+	if (strcmp(command, "show")==0 && strcmp(param1, "pipeline")==0){
+		printf("\r\n-------------------------------------------------------------------------\r\n");
+		printf("Pipeline\r\n");
+		if (vm_active != NULL)
+		{
+			printf(" Running: loaded program, %d of %d instructions\r\n", vm_active_len, VM_MAX_INSNS);
+		} else {
+			printf(" Running: compiled\r\n");
+		}
+		printf(" Programs loaded: %lu\r\n", vm_stats.loads);
+		printf(" Programs rejected: %lu\r\n", vm_stats.rejected);
+		printf(" Frames interpreted: %lu\r\n", vm_stats.packets);
+		printf(" Frames dropped (bad packet offset): %lu\r\n", vm_stats.faults);
+		printf("\r\nLatency (receive to transmit)\r\n");
+		printf(" Frames: %lu\r\n", latency_stats.frames);
+		printf(" Last: %lu ns\r\n", latency_stats.last_ns);
+		printf(" Worst: %lu ns\r\n", latency_stats.max_ns);
+		for (int x=0;x<LATENCY_BUCKETS;x++)
+		{
+			if (latency_stats.buckets[x] == 0) continue;
+			if (x == 0)
 			{
-				printf(" VLAN type: Default\r\n");
-				printf(" VLAN ID: n/a\r\n");
-			} else
+				printf("   < 1 us: %lu\r\n", latency_stats.buckets[x]);
+			} else if (x == LATENCY_BUCKETS-1) {
+				printf("   >= %d us: %lu\r\n", 1 << (x-1), latency_stats.buckets[x]);
+			} else {
+				printf("   %d - %d us: %lu\r\n", 1 << (x-1), (1 << x) - 1, latency_stats.buckets[x]);
+			}
+		}
+		printf(" Clock: %lu cycles/ms over %lu windows, %lu reads held\r\n", clock_stats.cycles_per_ms, clock_stats.windows, clock_stats.held);
+		printf("\r\n-------------------------------------------------------------------------\r\n\n");
+		return;
+	}
+
+	// Display the runtime tables
+	if (strcmp(command, "show")==0 && strcmp(param1, "tables")==0){
+		static const char *rcu_state[] = {"Idle", "Copying", "Updating", "Grace"};
+		struct p4_table *table;
+		uint32_t us_div = sysclk_get_cpu_hz() / 1000000;
+
+		printf("\r\n-------------------------------------------------------------------------\r\n");
+		printf("ID  Key  Size   Entries  Version  State     Hits        Misses\r\n");
+		for (int x=0;x<P4_MAX_TABLES;x++)
+		{
+			table = p4_get_table(x);
+			if (table == NULL) continue;
+			printf("%-3d %-4d %-6d %-8d %-8lu %-9s %-11lu %lu\r\n", x, table->key_len, table->size, table->count, table->version, rcu_state[table->state], table->hits, table->misses);
+		}
+		printf("\r\nRCU updates\r\n");
+		printf(" Published: %lu\r\n", p4_rcu_stats.commits);
+		printf(" Abandoned: %lu\r\n", p4_rcu_stats.aborts);
+		printf(" Last update: %lu entries in %lu ms\r\n", p4_rcu_stats.updates, p4_rcu_stats.duration_ms);
+		printf(" Longest stall since last begin: %lu us\r\n", p4_rcu_stats.max_stall_cycles / us_div);
+		printf(" Longest request slice: %lu us\r\n", ctrl_stats.max_slice / us_div);
+		printf("\r\nSaved tables\r\n");
+		if (persist_stats.seq != 0)
+		{
+			printf(" Snapshot: %lu, %lu bytes at 0x%08lX\r\n", persist_stats.seq, persist_stats.length, persist_stats.addr);
+		} else {
+			printf(" Snapshot: none\r\n");
+		}
+		printf(" Entries restored at boot: %lu (%lu left out)\r\n", persist_stats.restored, persist_stats.skipped);
+		printf(" Saves: %lu, last took %lu ms%s\r\n", persist_stats.saves, persist_stats.save_ms, persist_busy() ? ", saving" : "");
+		printf(" Bank erases: %lu\r\n", persist_stats.erases);
+		printf(" Failed saves: %lu\r\n", persist_stats.errors);
+		printf("\r\n-------------------------------------------------------------------------\r\n\n");
+		return;
+	}
+
+	if (strcmp(command, "show")==0 && strcmp(param1, "boot")==0){
+		uint32_t us_div = sysclk_get_cpu_hz() / 1000000;
+		uint32_t us, last_us = 0;
+
+		printf("\r\n-------------------------------------------------------------------------\r\n");
+		printf("Boot timeline\r\n");
+		printf("   Time (ms)   Step (ms)  Event\r\n");
+		for (int x=0;x<boot_event_count;x++)
+		{
+			us = boot_events[x].cycles / us_div;
+			printf(" %7lu.%03lu %7lu.%03lu  %s\r\n", us / 1000, us % 1000, (us - last_us) / 1000, (us - last_us) % 1000, boot_events[x].name);
+			last_us = us;
+		}
+		printf("\r\n-------------------------------------------------------------------------\r\n\n");
+		return;
+	}
+
+	// Display the firmware slots
+	if (strcmp(command, "show")==0 && strcmp(param1, "update")==0){
+		static const char *slot_state[] = {"Empty", "Receiving", "Verified, type 'update' to activate", "Failed"};
+
+		printf("\r\n-------------------------------------------------------------------------\r\n");
+		printf("Firmware update\r\n");
+		printf(" Running image: %lu of %d bytes", update_image_size(), UPDATE_IMAGE_MAX);
+		if (update_stats.trial)
+		{
+			printf(", on trial (boot %d of %d)", update_stats.boots, UPDATE_TRIES);
+		} else if (update_stats.reverted)
+		{
+			printf(", restored after a new image failed");
+		}
+		printf("\r\n Upload port: %d\r\n", UPDATE_PORT);
+		printf(" Slot B: %s\r\n", slot_state[update_stats.state]);
+		if (update_stats.state == UPDATE_RECEIVING) printf(" Received: %lu of %lu bytes\r\n", update_stats.received, update_stats.length);
+		if (update_stats.state == UPDATE_READY) printf(" Image: %lu bytes, CRC 0x%08lX, uploaded in %lu ms\r\n", update_stats.length, update_stats.crc32, update_stats.upload_ms);
+		if (update_stats.state == UPDATE_FAILED) printf(" Error: %s\r\n", update_stats.error);
+		printf(" Uploads: %lu, failed: %lu\r\n", update_stats.uploads, update_stats.errors);
+		printf("\r\n-------------------------------------------------------------------------\r\n\n");
+		return;
+	}
+
+	// Display the main loop tasks
+	if (strcmp(command, "show")==0 && param1 != NULL && strcmp(param1, "tasks")==0){
+		printf("\r\n-------------------------------------------------------------------------\r\n");
+		printf("Tasks\r\n");
+		printf(" Task             Class             Runs  Avg us  Max us  Budget  Overruns\r\n");
+		for (int x=0;x<sched_task_count;x++)
+		{
+			struct sched_task *t = &sched_tasks[x];
+			printf(" %-15s  %-10s  %10lu  %6lu  %6lu  %6lu  %8lu\r\n", t->name, sched_class_name[t->class], t->runs,
+				sched_cycles_to_us(t->avg), sched_cycles_to_us(t->max), sched_cycles_to_us(t->budget), t->overruns);
+		}
+		printf("\r\n Passes: %lu, longest %lu us\r\n", sched_stats.passes, sched_cycles_to_us(sched_stats.max_pass));
+		printf(" Background work held back: %lu passes\r\n", sched_stats.held);
+		printf(" Deferred work: %lu runs, %lu refused\r\n", sched_stats.work_runs, sched_stats.work_full);
+		if (sched_stats.overrun != NULL)
+		{
+			printf(" Last overrun: %s, %lu us at %lu ms\r\n", sched_stats.overrun, sched_stats.overrun_us, sched_stats.overrun_ms);
+		}
+		printf("\r\n-------------------------------------------------------------------------\r\n\n");
+		return;
+	}
+
+	// Display the packet buffer pool
+	if (strcmp(command, "show")==0 && param1 != NULL && strcmp(param1, "buffers")==0){
+		gmac_dev_tx_reclaim(&gs_gmac_dev);	// Return the blocks of frames already sent
+
+		printf("\r\n-------------------------------------------------------------------------\r\n");
+		printf("Packet buffers\r\n");
+		printf(" Pool: %d blocks of %d bytes, %d reserved for receive\r\n", PKTBUF_COUNT, PKTBUF_SIZE, PKTBUF_RX_RESERVE);
+		printf(" Free: %d (lowest %d)\r\n\n", pktbuf_stats.held[PKTBUF_FREE], pktbuf_stats.low);
+		printf(" Owner       Held   Peak  Quota       Allocs  Quota drops\r\n");
+		for (int x=PKTBUF_RX;x<PKTBUF_OWNERS;x++)
+		{
+			printf(" %-10s  %4d   %4d   %4d  %11lu  %11lu\r\n", pktbuf_owner_name[x], pktbuf_stats.held[x], pktbuf_stats.peak[x], pktbuf_quota[x], pktbuf_stats.allocs[x], pktbuf_stats.quota[x]);
+		}
+		printf("\r\n Pool empty: %lu\r\n", pktbuf_stats.empty);
+		printf(" Send drops: %lu\r\n", pktbuf_stats.tx_busy);
+		printf(" GMAC receive ring: %lu of %d units of %d bytes used\r\n", gmac_dev_rx_buf_used(&gs_gmac_dev), GMAC_RX_BUFFERS, GMAC_RX_BUFSIZE);
+		printf(" GMAC transmit ring: %lu of %d descriptors used\r\n", gmac_dev_get_tx_load(&gs_gmac_dev), GMAC_TX_BUFFERS);
+		printf("\r\n-------------------------------------------------------------------------\r\n\n");
+		return;
+	}
+
+	// Display the egress queues
+	if (strcmp(command, "show")==0 && param1 != NULL && strcmp(param1, "queues")==0){
+		struct egress_queue *q;
+
+		printf("\r\n-------------------------------------------------------------------------\r\n");
+		printf("Egress queues, %s scheduler, weights %d/%d/%d\r\n", egress_sched_name[Zodiac_Config.egress_sched < EGRESS_SCHEDS ? Zodiac_Config.egress_sched : EGRESS_STRICT], egress_weight(1), egress_weight(2), egress_weight(3));
+		printf(" Sent with nothing queued: %lu\r\n", egress_stats.direct);
+		printf(" Sent from the queues: %lu\r\n", egress_stats.sent);
+		printf(" Dropped with nothing to evict: %lu\r\n", egress_stats.no_block);
+		printf(" AQM: %s, target %d us, interval %d us\r\n\n", egress_aqm_name[Zodiac_Config.egress_aqm < EGRESS_AQMS ? Zodiac_Config.egress_aqm : EGRESS_AQM_OFF], (int)((EGRESS_CODEL_TARGET << EGRESS_TICK_SHIFT) / 1000), (int)((EGRESS_CODEL_INTERVAL << EGRESS_TICK_SHIFT) / 1000));
+		printf(" Port   Class  Depth  Peak     Queued      Drops    Evicted  AQM drops      Marks\r\n");
+		for (int x=0;x<EGRESS_PORTS;x++)
+		{
+			for (int c=0;c<EGRESS_CLASSES;c++)
 			{
-				for (int x=0;x<MAX_VLANS;x++)
+				q = &egress_ports[x].queue[c];
+				if (q->frames == 0 && q->drops == 0) continue;
+				if (x < TOTAL_PORTS)
 				{
-					if (Zodiac_Config.vlan_list[x].portmap[i] == 1)
-					{
-						if (Zodiac_Config.vlan_list[x].uVlanType == 0) printf(" VLAN type: Unassigned\r\n");
-						if (Zodiac_Config.vlan_list[x].uVlanType == 1) printf(" VLAN type: Default\r\n");
-						printf(" VLAN ID: %d\r\n", Zodiac_Config.vlan_list[x].uVlanID);
-					}
+					printf(" %-6d", x + 1);
+				} else {
+					printf(" %-6s", "Multi");
 				}
+				printf(" %-6d %-6d %-5d %9lu  %9lu  %9lu  %9lu  %9lu\r\n", c, q->depth, q->peak, q->frames, q->drops, q->evicted, q->aqm_drops, q->marks);
 			}
-
 		}
 		printf("\r\n-------------------------------------------------------------------------\r\n\n");
-
 		return;
 	}
 
-	// Display Config
-	if (strcmp(command, "show")==0 && strcmp(param1, "status")==0){
+	// Display the SRAM budget
+	if (strcmp(command, "show")==0 && param1 != NULL && strcmp(param1, "memory")==0){
+		struct memory_usage usage;
+		struct p4_table *table;
+		struct p4_counter *counter;
+		struct p4_register *reg;
+		uint32_t bytes, table_bytes = 0;
 
+		memory_usage(&usage);
 		printf("\r\n-------------------------------------------------------------------------\r\n");
-		printf("Device Status\r\n");
-		printf(" CPU UID: %d-%d-%d-%d\r\n", uid_buf[0], uid_buf[1], uid_buf[2], uid_buf[3]);
-		printf(" Firmware Version: %s\r\n",VERSION);
-		printf(" CPU Temp: %d C\r\n", (int)ul_temp);
+		printf("SRAM (%lu bytes)\r\n", (uint32_t)IRAM_SIZE);
+		printf(" Code: %lu\r\n", usage.ramfunc);
+		printf(" Data: %lu\r\n", usage.data);
+		printf(" BSS: %lu\r\n", usage.bss);
+		printf(" Stack: %lu, %lu used at peak (%lu%%)\r\n", usage.stack, usage.stack_peak, (usage.stack_peak * 100) / usage.stack);
+		printf(" Heap: %lu\r\n", usage.heap);
+		printf(" Free: %lu\r\n", usage.free);
+		printf("\r\nPools\r\n");
+		printf(" Packet buffers: %d of %d in use, peak %d\r\n", PKTBUF_COUNT - pktbuf_stats.held[PKTBUF_FREE], PKTBUF_COUNT, PKTBUF_COUNT - pktbuf_stats.low);
+		printf(" GMAC receive ring: %lu of %d units of %d bytes\r\n", gmac_dev_rx_buf_used(&gs_gmac_dev), GMAC_RX_BUFFERS, GMAC_RX_BUFSIZE);
+		printf(" GMAC transmit ring: %lu of %d descriptors\r\n", gmac_dev_get_tx_load(&gs_gmac_dev), GMAC_TX_BUFFERS);
+		printf(" Console ring: %d bytes at peak of %d\r\n", console_stats.peak, CONSOLE_RING_SIZE);
+		printf("\r\nTables\r\n");
+		printf(" ID  Entries  Size   Bytes\r\n");
+		for (int x=0;x<P4_MAX_TABLES;x++)
+		{
+			table = p4_get_table(x);
+			if (table == NULL) continue;
+			bytes = table->size * sizeof(struct p4_table_entry) * ((table->shadow != NULL) ? 2 : 1);
+			table_bytes += bytes;
+			printf(" %-3d %-8d %-6d %lu\r\n", x, table->count, table->size, bytes);
+		}
+		for (int x=0;x<P4_MAX_COUNTERS;x++)
+		{
+			counter = p4_get_counter(x);
+			if (counter != NULL) table_bytes += counter->size * sizeof(struct p4_counter_cell);
+		}
+		for (int x=0;x<P4_MAX_REGISTERS;x++)
+		{
+			reg = p4_get_register(x);
+			if (reg != NULL) table_bytes += reg->size * sizeof(uint32_t);
+		}
+		printf(" Tables, counters and registers: %lu bytes\r\n", table_bytes);
+		printf(" Free SRAM fits %lu more table entries (%d bytes each)\r\n", (uint32_t)(usage.free / sizeof(struct p4_table_entry)), (int)sizeof(struct p4_table_entry));
 		printf("\r\n-------------------------------------------------------------------------\r\n\n");
 		return;
 	}
 
+	// Activate an uploaded image
+	if (strcmp(command, "update")==0)
+	{
+		if (update_stats.state != UPDATE_READY)
+		{
+			printf("No verified image, upload one to TCP port %d first\r\n\n", UPDATE_PORT);
+			return;
+		}
+		printf("Installing the new firmware and restarting, please reopen your terminal application.\r\n");
+		update_activate();
+		return;
+	}
+
+	// Save the tables to flash
+	if (strcmp(command, "save")==0 && param1 != NULL && strcmp(param1, "tables")==0){
+		int status = persist_save();
+
+		if (status == P4_OK)
+		{
+			printf("Saving snapshot %lu, 'show tables' shows when it is done\r\n\n", persist_stats.seq + 1);
+		} else if (status == P4_ERR_BUSY) {
+			printf("A table update or save is in progress, try again when it is done\r\n\n");
+		} else if (status == P4_ERR_FULL) {
+			printf("The tables are too large to save\r\n\n");
+		} else {
+			printf("Unable to write to flash\r\n\n");
+		}
+		return;
+	}
+
 	// Build shortcut - b XX:XX, where XX:XX are the last 4 digits of the new mac address
 	if (strcmp(command, "b")==0)
 	{
@@ -422,6 +843,18 @@ void command_config(char *command, char *param1, char *param2, char *param3)
 		printf(" IP Address: %d.%d.%d.%d\r\n" , Zodiac_Config.IP_address[0], Zodiac_Config.IP_address[1], Zodiac_Config.IP_address[2], Zodiac_Config.IP_address[3]);
 		printf(" Netmask: %d.%d.%d.%d\r\n" , Zodiac_Config.netmask[0], Zodiac_Config.netmask[1], Zodiac_Config.netmask[2], Zodiac_Config.netmask[3]);
 		printf(" Gateway: %d.%d.%d.%d\r\n" , Zodiac_Config.gateway_address[0], Zodiac_Config.gateway_address[1], Zodiac_Config.gateway_address[2], Zodiac_Config.gateway_address[3]);
+		if (Zodiac_Config.flow_collector_port != 0)
+		{
+			printf(" Flow collector: %d.%d.%d.%d:%d\r\n", Zodiac_Config.flow_collector[0], Zodiac_Config.flow_collector[1], Zodiac_Config.flow_collector[2], Zodiac_Config.flow_collector[3], Zodiac_Config.flow_collector_port);
+		}
+		printf(" Egress scheduler: %s %d/%d/%d\r\n", egress_sched_name[Zodiac_Config.egress_sched < EGRESS_SCHEDS ? Zodiac_Config.egress_sched : EGRESS_STRICT], egress_weight(1), egress_weight(2), egress_weight(3));
+		printf(" Egress AQM: %s\r\n", egress_aqm_name[Zodiac_Config.egress_aqm < EGRESS_AQMS ? Zodiac_Config.egress_aqm : EGRESS_AQM_OFF]);
+		printf("\r\nConfiguration log\r\n");
+		printf(" Saves: %lu (%lu unchanged)%s\r\n", cfglog_stats.saves, cfglog_stats.unchanged, cfglog_busy() ? ", writing" : "");
+		printf(" Last save: %lu\r\n", cfglog_stats.seq);
+		printf(" Pages used: %lu of %d\r\n", cfglog_stats.pages, CFGLOG_BANK_SIZE / IFLASH_PAGE_SIZE);
+		printf(" Bank erases: %lu\r\n", cfglog_stats.erases);
+		printf(" Write errors: %lu\r\n", cfglog_stats.errors);
 		printf("\r\n-------------------------------------------------------------------------\r\n\n");
 		return;
 	}
@@ -446,6 +879,27 @@ void command_config(char *command, char *param1, char *param2, char *param3)
 		return;
 	}
 
+	// Display the VLANs programmed into the switch
+	if (strcmp(command, "show")==0 && strcmp(param1, "vlan-table")==0){
+		int x;
+		printf("\r\n\tVLAN ID\tFID\tMembers\t\tTagged\r\n");
+		printf("-------------------------------------------------------------------------------\r\n");
+		for (x=0;x<MAX_ACTIVE_VLANS;x++)
+		{
+			if (vlan_table[x].active == 1)
+			{
+				printf("\t%d\t%d\t", vlan_table[x].vid, vlan_table[x].fid);
+				for (int i=0;i<5;i++) printf("%c", (vlan_table[x].members & (1 << i)) ? '1'+i : '-');
+				printf("\t\t");
+				for (int i=0;i<4;i++) printf("%c", (vlan_table[x].tagged & (1 << i)) ? '1'+i : '-');
+				printf("\r\n");
+			}
+		}
+		printf("\r\n Tag push/pop offloaded: %lu, rewritten: %lu\r\n", vlan_hw_offload, vlan_sw_rewrite);
+		printf("-------------------------------------------------------------------------------\r\n\n");
+		return;
+	}
+
 //
 //
 // VLAN commands
@@ -487,6 +941,7 @@ void command_config(char *command, char *param1, char *param2, char *param3)
 				Zodiac_Config.vlan_list[x].uVlanType = 0;
 				Zodiac_Config.vlan_list[x].uTagged = 0;
 				Zodiac_Config.vlan_list[x].uVlanID = 0;
+				switch_vlan_delete(vlanid);	// Remove it from the switch now rather than at the next restart
 				printf("VLAN %d deleted\r\n",vlanid);
 				return;
 			}
@@ -604,6 +1059,61 @@ void command_config(char *command, char *param1, char *param2, char *param3)
 			return;
 	}
 
+	// Add a VLAN to the switch now, it is saved with the tables rather than the config
+	if (strcmp(command, "add")==0 && strcmp(param1, "vlan-table")==0)
+	{
+		int vlanid;
+		uint8_t members = 0;
+		uint8_t tagged = 0;
+
+		if (param2 == NULL || param3 == NULL)
+		{
+			printf("Usage: add vlan-table <vlan id> <ports>\r\n");
+			return;
+		}
+		vlanid = atoi(param2);
+
+		// Ports are listed as 1 - 5 (5 = CPU port), a 't' after a port makes it tagged, e.g. 12t5
+		for (char *p = param3; *p != 0; p++)
+		{
+			if (*p >= '1' && *p <= '5')
+			{
+				members |= 1 << (*p - '1');
+			} else if (*p == 't' && p > param3 && p[-1] >= '1' && p[-1] <= '4') {
+				tagged |= 1 << (p[-1] - '1');
+			} else {
+				printf("Invalid port list\r\n");
+				return;
+			}
+		}
+		if (members == 0)
+		{
+			printf("Invalid port list\r\n");
+			return;
+		}
+		if (switch_vlan_set(vlanid, members, tagged) != 0)
+		{
+			printf("Unable to add VLAN %d\r\n", vlanid);
+			return;
+		}
+		printf("Added VLAN %d\r\n", vlanid);
+		return;
+	}
+
+	// Remove a VLAN from the switch
+	if (strcmp(command, "delete")==0 && strcmp(param1, "vlan-table")==0)
+	{
+		int vlanid = (param2 != NULL) ? atoi(param2) : 0;
+
+		if (switch_vlan_delete(vlanid) != 0)
+		{
+			printf("Unknown VLAN ID\r\n");
+			return;
+		}
+		printf("VLAN %d deleted\r\n", vlanid);
+		return;
+	}
+
 //
 //
 // Configuration commands
@@ -640,6 +1150,80 @@ void command_config(char *command, char *param1, char *param2, char *param3)
 		return;
 	}
 
+	// Set the IPFIX collector
+	if (strcmp(command, "set")==0 && strcmp(param1, "flow-collector")==0)
+	{
+		int ip1,ip2,ip3,ip4;
+		int port = IPFIX_PORT;
+		ip_addr_t collector;
+
+		if (param2 == NULL || strlen(param2) > 15 || sscanf(param2, "%d.%d.%d.%d", &ip1, &ip2,&ip3,&ip4) != 4)
+		{
+			printf("incorrect format\r\n");
+			return;
+		}
+		if (param3 != NULL) port = atoi(param3);
+		IP4_ADDR(&collector, ip1, ip2, ip3, ip4);
+		flow_set_collector(&collector, port);
+		Zodiac_Config.flow_collector[0] = ip1;
+		Zodiac_Config.flow_collector[1] = ip2;
+		Zodiac_Config.flow_collector[2] = ip3;
+		Zodiac_Config.flow_collector[3] = ip4;
+		Zodiac_Config.flow_collector_port = port;
+		if (port == 0)
+		{
+			printf("Flow export stopped\r\n");
+		} else {
+			printf("Flow collector set to %d.%d.%d.%d:%d\r\n", ip1, ip2, ip3, ip4, port);
+		}
+		return;
+	}
+
+	// Set the egress queue scheduler
+	if (strcmp(command, "set")==0 && strcmp(param1, "egress-sched")==0)
+	{
+		int w1 = 0, w2 = 0, w3 = 0;
+		int sched;
+
+		for (sched=0;sched<EGRESS_SCHEDS;sched++)
+		{
+			if (param2 != NULL && strcmp(param2, egress_sched_name[sched]) == 0) break;
+		}
+		if (sched == EGRESS_SCHEDS || (param3 != NULL && sscanf(param3, "%d/%d/%d", &w1, &w2, &w3) != 3) || w1 < 0 || w1 > 255 || w2 < 0 || w2 > 255 || w3 < 0 || w3 > 255)
+		{
+			printf("incorrect format\r\n");
+			return;
+		}
+		Zodiac_Config.egress_sched = sched;
+		Zodiac_Config.egress_weight[0] = 0;	// Network control is always sent first
+		Zodiac_Config.egress_weight[1] = w1;
+		Zodiac_Config.egress_weight[2] = w2;
+		Zodiac_Config.egress_weight[3] = w3;
+		egress_configure(Zodiac_Config.egress_sched, Zodiac_Config.egress_weight);
+		printf("Egress scheduler set to %s %d/%d/%d\r\n", egress_sched_name[sched], egress_weight(1), egress_weight(2), egress_weight(3));
+		return;
+	}
+
+	// Set the egress queue AQM
+	if (strcmp(command, "set")==0 && strcmp(param1, "egress-aqm")==0)
+	{
+		int aqm;
+
+		for (aqm=0;aqm<EGRESS_AQMS;aqm++)
+		{
+			if (param2 != NULL && strcmp(param2, egress_aqm_name[aqm]) == 0) break;
+		}
+		if (aqm == EGRESS_AQMS)
+		{
+			printf("incorrect format\r\n");
+			return;
+		}
+		Zodiac_Config.egress_aqm = aqm;
+		egress_set_aqm(aqm);
+		printf("Egress AQM set to %s\r\n", egress_aqm_name[aqm]);
+		return;
+	}
+
 	// Set IP Address
 	if (strcmp(command, "set")==0 && strcmp(param1, "ip-address")==0)
 	{
@@ -775,6 +1359,185 @@ void command_debug(char *command, char *param1, char *param2, char *param3)
 		printf("Starting trace...\r\n");
 		return;
 	}	
+
+	// Time an RCU update of RCU_BENCH_UPDATES entries, forwarding between slices
+	if (strcmp(command, "bench")==0 && strcmp(param1, "rcu")==0)
+	{
+		uint8_t id = (param2 != NULL) ? atoi(param2) : P4_TABLE_FORWARD;
+		struct p4_table *table = p4_get_table(id);
+		uint8_t key[P4_KEY_MAX];
+		uint8_t data[P4_DATA_MAX];
+		uint32_t start, cycles;
+		uint32_t max_cycles = 0;
+		uint32_t slices = 0;
+		uint32_t failed = 0;
+		uint32_t window;
+		uint32_t begin_ms = sys_get_ms();
+		uint32_t n = 0;
+
+		if (table == NULL || table->shadow == NULL)
+		{
+			printf("No table with that ID that has a shadow\r\n\n");
+			return;
+		}
+		if (p4_table_begin(table) != P4_OK)
+		{
+			printf("Table %d is already being updated\r\n\n", id);
+			return;
+		}
+		window = table->size / 2;	// Keys kept in the table at once
+		memset(key, 0, sizeof(key));
+		memset(data, 0, sizeof(data));
+
+		while (n < RCU_BENCH_UPDATES || table->state == P4_RCU_COPY)
+		{
+			start = DWT->CYCCNT;
+			if (table->state == P4_RCU_COPY)
+			{
+				p4_tables_task();
+			} else {
+				/* Rebuild from empty, add a new key and retire the oldest once the window is full */
+				if (n == 0) p4_table_clear(table);
+				for (int x=0;x<RCU_BENCH_SLICE && n<RCU_BENCH_UPDATES;x++,n++)
+				{
+					if ((n & 1) && n/2 >= window)
+					{
+						key[0] = (n/2 - window) >> 24;
+						key[1] = (n/2 - window) >> 16;
+						key[2] = (n/2 - window) >> 8;
+						key[3] = n/2 - window;
+						if (p4_table_delete(table, key) != P4_OK) failed++;
+					} else {
+						key[0] = (n/2) >> 24;
+						key[1] = (n/2) >> 16;
+						key[2] = (n/2) >> 8;
+						key[3] = n/2;
+						data[0] = n;
+						if (p4_table_add(table, key, 1, data, sizeof(data)) != P4_OK && p4_table_modify(table, key, 1, data, sizeof(data)) != P4_OK) failed++;
+					}
+				}
+			}
+			cycles = DWT->CYCCNT - start;
+			if (cycles > max_cycles) max_cycles = cycles;
+			slices++;
+
+			/* Keep forwarding between slices */
+			task_switch(&gs_net_if);
+			p4_quiescent();
+		}
+		/* Leave the table as it was */
+		p4_table_abort(table);
+
+		printf("RCU update of %d entries, table %d (%d slots)\r\n", RCU_BENCH_UPDATES, id, table->size);
+		printf(" Slices: %lu\r\n", slices);
+		printf(" Longest dataplane stall: %lu us\r\n", max_cycles / (sysclk_get_cpu_hz() / 1000000));
+		printf(" Total time: %lu ms\r\n", sys_get_ms() - begin_ms);
+		printf(" Failed updates: %lu\r\n", failed);
+		printf(" The live table was not changed\r\n\n");
+		return;
+	}
+
+	// Measure the cycles taken by each hash algorithm
+	if (strcmp(command, "bench")==0 && strcmp(param1, "hash")==0)
+	{
+		struct hash_input in;
+		uint32_t start;
+		uint32_t cycles[3];
+		volatile uint32_t sink = 0;
+
+		/* IPv4 5-tuple, 13 bytes */
+		in.len = 0;
+		hash_add_u32(&in, 0x0A000163);
+		hash_add_u32(&in, 0x0A000101);
+		hash_add_u16(&in, 49152);
+		hash_add_u16(&in, 80);
+		hash_add_u8(&in, 6);
+
+		/* Start the DWT cycle counter */
+		CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+		DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+		for (int algo=HASH_ALGO_CRC32;algo<=HASH_ALGO_MULT;algo++)
+		{
+			start = DWT->CYCCNT;
+			for (int x=0;x<HASH_BENCH_RUNS;x++)
+			{
+				in.buf[12] = x;	// Vary the flow
+				sink += p4_hash(algo, 0, &in, 0);
+			}
+			cycles[algo] = (DWT->CYCCNT - start) / HASH_BENCH_RUNS;
+		}
+		printf("Cycles per hash of a 13 byte 5-tuple (%d runs)\r\n", HASH_BENCH_RUNS);
+		printf(" CRC32: %lu\r\n CRC16: %lu\r\n Multiplicative: %lu\r\n\n", cycles[HASH_ALGO_CRC32], cycles[HASH_ALGO_CRC16], cycles[HASH_ALGO_MULT]);
+		return;
+	}
+
+	// Compare the bytecode interpreter with the compiled pipeline
+	if (strcmp(command, "bench")==0 && strcmp(param1, "vm")==0)
+	{
+		uint32_t compiled, interpreted;
+
+		vm_bench(VM_BENCH_RUNS, &compiled, &interpreted);
+		printf("Cycles per IPv4 frame through test_parser (%d runs)\r\n", VM_BENCH_RUNS);
+		printf(" Compiled: %lu\r\n Interpreted: %lu\r\n", compiled, interpreted);
+		if (compiled > 0 && interpreted >= compiled) printf(" Overhead: %lu%%\r\n", ((interpreted - compiled) * 100) / compiled);
+		printf("\n");
+		return;
+	}
+
+	// Compare the pipeline with and without the flash cache, for choosing HOT_PATH_LEVEL
+	if (strcmp(command, "bench")==0 && strcmp(param1, "hotpath")==0)
+	{
+		uint32_t compiled[2], interpreted[2], hits;
+		uint32_t compiled_fps[2], interpreted_fps[2];
+		uint32_t hz = sysclk_get_cpu_hz();
+
+		cache_monitor_reset();
+		vm_bench(VM_BENCH_RUNS, &compiled[0], &interpreted[0]);
+		hits = cache_monitor_hits();
+		cache_enable(false);
+		vm_bench(VM_BENCH_RUNS, &compiled[1], &interpreted[1]);
+		cache_invalidate();
+		cache_enable(true);
+
+		for (int x=0;x<2;x++)
+		{
+			compiled_fps[x] = (compiled[x] > 0) ? hz / compiled[x] : 0;
+			interpreted_fps[x] = (interpreted[x] > 0) ? hz / interpreted[x] : 0;
+		}
+
+		printf("Hot path level %d, %lu bytes of code in SRAM\r\n", HOT_PATH_LEVEL, ramfunc_size());
+		printf("Cycles (frames/s) per IPv4 frame through test_parser (%d runs)\r\n", VM_BENCH_RUNS);
+		printf("               Cache on            Cache off\r\n");
+		printf(" Compiled:     %-6lu (%-8lu)   %-6lu (%lu)\r\n", compiled[0], compiled_fps[0], compiled[1], compiled_fps[1]);
+		printf(" Interpreted:  %-6lu (%-8lu)   %-6lu (%lu)\r\n", interpreted[0], interpreted_fps[0], interpreted[1], interpreted_fps[1]);
+		printf(" Cached instruction fetches: %lu per frame\r\n", hits / (VM_BENCH_RUNS * 2));
+		printf("\n");
+		return;
+	}
+
+	// Compare reading frames from small receive buffers with one buffer per frame
+	if (strcmp(command, "bench")==0 && strcmp(param1, "rx")==0)
+	{
+		static const uint16_t sizes[2] = {64, 1518};
+		uint32_t small, large;
+
+		printf("Cycles per frame read from the receive ring (%d runs), %d buffers of %d bytes in use\r\n", RX_BENCH_RUNS, GMAC_RX_BUFFERS, GMAC_RX_BUFSIZE);
+		printf(" Frame    %4d byte buffers   %4d byte buffers   Saved\r\n", GMAC_RX_UNITSIZE, GMAC_RX_FRAME_BUFSIZE);
+		for (int x=0;x<2;x++)
+		{
+			small = switch_rx_bench(sizes[x] + 1, GMAC_RX_UNITSIZE, RX_BENCH_RUNS);	// With the tail tag
+			large = switch_rx_bench(sizes[x] + 1, GMAC_RX_FRAME_BUFSIZE, RX_BENCH_RUNS);
+			if (small == 0 || large == 0)
+			{
+				printf("No free packet buffers\r\n");
+				return;
+			}
+			printf(" %-4d     %-6lu (%2d bufs)      %-6lu (1 buf)        %ld\r\n", sizes[x], small, (sizes[x] + GMAC_RX_UNITSIZE) / GMAC_RX_UNITSIZE, large, (long)(small - large));
+		}
+		printf("\n");
+		return;
+	}
 	
 	// Unknown Command response
 	printf("Unknown command\r\n");
@@ -816,6 +1579,17 @@ void printhelp(void)
 	printf(" show status\r\n");
 	printf(" show version\r\n");
 	printf(" show ports\r\n");
+	printf(" show controller\r\n");
+	printf(" show tables\r\n");
+	printf(" show flows\r\n");
+	printf(" show pipeline\r\n");
+	printf(" show boot\r\n");
+	printf(" show update\r\n");
+	printf(" show buffers\r\n");
+	printf(" show memory\r\n");
+	printf(" show queues\r\n");
+	printf(" show tasks\r\n");
+	printf(" save tables\r\n");
 	printf(" restart\r\n");
 	printf(" help\r\n");
 	printf("\r\n");
@@ -824,11 +1598,15 @@ void printhelp(void)
 	printf(" restart\r\n");
 	printf(" show config\r\n");
 	printf(" show vlans\r\n");
+	printf(" show vlan-table\r\n");
 	printf(" set name <name>\r\n");
 	printf(" set mac-address <mac address>\r\n");
 	printf(" set ip-address <ip address>\r\n");
 	printf(" set netmask <netmasks>\r\n");
 	printf(" set gateway <gateway ip address>\r\n");
+	printf(" set flow-collector <ip address> [port]\r\n");
+	printf(" set egress-sched <strict|wrr|drr> [w1/w2/w3]\r\n");
+	printf(" set egress-aqm <off|codel|fq-codel>\r\n");
 	printf(" set failstate <secure|safe>\r\n");
 	printf(" add vlan <vlan id> <vlan name>\r\n");
 	printf(" delete vlan <vlan id>\r\n");
@@ -836,6 +1614,8 @@ void printhelp(void)
 	printf(" set vlan-tag <vlan id> <tagged|untagged>\r\n");
 	printf(" add vlan-port <vlan id> <port>\r\n");
 	printf(" delete vlan-port <port>\r\n");
+	printf(" add vlan-table <vlan id> <ports, e.g. 12t5>\r\n");
+	printf(" delete vlan-table <vlan id>\r\n");
 	printf(" set of-version <version(0|1|4)>\r\n");
 	printf(" set ethertype-filter <enable|disable>\r\n");
 	printf(" factory reset\r\n");
@@ -845,6 +1625,11 @@ void printhelp(void)
 	printf(" read <register>\r\n");
 	printf(" write <register> <value>\r\n");
 	printf(" trace\r\n");
+	printf(" bench hash\r\n");
+	printf(" bench vm\r\n");
+	printf(" bench hotpath\r\n");
+	printf(" bench rx\r\n");
+	printf(" bench rcu [table]\r\n");
 	printf(" exit\r\n");
 	printf("\r\n");
 	return;
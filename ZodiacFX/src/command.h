@@ -61,6 +61,11 @@ struct zodiac_config {
 	uint8_t netmask[4];
 	uint8_t gateway_address[4];
 	struct virtlan vlan_list[MAX_VLANS];
+	uint8_t flow_collector[4];	// IPFIX collector, flows are not exported if the port is 0
+	uint16_t flow_collector_port;
+	uint8_t egress_sched;		// enum egress_sched
+	uint8_t egress_weight[EGRESS_CLASSES];	// 0 for the default weight
+	uint8_t egress_aqm;		// enum egress_aqm
 } PACK_STRUCT_STRUCT;
 PACK_STRUCT_END
 
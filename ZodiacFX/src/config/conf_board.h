@@ -71,6 +71,9 @@
 /* GMAC module. */
 #define CONF_BOARD_KSZ8795CLX
 
+/* Watchdog is set up by update_boot(), it only runs while a new image is on trial */
+#define CONF_BOARD_KEEP_WATCHDOG_AT_INIT
+
 //! [tc_define_peripheral]
 /* Use TC Peripheral 0. */
 #define TC             TC0
@@ -57,11 +57,22 @@ extern "C" {
 
 #include "gmac.h"
 
+/** Size of each RX buffer, a multiple of 64. GMAC_RX_UNITSIZE buffers hold
+ * more small frames but a full size frame takes 12 of them,
+ * GMAC_RX_FRAME_BUFSIZE takes one buffer per frame. */
+#define GMAC_RX_BUFSIZE  GMAC_RX_UNITSIZE
+
+/** Memory for RX buffers, 64 x 128 bytes or 5 x 1536 bytes each hold 5 full size frames */
+#define GMAC_RX_MEMORY   8192
+
 /** Number of buffer for RX */
-#define GMAC_RX_BUFFERS  24
+#define GMAC_RX_BUFFERS  (GMAC_RX_MEMORY / GMAC_RX_BUFSIZE)
 
 /** Number of buffer for TX */
-#define GMAC_TX_BUFFERS  12
+#define GMAC_TX_BUFFERS  24
+
+/** TDs point at pool blocks and lwIP pbufs, so they have no copy buffers */
+#define GMAC_TX_NO_COPY
 
 /** MAC PHY operation max retry count */
 #define MAC_PHY_RETRY_MAX 1000000
@@ -104,10 +104,10 @@
  * @{
  */
 //! Interface callback definition
-#define  UDI_CDC_ENABLE_EXT(port)          stdio_usb_enable()
-#define  UDI_CDC_DISABLE_EXT(port)         stdio_usb_disable()
+#define  UDI_CDC_ENABLE_EXT(port)          console_enable()
+#define  UDI_CDC_DISABLE_EXT(port)         console_disable()
 #define  UDI_CDC_RX_NOTIFY(port)
-#define  UDI_CDC_TX_EMPTY_NOTIFY(port)
+#define  UDI_CDC_TX_EMPTY_NOTIFY(port)     console_tx_empty()
 #define  UDI_CDC_SET_CODING_EXT(port,cfg)
 #define  UDI_CDC_SET_DTR_EXT(port,set)
 #define  UDI_CDC_SET_RTS_EXT(port,set)
@@ -130,5 +130,6 @@
 //! The includes of classes and other headers must be done at the end of this file to avoid compile error
 #include <udi_cdc_conf.h>
 #include <stdio_usb.h>
+#include "console.h"
 
 #endif // _CONF_USB_H_
@@ -35,5 +35,25 @@
 
 #define TOTAL_PORTS 4		// Total number of physical ports on the Zodiac FX
 #define MAX_VLANS	4	// Maximum number of VLANS, default is 1 per port (4)
+#define MAX_ACTIVE_VLANS	128	// Maximum number of active VLANs in the KSZ8795 VLAN table (one per FID)
+#define EGRESS_CLASSES	4	// Egress queues per port, class 0 is sent first
+
+/* Code run from SRAM instead of flash, compare levels with "bench hotpath"
+ * 0 - none, everything runs from flash through the CMCC cache
+ * 1 - the per-frame receive and transmit path
+ * 2 - level 1 plus table lookups, hashing, the VM and the flow cache */
+#define HOT_PATH_LEVEL	0
+
+#include <compiler.h>
+#if HOT_PATH_LEVEL >= 1
+#define HOT_PATH	RAMFUNC
+#else
+#define HOT_PATH
+#endif
+#if HOT_PATH_LEVEL >= 2
+#define HOT_PATH_TABLES	RAMFUNC
+#else
+#define HOT_PATH_TABLES
+#endif
 
 #endif /* CONFIG_ZODIAC_H_ */
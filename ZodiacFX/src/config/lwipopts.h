@@ -164,8 +164,10 @@
 
 /**
  * PBUF_POOL_SIZE: the number of buffers in the pbuf pool.
+ * Received frames are held in the switch's buffer pool (pktbuf.c),
+ * nothing allocates from this one.
  */
-#define PBUF_POOL_SIZE                  4
+#define PBUF_POOL_SIZE                  1
 
 /**
  * PBUF_POOL_BUFSIZE: the size of each pbuf in the pbuf pool.
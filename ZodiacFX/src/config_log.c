@@ -0,0 +1,332 @@
+/**
+ * @file
+ * config_log.c
+ *
+ * This file contains the configuration log in internal flash
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX P4 firmware.
+ * Copyright (c) 2019 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Paul Zanna <paul@northboundnetworks.com>
+ *
+ */
+
+#include <asf.h>
+#include <string.h>
+#include "config_log.h"
+#include "cache.h"
+#include "command.h"
+#include "P4/zodiacfx-hash.h"
+
+/*
+*	The configuration is saved as a log of key/value records, appended
+*	one flash page per save. Only keys that have changed since the last
+*	save are written, and the first page of a bank always holds every
+*	key, so the other bank can be erased when the log moves over. An
+*	index in RAM points at the newest record of each key.
+*
+*	Saving is done from the main loop with at most one page write or one
+*	8 page erase per pass. The flash can not be read while it is being
+*	written, so each of those still holds the CPU for a few ms, instead
+*	of the seconds the EEPROM page loop took.
+*/
+
+// Global variables
+extern struct zodiac_config Zodiac_Config;
+struct cfglog_stats cfglog_stats;
+
+// Local variables
+static uint32_t cfglog_index[CFGLOG_KEYS];	// Newest record of each key, 0 if it has never been saved
+static uint32_t cfglog_bank = CFGLOG_ADDR;
+static uint32_t cfglog_next = CFGLOG_ADDR;	// Page the next save goes in
+static uint32_t cfglog_seq = 0;
+static uint32_t cfglog_erase_addr = 0;		// Next block to erase, 0 when not erasing
+static bool cfglog_pending = false;
+static bool cfglog_full = true;			// The next save has to include every key
+
+// Internal Functions
+static uint8_t *cfglog_value(uint8_t key, uint8_t *len);
+static uint32_t cfglog_scan(uint32_t bank, uint32_t *last_seq, bool apply);
+static void cfglog_write(void);
+
+/*
+*	Build the index from the log. The bank with the older saves is
+*	walked first so the newest record of each key wins.
+*
+*/
+void cfglog_init(void)
+{
+	uint32_t bank_b = CFGLOG_ADDR + CFGLOG_BANK_SIZE;
+	uint32_t seq_a = 0;
+	uint32_t seq_b = 0;
+	uint32_t next_a = cfglog_scan(CFGLOG_ADDR, &seq_a, false);
+	uint32_t next_b = cfglog_scan(bank_b, &seq_b, false);
+
+	memset(cfglog_index, 0, sizeof(cfglog_index));
+	if (seq_b > seq_a)
+	{
+		cfglog_scan(CFGLOG_ADDR, &seq_a, true);
+		cfglog_scan(bank_b, &seq_b, true);
+		cfglog_bank = bank_b;
+		cfglog_next = next_b;
+		cfglog_seq = seq_b;
+	} else {
+		cfglog_scan(bank_b, &seq_b, true);
+		cfglog_scan(CFGLOG_ADDR, &seq_a, true);
+		cfglog_bank = CFGLOG_ADDR;
+		cfglog_next = next_a;
+		cfglog_seq = seq_a;
+	}
+	cfglog_full = (cfglog_next == cfglog_bank);
+	cfglog_stats.seq = cfglog_seq;
+	cfglog_stats.pages = (cfglog_next - cfglog_bank) / IFLASH_PAGE_SIZE;
+	return;
+}
+
+/*
+*	Copy the saved configuration into Zodiac_Config
+*
+*	Returns the number of keys found, keys that were never saved are
+*	left as they are.
+*
+*/
+int cfglog_load(void)
+{
+	struct cfglog_record rec;
+	uint8_t *value;
+	uint8_t len;
+	int found = 0;
+
+	for (int key=0;key<CFGLOG_KEYS;key++)
+	{
+		if (cfglog_index[key] == 0) continue;
+		memcpy(&rec, (const void *)cfglog_index[key], sizeof(rec));
+		value = cfglog_value(key, &len);
+		if (rec.len != len) continue;	// Saved by firmware with a different layout
+		memcpy(value, (const void *)(cfglog_index[key] + sizeof(rec)), len);
+		found++;
+	}
+	return found;
+}
+
+/*
+*	Save Zodiac_Config, the write happens in cfglog_task()
+*
+*/
+void cfglog_save(void)
+{
+	cfglog_pending = true;
+	return;
+}
+
+/*
+*	Returns true while a save has not been written
+*
+*/
+bool cfglog_busy(void)
+{
+	return cfglog_pending || cfglog_erase_addr != 0;
+}
+
+/*
+*	Write a pending save, called from the main loop
+*
+*/
+void cfglog_task(void)
+{
+	if (cfglog_erase_addr != 0)
+	{
+		if (cache_flash_erase(cfglog_erase_addr, IFLASH_ERASE_PAGES_8) != FLASH_RC_OK) cfglog_stats.errors++;
+		cfglog_erase_addr += CFGLOG_ERASE_SIZE;
+		if (cfglog_erase_addr >= cfglog_bank + CFGLOG_BANK_SIZE)
+		{
+			cfglog_erase_addr = 0;
+			cfglog_stats.erases++;
+		}
+		return;
+	}
+	if (!cfglog_pending) return;
+
+	if (cfglog_next >= cfglog_bank + CFGLOG_BANK_SIZE)
+	{
+		// Bank full, erase the other one and start it with every key
+		cfglog_bank = (cfglog_bank == CFGLOG_ADDR) ? CFGLOG_ADDR + CFGLOG_BANK_SIZE : CFGLOG_ADDR;
+		cfglog_next = cfglog_bank;
+		cfglog_erase_addr = cfglog_bank;
+		cfglog_full = true;
+		return;
+	}
+	cfglog_pending = false;
+	cfglog_write();
+	return;
+}
+
+/*
+*	Get the part of Zodiac_Config a key is saved from
+*
+*	@param key - the key.
+*	@param *len - set to the length of the value.
+*
+*/
+static uint8_t *cfglog_value(uint8_t key, uint8_t *len)
+{
+	switch (key)
+	{
+		case CFGLOG_NAME:
+		*len = sizeof(Zodiac_Config.device_name);
+		return (uint8_t *)Zodiac_Config.device_name;
+
+		case CFGLOG_MAC:
+		*len = sizeof(Zodiac_Config.MAC_address);
+		return Zodiac_Config.MAC_address;
+
+		case CFGLOG_IP:
+		*len = sizeof(Zodiac_Config.IP_address);
+		return Zodiac_Config.IP_address;
+
+		case CFGLOG_NETMASK:
+		*len = sizeof(Zodiac_Config.netmask);
+		return Zodiac_Config.netmask;
+
+		case CFGLOG_GATEWAY:
+		*len = sizeof(Zodiac_Config.gateway_address);
+		return Zodiac_Config.gateway_address;
+
+		case CFGLOG_FLOW_COLLECTOR:
+		*len = sizeof(Zodiac_Config.flow_collector) + sizeof(Zodiac_Config.flow_collector_port);
+		return Zodiac_Config.flow_collector;	// The port follows in the packed struct
+
+		case CFGLOG_EGRESS:
+		*len = sizeof(Zodiac_Config.egress_sched) + sizeof(Zodiac_Config.egress_weight);
+		return &Zodiac_Config.egress_sched;	// The weights follow in the packed struct
+
+		case CFGLOG_AQM:
+		*len = sizeof(Zodiac_Config.egress_aqm);
+		return &Zodiac_Config.egress_aqm;
+
+		default:
+		*len = sizeof(struct virtlan);
+		return (uint8_t *)&Zodiac_Config.vlan_list[key - CFGLOG_VLAN];
+	}
+}
+
+/*
+*	Walk the saves in a bank
+*
+*	@param bank - address of the bank.
+*	@param *last_seq - set to the highest sequence number found.
+*	@param apply - true to point the index at the records.
+*
+*	Returns the first erased page, where the next save can go.
+*
+*/
+static uint32_t cfglog_scan(uint32_t bank, uint32_t *last_seq, bool apply)
+{
+	struct cfglog_header header;
+	struct cfglog_record rec;
+	uint32_t addr;
+	uint32_t pos;
+	uint32_t end;
+
+	for (addr = bank; addr < bank + CFGLOG_BANK_SIZE; addr += IFLASH_PAGE_SIZE)
+	{
+		memcpy(&header, (const void *)addr, sizeof(header));
+		if (header.magic == 0xFFFFFFFF) break;
+		if (header.magic != CFGLOG_MAGIC || header.length > IFLASH_PAGE_SIZE - sizeof(header)) continue;
+		if (hash_crc32((const uint8_t *)(addr + sizeof(header)), header.length) != header.crc) continue;	// Torn write
+		if (header.seq > *last_seq) *last_seq = header.seq;
+		if (!apply) continue;
+
+		pos = addr + sizeof(header);
+		end = pos + header.length;
+		while (pos + sizeof(rec) <= end)
+		{
+			memcpy(&rec, (const void *)pos, sizeof(rec));
+			if (rec.key < CFGLOG_KEYS) cfglog_index[rec.key] = pos;
+			pos += sizeof(rec) + rec.len;
+		}
+	}
+	return addr;
+}
+
+/*
+*	Append a page holding every key that has changed
+*
+*	All the keys fit in one page, with room for a few more VLANs.
+*
+*/
+static void cfglog_write(void)
+{
+	uint8_t page[IFLASH_PAGE_SIZE];
+	struct cfglog_header header;
+	struct cfglog_record rec;
+	struct cfglog_record saved;
+	uint16_t offset[CFGLOG_KEYS];
+	uint16_t pos = sizeof(header);
+	uint8_t *value;
+
+	for (int key=0;key<CFGLOG_KEYS;key++)
+	{
+		offset[key] = 0;
+		value = cfglog_value(key, &rec.len);
+		if (!cfglog_full && cfglog_index[key] != 0)
+		{
+			memcpy(&saved, (const void *)cfglog_index[key], sizeof(saved));
+			if (saved.len == rec.len && memcmp((const void *)(cfglog_index[key] + sizeof(saved)), value, rec.len) == 0) continue;
+		}
+		rec.key = key;
+		offset[key] = pos;
+		memcpy(&page[pos], &rec, sizeof(rec));
+		memcpy(&page[pos + sizeof(rec)], value, rec.len);
+		pos += sizeof(rec) + rec.len;
+	}
+	if (pos == sizeof(header))
+	{
+		cfglog_stats.unchanged++;
+		return;
+	}
+
+	header.magic = CFGLOG_MAGIC;
+	header.seq = cfglog_seq + 1;
+	header.length = pos - sizeof(header);
+	header.reserved = 0;
+	header.crc = hash_crc32(&page[sizeof(header)], header.length);
+	memcpy(page, &header, sizeof(header));
+	memset(&page[pos], 0xFF, IFLASH_PAGE_SIZE - pos);
+
+	if (cache_flash_write(cfglog_next, page, IFLASH_PAGE_SIZE) != FLASH_RC_OK || memcmp((const void *)cfglog_next, page, IFLASH_PAGE_SIZE) != 0)
+	{
+		cfglog_stats.errors++;
+		cfglog_next += IFLASH_PAGE_SIZE;
+		cfglog_pending = true;	// Try again in the next page
+		return;
+	}
+
+	for (int key=0;key<CFGLOG_KEYS;key++)
+	{
+		if (offset[key] != 0) cfglog_index[key] = cfglog_next + offset[key];
+	}
+	cfglog_seq = header.seq;
+	cfglog_next += IFLASH_PAGE_SIZE;
+	cfglog_full = false;
+	cfglog_stats.seq = cfglog_seq;
+	cfglog_stats.pages = (cfglog_next - cfglog_bank) / IFLASH_PAGE_SIZE;
+	cfglog_stats.saves++;
+	return;
+}
@@ -0,0 +1,92 @@
+/**
+ * @file
+ * config_log.h
+ *
+ * This file contains the declarations for the configuration log in internal flash
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX P4 firmware.
+ * Copyright (c) 2019 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Paul Zanna <paul@northboundnetworks.com>
+ *
+ */
+
+#ifndef CONFIG_LOG_H_
+#define CONFIG_LOG_H_
+
+#include <asf.h>
+#include "config_zodiac.h"
+
+#define CFGLOG_ADDR		0x00470000	// 64 KB sector reserved for the configuration log
+#define CFGLOG_BANK_SIZE	0x8000		// Two banks, the log moves to the other one when a bank is full
+#define CFGLOG_ERASE_SIZE	(8 * IFLASH_PAGE_SIZE)	// Erased per main loop pass
+#define CFGLOG_MAGIC		0x474F4C43	// "CLOG"
+
+/* Configuration keys, each is one value in Zodiac_Config */
+enum cfglog_key {
+	CFGLOG_NAME,
+	CFGLOG_MAC,
+	CFGLOG_IP,
+	CFGLOG_NETMASK,
+	CFGLOG_GATEWAY,
+	CFGLOG_FLOW_COLLECTOR,
+	CFGLOG_VLAN,				// One key per VLAN
+	CFGLOG_EGRESS = CFGLOG_VLAN + MAX_VLANS,
+	CFGLOG_AQM,
+	CFGLOG_KEYS
+};
+
+/*
+*	Each save is one flash page: a header, then a record for each key
+*	that changed. A record is a cfglog_record followed by the value. The
+*	CRC covers the records, so a page that was not completely written is
+*	ignored as a whole and a save is never half applied.
+*/
+struct cfglog_header {
+	uint32_t magic;
+	uint32_t seq;
+	uint16_t length;	// Bytes of records after the header
+	uint16_t reserved;
+	uint32_t crc;		// CRC-32 of the records
+};
+
+struct cfglog_record {
+	uint8_t key;
+	uint8_t len;
+};
+
+/* Configuration log counters */
+struct cfglog_stats {
+	uint32_t seq;		// Sequence number of the last save
+	uint32_t pages;		// Pages used in the current bank
+	uint32_t saves;
+	uint32_t unchanged;	// Saves with nothing to write
+	uint32_t erases;	// Banks erased
+	uint32_t errors;	// Pages that did not read back correctly
+};
+
+extern struct cfglog_stats cfglog_stats;
+
+void cfglog_init(void);
+int cfglog_load(void);
+void cfglog_save(void);
+bool cfglog_busy(void);
+void cfglog_task(void);
+
+#endif /* CONFIG_LOG_H_ */
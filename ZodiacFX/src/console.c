@@ -0,0 +1,225 @@
+/**
+ * @file
+ * console.c
+ *
+ * This file contains the USB console output functions
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX P4 firmware.
+ * Copyright (c) 2019 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Paul Zanna <paul@northboundnetworks.com>
+ *
+ */
+
+#include <asf.h>
+#include <stdio.h>
+#include <string.h>
+#include "console.h"
+#include "timers.h"
+
+#define CONSOLE_MASK		(CONSOLE_RING_SIZE - 1)
+#define CONSOLE_NOTE_SIZE	48	// Room kept for the dropped output line
+
+// Global variables
+struct console_stats console_stats;
+
+// Local variables
+static char console_ring[CONSOLE_RING_SIZE];
+static volatile uint16_t console_head = 0;	// Written by the main loop
+static volatile uint16_t console_tail = 0;	// Moved by whoever is sending, with interrupts off
+static volatile bool console_enabled = false;	// The host has opened the port
+static uint32_t console_lost = 0;		// Bytes dropped since the last dropped output line
+static volatile bool console_in_flight = false;	// Bytes handed to the CDC driver have not all gone out yet
+
+// Internal Functions
+static void console_send(void);
+
+/*
+*	Bytes waiting in the ring
+*
+*/
+static uint16_t console_used(void)
+{
+	return (console_head - console_tail) & CONSOLE_MASK;
+}
+
+/*
+*	Copy a byte into the ring, the caller has checked there is room
+*
+*	@param c - the byte.
+*
+*/
+static void console_put(char c)
+{
+	console_ring[console_head] = c;
+	console_head = (console_head + 1) & CONSOLE_MASK;
+	return;
+}
+
+/*
+*	Low level write function used by printf in place of stdio_usb_putchar
+*
+*	Output is only kept while the host has the port open, like
+*	stdio_usb_putchar(). The last CONSOLE_NOTE_SIZE bytes of the ring
+*	are kept for the line that reports dropped output.
+*
+*	@param *unused - stdio base, not used.
+*	@param data - the byte to write.
+*
+*/
+static int console_putchar(volatile void *unused, char data)
+{
+	char note[CONSOLE_NOTE_SIZE];
+	uint16_t used;
+	int len;
+
+	UNUSED(unused);
+	if (!console_enabled) return 0;
+
+	used = console_used();
+	if (console_lost > 0)
+	{
+		/* Report the dropped output once there is room for the line and the byte */
+		if (CONSOLE_RING_SIZE - 1 - used < CONSOLE_NOTE_SIZE + 1)
+		{
+			console_lost++;
+			console_stats.dropped++;
+			return 0;
+		}
+		len = snprintf(note, sizeof(note), "\r\n*** %lu bytes of output dropped ***\r\n", console_lost);
+		for (int x=0;x<len;x++) console_put(note[x]);
+		console_lost = 0;
+	} else if (CONSOLE_RING_SIZE - 1 - used <= CONSOLE_NOTE_SIZE)
+	{
+		console_lost = 1;
+		console_stats.dropped++;
+		console_stats.overflows++;
+		return 0;
+	}
+
+	console_put(data);
+	used = console_used();
+	if (used > console_stats.peak) console_stats.peak = used;
+	return 0;
+}
+
+/*
+*	Move as much of the ring as fits into the USB CDC buffers
+*
+*	Called from the main loop and from the USB interrupt, so the tail is
+*	only moved with interrupts off. The CDC buffers are at most a few
+*	hundred bytes, so this never takes long.
+*
+*/
+static void console_send(void)
+{
+	irqflags_t flags;
+	uint16_t tail;
+	uint16_t len;
+	iram_size_t space;
+
+	flags = cpu_irq_save();
+	while (console_enabled && console_head != console_tail)
+	{
+		space = udi_cdc_get_free_tx_buffer();
+		if (space == 0) break;
+
+		/* Send up to the end of the ring, the rest goes on the next time round */
+		tail = console_tail;
+		len = (console_head > tail) ? console_head - tail : CONSOLE_RING_SIZE - tail;
+		if (len > space) len = space;
+		udi_cdc_write_buf(&console_ring[tail], len);
+		console_in_flight = true;
+		console_tail = (tail + len) & CONSOLE_MASK;
+		console_stats.written += len;
+	}
+	cpu_irq_restore(flags);
+	return;
+}
+
+/*
+*	Send printf output through the ring, called after stdio_usb_init()
+*
+*/
+void console_init(void)
+{
+	ptr_put = console_putchar;
+	return;
+}
+
+/*
+*	The host has opened the port, called by the CDC driver
+*
+*	Anything left in the ring from before the port was closed is sent.
+*
+*/
+bool console_enable(void)
+{
+	console_enabled = true;
+	return stdio_usb_enable();
+}
+
+/*
+*	The host has closed the port, called by the CDC driver
+*
+*/
+void console_disable(void)
+{
+	console_enabled = false;
+	stdio_usb_disable();
+	return;
+}
+
+/*
+*	A CDC transfer has completed, called from the USB interrupt
+*
+*/
+void console_tx_empty(void)
+{
+	console_in_flight = false;
+	console_send();
+	return;
+}
+
+/*
+*	Start sending new output, the USB interrupt keeps it going
+*
+*/
+void console_task(void)
+{
+	console_send();
+	return;
+}
+
+/*
+*	Wait for the ring to be sent, used before a restart
+*
+*/
+void console_flush(void)
+{
+	uint32_t start = sys_get_ms();
+
+	while (console_head != console_tail && (sys_get_ms() - start) < CONSOLE_FLUSH_TIMEOUT)
+	{
+		console_send();
+	}
+	/* Let the last transfer go out before the caller detaches */
+	while (console_enabled && console_in_flight && (sys_get_ms() - start) < CONSOLE_FLUSH_TIMEOUT);
+	return;
+}
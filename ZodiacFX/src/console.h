@@ -0,0 +1,60 @@
+/**
+ * @file
+ * console.h
+ *
+ * This file contains the USB console output functions
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX P4 firmware.
+ * Copyright (c) 2019 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Paul Zanna <paul@northboundnetworks.com>
+ *
+ */
+
+#ifndef CONSOLE_H_
+#define CONSOLE_H_
+
+#include <compiler.h>
+
+/*
+*	Console output is written to a ring and sent to the USB CDC buffers
+*	as they empty, so printing never waits for the host. When the ring
+*	is full new output is dropped, and a line saying how much was lost
+*	is written once there is room again.
+*/
+#define CONSOLE_RING_SIZE	4096	// Must be a power of 2
+#define CONSOLE_FLUSH_TIMEOUT	200	// Longest time console_flush() waits for the host (ms)
+
+struct console_stats {
+	uint32_t written;	// Bytes sent to the host
+	uint32_t dropped;	// Bytes dropped with the ring full
+	uint32_t overflows;	// Times the ring has filled up
+	uint16_t peak;		// Most bytes waiting in the ring
+};
+
+extern struct console_stats console_stats;
+
+void console_init(void);
+bool console_enable(void);
+void console_disable(void);
+void console_tx_empty(void);
+void console_task(void);
+void console_flush(void);
+
+#endif /* CONSOLE_H_ */
@@ -0,0 +1,918 @@
+/**
+ * @file
+ * controller.c
+ *
+ * This file contains the management connection to the controller
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX P4 firmware.
+ * Copyright (c) 2019 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Paul Zanna <paul@northboundnetworks.com>
+ *
+ */
+
+
+#include <asf.h>
+#include <string.h>
+#include "controller.h"
+#include "command.h"
+#include "common.h"
+#include "timers.h"
+#include "lwip/tcp.h"
+#include "P4/zodiacfx-digest.h"
+#include "P4/zodiacfx-tables.h"
+#include "P4/zodiacfx-punt.h"
+#include "P4/zodiacfx-persist.h"
+#include "P4/zodiacfx-vm.h"
+#include "P4/zodiacfx-externs.h"
+#include "P4/zodiacfx-hash.h"
+
+/* Read position in the chain of received pbufs */
+struct ctrl_cursor {
+	struct pbuf *p;
+	uint16_t offset;
+};
+
+// Global variables
+struct ctrl_stats ctrl_stats;
+
+// Local variables
+static struct tcp_pcb *ctrl_listen_pcb = NULL;
+static struct tcp_pcb *ctrl_pcb = NULL;
+static struct pbuf *ctrl_rx = NULL;	// Received data not yet handled
+static uint8_t ctrl_reply[sizeof(struct ctrl_array_range) + CTRL_REPLY_MAX];
+
+// Internal Functions
+static err_t controller_accept(void *arg, struct tcp_pcb *pcb, err_t err);
+static err_t controller_recv(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err);
+static err_t controller_sent(void *arg, struct tcp_pcb *pcb, u16_t len);
+static void controller_error(void *arg, err_t err);
+static err_t controller_process(struct tcp_pcb *pcb);
+
+/*
+*	Start listening for a controller connection
+*
+*/
+void controller_init(void)
+{
+	struct tcp_pcb *pcb = tcp_new();
+
+	if (pcb == NULL) return;
+	if (tcp_bind(pcb, IP_ADDR_ANY, CONTROLLER_PORT) != ERR_OK)
+	{
+		tcp_close(pcb);
+		return;
+	}
+	ctrl_listen_pcb = tcp_listen(pcb);
+	tcp_accept(ctrl_listen_pcb, controller_accept);
+
+	punt_init();
+	return;
+}
+
+/*
+*	Release the connection state
+*
+*/
+static void controller_reset(void)
+{
+	if (ctrl_rx != NULL)
+	{
+		pbuf_free(ctrl_rx);
+		ctrl_rx = NULL;
+	}
+	digest_subscribe(DIGEST_ID_LEARN, false);
+	for (int x=0;x<P4_MAX_TABLES;x++)
+	{
+		if (p4_get_table(x) != NULL) p4_table_abort(p4_get_table(x));
+	}
+	ctrl_pcb = NULL;
+	return;
+}
+
+/*
+*	Accept a controller connection, a new connection replaces the old one
+*
+*/
+static err_t controller_accept(void *arg, struct tcp_pcb *pcb, err_t err)
+{
+	LWIP_UNUSED_ARG(arg);
+	LWIP_UNUSED_ARG(err);
+
+	if (ctrl_pcb != NULL)
+	{
+		tcp_arg(ctrl_pcb, NULL);
+		tcp_recv(ctrl_pcb, NULL);
+		tcp_sent(ctrl_pcb, NULL);
+		tcp_err(ctrl_pcb, NULL);
+		tcp_abort(ctrl_pcb);
+		controller_reset();
+	}
+
+	tcp_accepted(ctrl_listen_pcb);
+	ctrl_pcb = pcb;
+	ctrl_stats.connects++;
+	tcp_setprio(pcb, TCP_PRIO_MAX);
+	tcp_nagle_disable(pcb);
+	tcp_recv(pcb, controller_recv);
+	tcp_sent(pcb, controller_sent);
+	tcp_err(pcb, controller_error);
+	TRACE("controller.c: controller connected");
+
+	/* Say hello */
+	controller_send(CTRL_HELLO, 0, NULL, 0);
+	return ERR_OK;
+}
+
+/*
+*	Data received from the controller
+*
+*	Segments are chained onto any partial message already held and
+*	handled in place. The TCP window is only opened for bytes that have
+*	been handled, so a slow reply path pushes back on the controller.
+*
+*/
+static err_t controller_recv(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err)
+{
+	LWIP_UNUSED_ARG(arg);
+	LWIP_UNUSED_ARG(err);
+
+	if (p == NULL)
+	{
+		/* Connection closed by the controller */
+		TRACE("controller.c: controller disconnected");
+		tcp_recv(pcb, NULL);
+		tcp_sent(pcb, NULL);
+		tcp_err(pcb, NULL);
+		tcp_close(pcb);
+		if (pcb == ctrl_pcb) controller_reset();
+		return ERR_OK;
+	}
+
+	if (ctrl_rx == NULL)
+	{
+		ctrl_rx = p;
+	} else {
+		pbuf_cat(ctrl_rx, p);
+	}
+	return controller_process(pcb);
+}
+
+/*
+*	Data acknowledged by the controller, continue any requests that were waiting for send buffer space
+*
+*/
+static err_t controller_sent(void *arg, struct tcp_pcb *pcb, u16_t len)
+{
+	LWIP_UNUSED_ARG(arg);
+	LWIP_UNUSED_ARG(len);
+
+	if (ctrl_rx != NULL) return controller_process(pcb);
+	return ERR_OK;
+}
+
+/*
+*	Connection error, the pcb has already been freed by lwIP
+*
+*/
+static void controller_error(void *arg, err_t err)
+{
+	LWIP_UNUSED_ARG(arg);
+	LWIP_UNUSED_ARG(err);
+
+	TRACE("controller.c: controller connection error %d", err);
+	controller_reset();
+	return;
+}
+
+/*
+*	Get a pointer to the next len bytes of a request
+*
+*	Returns a pointer into the pbuf payload when the bytes are in one
+*	segment. Only fields that cross a segment boundary are gathered
+*	into the scratch buffer.
+*
+*	@param *cursor - pointer to the read position.
+*	@param len - number of bytes needed, the caller has checked they have been received.
+*	@param *scratch - pointer to a buffer of at least len bytes.
+*
+*/
+static const uint8_t *ctrl_take(struct ctrl_cursor *cursor, uint16_t len, uint8_t *scratch)
+{
+	const uint8_t *data;
+
+	if (len == 0) return scratch;
+	while (cursor->offset >= cursor->p->len)
+	{
+		cursor->offset -= cursor->p->len;
+		cursor->p = cursor->p->next;
+	}
+
+	if (cursor->p->len - cursor->offset >= len)
+	{
+		data = (const uint8_t*)cursor->p->payload + cursor->offset;
+	} else {
+		pbuf_copy_partial(cursor->p, scratch, len, cursor->offset);
+		data = scratch;
+		ctrl_stats.copies++;
+	}
+	cursor->offset += len;
+	return data;
+}
+
+/*
+*	Drop handled bytes from the front of the received data and open the window
+*
+*	@param *pcb - pointer to the connection.
+*	@param len - number of bytes handled.
+*
+*/
+static void ctrl_consume(struct tcp_pcb *pcb, uint16_t len)
+{
+	struct pbuf *next;
+
+	tcp_recved(pcb, len);
+	while (len > 0)
+	{
+		if (len >= ctrl_rx->len)
+		{
+			len -= ctrl_rx->len;
+			next = ctrl_rx->next;
+			if (next != NULL) pbuf_ref(next);	// Keep the rest of the chain
+			pbuf_free(ctrl_rx);
+			ctrl_rx = next;
+		} else {
+			pbuf_header(ctrl_rx, -(s16_t)len);
+			len = 0;
+		}
+	}
+	return;
+}
+
+/*
+*	Queue the acknowledgement of a request
+*
+*/
+static void ctrl_ack(uint32_t xid, int status, uint16_t index)
+{
+	struct ctrl_ack ack;
+
+	if (status != P4_OK) ctrl_stats.errors++;
+	ack.status = status;
+	ack.reserved = 0;
+	ack.index = htons(index);
+	controller_queue(CTRL_ACK, xid, &ack, sizeof(ack));
+	return;
+}
+
+/*
+*	Apply a batch of table updates
+*
+*	Updates are applied in order and the batch stops at the first
+*	failure. The acknowledgement carries the number of updates applied.
+*
+*	@param xid - the transaction ID.
+*	@param *cursor - pointer to the start of the body.
+*	@param len - length of the body.
+*
+*/
+static void ctrl_table_write(uint32_t xid, struct ctrl_cursor *cursor, uint16_t len)
+{
+	uint8_t update_buf[sizeof(struct ctrl_table_update)];
+	uint8_t key_buf[P4_KEY_MAX];
+	uint8_t data_buf[P4_DATA_MAX];
+	const struct ctrl_table_update *update;
+	const uint8_t *key;
+	const uint8_t *data;
+	struct p4_table *table;
+	uint16_t applied = 0;
+	int status = P4_OK;
+
+	while (len > 0 && status == P4_OK)
+	{
+		if (len < sizeof(struct ctrl_table_update))
+		{
+			status = P4_ERR_INVALID;
+			break;
+		}
+		update = (const struct ctrl_table_update*)ctrl_take(cursor, sizeof(struct ctrl_table_update), update_buf);
+		len -= sizeof(struct ctrl_table_update);
+
+		table = p4_get_table(update->table_id);
+		if (table == NULL || update->data_len > P4_DATA_MAX || len < table->key_len + update->data_len)
+		{
+			status = P4_ERR_INVALID;
+			break;
+		}
+		if (persist_busy() && table->state != P4_RCU_OPEN)
+		{
+			status = P4_ERR_BUSY;	// The live entries are being saved, updates to a shadow can go ahead
+			break;
+		}
+		key = ctrl_take(cursor, table->key_len, key_buf);
+		data = ctrl_take(cursor, update->data_len, data_buf);
+		len -= table->key_len + update->data_len;
+
+		switch (update->op)
+		{
+			case CTRL_TABLE_ADD:
+			status = p4_table_add(table, key, update->action_id, data, update->data_len);
+			break;
+
+			case CTRL_TABLE_MODIFY:
+			status = p4_table_modify(table, key, update->action_id, data, update->data_len);
+			break;
+
+			case CTRL_TABLE_DELETE:
+			status = p4_table_delete(table, key);
+			break;
+
+			default:
+			status = P4_ERR_INVALID;
+			break;
+		}
+		if (status == P4_OK) applied++;
+	}
+	ctrl_stats.updates += applied;
+	if (applied > 0) persist_changed();
+	ctrl_ack(xid, status, applied);
+	return;
+}
+
+/*
+*	Read a range of counter or register cells
+*
+*	The reply holds as many cells as fit in CTRL_REPLY_MAX, the count
+*	in the echoed range says how many were returned.
+*
+*	@param *header - pointer to the request header.
+*	@param *cursor - pointer to the start of the body.
+*	@param len - length of the body.
+*
+*/
+static void ctrl_array_read(const struct ctrl_header *header, struct ctrl_cursor *cursor, uint16_t len)
+{
+	uint8_t range_buf[sizeof(struct ctrl_array_range)];
+	const struct ctrl_array_range *range;
+	struct ctrl_array_range *reply = (struct ctrl_array_range*)ctrl_reply;
+	uint8_t *cells = ctrl_reply + sizeof(struct ctrl_array_range);
+	uint32_t value[2];
+	uint8_t cell_len;
+	struct p4_counter *counter = NULL;
+	struct p4_register *reg = NULL;
+	uint16_t index, count, size, max;
+	uint32_t xid = ntohl(header->xid);
+
+	if (len != sizeof(struct ctrl_array_range))
+	{
+		ctrl_ack(xid, P4_ERR_INVALID, 0);
+		return;
+	}
+	range = (const struct ctrl_array_range*)ctrl_take(cursor, sizeof(struct ctrl_array_range), range_buf);
+	index = ntohs(range->index);
+	count = ntohs(range->count);
+
+	if (header->type == CTRL_COUNTER_READ)
+	{
+		counter = p4_get_counter(range->id);
+		size = (counter != NULL) ? counter->size : 0;
+		cell_len = 2 * sizeof(uint32_t);
+	} else {
+		reg = p4_get_register(range->id);
+		size = (reg != NULL) ? reg->size : 0;
+		cell_len = sizeof(uint32_t);
+	}
+	max = CTRL_REPLY_MAX / cell_len;
+	if (size == 0 || index >= size)
+	{
+		ctrl_ack(xid, (size == 0) ? P4_ERR_NOT_FOUND : P4_ERR_INVALID, 0);
+		return;
+	}
+	if (count > size - index) count = size - index;
+	if (count > max) count = max;
+
+	for (int x=0;x<count;x++)
+	{
+		if (counter != NULL)
+		{
+			value[0] = htonl(counter->cells[index + x].packets);
+			value[1] = htonl(counter->cells[index + x].bytes);
+		} else {
+			value[0] = htonl(reg->cells[index + x]);
+		}
+		memcpy(cells + (x * cell_len), value, cell_len);	// Cells are not word aligned in the reply
+	}
+	reply->id = range->id;
+	reply->reserved = 0;
+	reply->index = htons(index);
+	reply->count = htons(count);
+	controller_queue((counter != NULL) ? CTRL_COUNTER_REPLY : CTRL_REGISTER_REPLY, xid, ctrl_reply, sizeof(struct ctrl_array_range) + (count * cell_len));
+	return;
+}
+
+/*
+*	Write a range of register cells
+*
+*	@param xid - the transaction ID.
+*	@param *cursor - pointer to the start of the body.
+*	@param len - length of the body.
+*
+*/
+static void ctrl_register_write(uint32_t xid, struct ctrl_cursor *cursor, uint16_t len)
+{
+	uint8_t range_buf[sizeof(struct ctrl_array_range)];
+	uint8_t value_buf[sizeof(uint32_t)];
+	const struct ctrl_array_range *range;
+	struct p4_register *reg;
+	uint32_t value;
+	uint16_t index, count;
+
+	if (len < sizeof(struct ctrl_array_range))
+	{
+		ctrl_ack(xid, P4_ERR_INVALID, 0);
+		return;
+	}
+	range = (const struct ctrl_array_range*)ctrl_take(cursor, sizeof(struct ctrl_array_range), range_buf);
+	index = ntohs(range->index);
+	count = ntohs(range->count);
+	reg = p4_get_register(range->id);
+
+	if (reg == NULL)
+	{
+		ctrl_ack(xid, P4_ERR_NOT_FOUND, 0);
+		return;
+	}
+	if (len != sizeof(struct ctrl_array_range) + (count * sizeof(uint32_t)) || index >= reg->size || count > reg->size - index)
+	{
+		ctrl_ack(xid, P4_ERR_INVALID, 0);
+		return;
+	}
+
+	for (int x=0;x<count;x++)
+	{
+		memcpy(&value, ctrl_take(cursor, sizeof(uint32_t), value_buf), sizeof(uint32_t));
+		reg->cells[index + x] = ntohl(value);
+	}
+	ctrl_ack(xid, P4_OK, count);
+	return;
+}
+
+/*
+*	Start or publish an RCU update of a table
+*
+*	Between CTRL_TABLE_BEGIN and CTRL_TABLE_COMMIT, CTRL_TABLE_WRITE
+*	updates to the table build a new version while the dataplane keeps
+*	using the current one.
+*
+*	@param *header - pointer to the request header.
+*	@param *cursor - pointer to the start of the body.
+*	@param len - length of the body.
+*
+*/
+static void ctrl_table_txn(const struct ctrl_header *header, struct ctrl_cursor *cursor, uint16_t len)
+{
+	uint8_t txn_buf[sizeof(struct ctrl_table_txn)];
+	const struct ctrl_table_txn *txn;
+	struct p4_table *table;
+	uint32_t xid = ntohl(header->xid);
+	int status;
+
+	if (len != sizeof(struct ctrl_table_txn))
+	{
+		ctrl_ack(xid, P4_ERR_INVALID, 0);
+		return;
+	}
+	txn = (const struct ctrl_table_txn*)ctrl_take(cursor, sizeof(struct ctrl_table_txn), txn_buf);
+	table = p4_get_table(txn->table_id);
+	if (table == NULL)
+	{
+		ctrl_ack(xid, P4_ERR_NOT_FOUND, 0);
+		return;
+	}
+
+	if (header->type == CTRL_TABLE_BEGIN)
+	{
+		ctrl_ack(xid, p4_table_begin(table), 0);
+	} else {
+		status = persist_busy() ? P4_ERR_BUSY : p4_table_commit(table);	// Not while the live entries are being saved
+		if (status == P4_OK) persist_changed();
+		ctrl_ack(xid, status, p4_rcu_stats.updates);
+	}
+	return;
+}
+
+/*
+*	Load a bytecode program
+*
+*	The instructions are copied into the buffer the dataplane is not
+*	using, then verified and swapped in before the next frame. A
+*	rejected program leaves the running pipeline unchanged and the
+*	acknowledgement carries the index of the instruction that failed.
+*
+*	@param xid - the transaction ID.
+*	@param *cursor - pointer to the start of the body.
+*	@param len - length of the body.
+*
+*/
+static void ctrl_program_load(uint32_t xid, struct ctrl_cursor *cursor, uint16_t len)
+{
+	uint8_t program_buf[sizeof(struct ctrl_program)];
+	uint8_t insn_buf[sizeof(struct vm_insn)];
+	const struct ctrl_program *program;
+	struct vm_insn *staging;
+	uint16_t count, bad;
+	int status;
+
+	if (len < sizeof(struct ctrl_program))
+	{
+		ctrl_ack(xid, P4_ERR_INVALID, 0);
+		return;
+	}
+	program = (const struct ctrl_program*)ctrl_take(cursor, sizeof(struct ctrl_program), program_buf);
+	count = ntohs(program->count);
+	if (len != sizeof(struct ctrl_program) + (count * sizeof(struct vm_insn)))
+	{
+		ctrl_ack(xid, P4_ERR_INVALID, 0);
+		return;
+	}
+	staging = vm_staging(count);
+	if (staging == NULL)
+	{
+		vm_stats.rejected++;
+		ctrl_ack(xid, (count == 0) ? P4_ERR_INVALID : P4_ERR_FULL, 0);
+		return;
+	}
+
+	for (int x=0;x<count;x++)
+	{
+		memcpy(&staging[x], ctrl_take(cursor, sizeof(struct vm_insn), insn_buf), sizeof(struct vm_insn));
+		staging[x].jump = ntohs(staging[x].jump);
+		staging[x].off = ntohs(staging[x].off);
+		staging[x].imm = ntohl(staging[x].imm);
+	}
+	status = vm_commit(count, &bad);
+	ctrl_ack(xid, status, bad);
+	return;
+}
+
+/*
+*	Set the ports of a fast failover group
+*
+*	@param xid - the transaction ID.
+*	@param *cursor - pointer to the start of the body.
+*	@param len - length of the body.
+*
+*/
+static void ctrl_ff_group_set(uint32_t xid, struct ctrl_cursor *cursor, uint16_t len)
+{
+	uint8_t group_buf[sizeof(struct ctrl_ff_group)];
+	uint8_t port_buf[FF_GROUP_MAX_MEMBERS];
+	const struct ctrl_ff_group *group;
+	const uint8_t *ports;
+
+	if (len < sizeof(struct ctrl_ff_group))
+	{
+		ctrl_ack(xid, P4_ERR_INVALID, 0);
+		return;
+	}
+	group = (const struct ctrl_ff_group*)ctrl_take(cursor, sizeof(struct ctrl_ff_group), group_buf);
+	if (group->count > FF_GROUP_MAX_MEMBERS || len != sizeof(struct ctrl_ff_group) + group->count)
+	{
+		ctrl_ack(xid, P4_ERR_INVALID, 0);
+		return;
+	}
+	ports = ctrl_take(cursor, group->count, port_buf);
+	ctrl_ack(xid, (ff_group_set(group->group_id, ports, group->count) == 0) ? P4_OK : P4_ERR_INVALID, group->count);
+	return;
+}
+
+/*
+*	Set or remove a member of an action selector
+*
+*	@param xid - the transaction ID.
+*	@param *cursor - pointer to the start of the body.
+*	@param len - length of the body.
+*
+*/
+static void ctrl_selector_member(uint32_t xid, struct ctrl_cursor *cursor, uint16_t len)
+{
+	uint8_t member_buf[sizeof(struct ctrl_selector_member)];
+	uint8_t data_buf[SELECTOR_DATA_LEN];
+	const struct ctrl_selector_member *member;
+	const uint8_t *data = NULL;
+
+	if (len < sizeof(struct ctrl_selector_member))
+	{
+		ctrl_ack(xid, P4_ERR_INVALID, 0);
+		return;
+	}
+	member = (const struct ctrl_selector_member*)ctrl_take(cursor, sizeof(struct ctrl_selector_member), member_buf);
+	if (len != sizeof(struct ctrl_selector_member) + (member->valid ? SELECTOR_DATA_LEN : 0))
+	{
+		ctrl_ack(xid, P4_ERR_INVALID, 0);
+		return;
+	}
+	if (member->valid) data = ctrl_take(cursor, SELECTOR_DATA_LEN, data_buf);
+	ctrl_ack(xid, (selector_set_member(member->selector_id, member->member_id, member->action_id, data) == 0) ? P4_OK : P4_ERR_INVALID, member->member_id);
+	return;
+}
+
+/*
+*	Set the members of an action selector group
+*
+*	@param xid - the transaction ID.
+*	@param *cursor - pointer to the start of the body.
+*	@param len - length of the body.
+*
+*/
+static void ctrl_selector_group(uint32_t xid, struct ctrl_cursor *cursor, uint16_t len)
+{
+	uint8_t group_buf[sizeof(struct ctrl_selector_group)];
+	uint8_t member_buf[SELECTOR_GROUP_SIZE];
+	const struct ctrl_selector_group *group;
+	const uint8_t *members;
+
+	if (len < sizeof(struct ctrl_selector_group))
+	{
+		ctrl_ack(xid, P4_ERR_INVALID, 0);
+		return;
+	}
+	group = (const struct ctrl_selector_group*)ctrl_take(cursor, sizeof(struct ctrl_selector_group), group_buf);
+	if (group->count > SELECTOR_GROUP_SIZE || len != sizeof(struct ctrl_selector_group) + group->count)
+	{
+		ctrl_ack(xid, P4_ERR_INVALID, 0);
+		return;
+	}
+	members = ctrl_take(cursor, group->count, member_buf);
+	ctrl_ack(xid, (selector_set_group(group->selector_id, group->group_id, members, group->count) == 0) ? P4_OK : P4_ERR_INVALID, group->count);
+	return;
+}
+
+/*
+*	Handle one complete request
+*
+*	@param *header - pointer to the request header.
+*	@param *cursor - pointer to the start of the body.
+*	@param len - length of the body.
+*
+*/
+static void controller_message(const struct ctrl_header *header, struct ctrl_cursor *cursor, uint16_t len)
+{
+	uint8_t subscribe_buf[sizeof(struct ctrl_subscribe)];
+	const struct ctrl_subscribe *subscribe;
+	uint8_t config_buf[sizeof(struct punt_config)];
+	const struct punt_config *config;
+	uint32_t xid = ntohl(header->xid);
+
+	ctrl_stats.rx_msgs++;
+	switch (header->type)
+	{
+		case CTRL_HELLO:
+		break;
+
+		case CTRL_TABLE_WRITE:
+		ctrl_table_write(xid, cursor, len);
+		break;
+
+		case CTRL_COUNTER_READ:
+		case CTRL_REGISTER_READ:
+		ctrl_array_read(header, cursor, len);
+		break;
+
+		case CTRL_REGISTER_WRITE:
+		ctrl_register_write(xid, cursor, len);
+		break;
+
+		case CTRL_DIGEST_SUBSCRIBE:
+		if (len != sizeof(struct ctrl_subscribe))
+		{
+			ctrl_ack(xid, P4_ERR_INVALID, 0);
+			break;
+		}
+		subscribe = (const struct ctrl_subscribe*)ctrl_take(cursor, sizeof(struct ctrl_subscribe), subscribe_buf);
+		ctrl_ack(xid, digest_subscribe(ntohs(subscribe->digest_id), subscribe->enable != 0), 0);
+		break;
+
+		case CTRL_TABLE_BEGIN:
+		case CTRL_TABLE_COMMIT:
+		ctrl_table_txn(header, cursor, len);
+		break;
+
+		case CTRL_PUNT_CONFIG:
+		if (len != sizeof(struct punt_config))
+		{
+			ctrl_ack(xid, P4_ERR_INVALID, 0);
+			break;
+		}
+		config = (const struct punt_config*)ctrl_take(cursor, sizeof(struct punt_config), config_buf);
+		ctrl_ack(xid, punt_configure(config->reason, ntohs(config->sample), ntohs(config->rate), ntohs(config->burst), ntohs(config->snaplen)), 0);
+		break;
+
+		case CTRL_PROGRAM_LOAD:
+		ctrl_program_load(xid, cursor, len);
+		break;
+
+		case CTRL_PROGRAM_UNLOAD:
+		vm_unload();
+		ctrl_ack(xid, P4_OK, 0);
+		break;
+
+		case CTRL_FF_GROUP_SET:
+		ctrl_ff_group_set(xid, cursor, len);
+		break;
+
+		case CTRL_SELECTOR_MEMBER:
+		ctrl_selector_member(xid, cursor, len);
+		break;
+
+		case CTRL_SELECTOR_GROUP:
+		ctrl_selector_group(xid, cursor, len);
+		break;
+
+		default:
+		ctrl_ack(xid, P4_ERR_INVALID, 0);
+		break;
+	}
+	return;
+}
+
+/*
+*	Record the time a control plane slice kept the main loop from forwarding
+*
+*	@param start - DWT cycle count at the start of the slice.
+*
+*/
+static void ctrl_slice(uint32_t start)
+{
+	uint32_t cycles = DWT->CYCCNT - start;
+
+	if (cycles > ctrl_stats.max_slice) ctrl_stats.max_slice = cycles;
+	p4_rcu_slice(cycles);
+	return;
+}
+
+/*
+*	Handle all the complete requests that have been received
+*
+*	Requests are pipelined, the controller does not wait for an
+*	acknowledgement before sending the next one. Replies are queued
+*	as each request is handled and sent together at the end. If the
+*	send buffer cannot hold a reply, handling stops until the
+*	controller acknowledges some data.
+*
+*	@param *pcb - pointer to the connection.
+*
+*	Returns ERR_ABRT if the connection was aborted for a protocol error.
+*
+*/
+static err_t controller_process(struct tcp_pcb *pcb)
+{
+	uint8_t header_buf[sizeof(struct ctrl_header)];
+	const struct ctrl_header *header;
+	struct ctrl_cursor cursor;
+	uint16_t length;
+	bool queued = false;
+	uint32_t start = DWT->CYCCNT;
+
+	while (ctrl_rx != NULL && ctrl_rx->tot_len >= sizeof(struct ctrl_header))
+	{
+		cursor.p = ctrl_rx;
+		cursor.offset = 0;
+		header = (const struct ctrl_header*)ctrl_take(&cursor, sizeof(struct ctrl_header), header_buf);
+		length = ntohs(header->length);
+
+		if (header->version != CTRL_VERSION || length < sizeof(struct ctrl_header) || length > CTRL_MAX_MSG)
+		{
+			TRACE("controller.c: bad message from controller, closing connection");
+			tcp_arg(pcb, NULL);
+			tcp_recv(pcb, NULL);
+			tcp_sent(pcb, NULL);
+			tcp_err(pcb, NULL);
+			tcp_abort(pcb);
+			controller_reset();
+			return ERR_ABRT;
+		}
+		if (ctrl_rx->tot_len < length) break;
+
+		if (tcp_sndbuf(pcb) < sizeof(struct ctrl_header) + sizeof(ctrl_reply) || tcp_sndqueuelen(pcb) > TCP_SND_QUEUELEN - 4)
+		{
+			ctrl_stats.stalls++;
+			break;
+		}
+
+		/* Wait for shadow copies to finish, task_controller() carries on */
+		if (p4_tables_busy()) break;
+
+		controller_message(header, &cursor, length - sizeof(struct ctrl_header));
+		ctrl_consume(pcb, length);
+		queued = true;
+	}
+
+	if (queued) tcp_output(pcb);
+	ctrl_slice(start);
+	return ERR_OK;
+}
+
+/*
+*	Check if a controller is connected
+*
+*/
+bool controller_connected(void)
+{
+	return (ctrl_pcb != NULL);
+}
+
+/*
+*	Space left in the send buffer of the controller connection
+*
+*/
+uint16_t controller_space(void)
+{
+	if (ctrl_pcb == NULL) return 0;
+	return tcp_sndbuf(ctrl_pcb);
+}
+
+/*
+*	Queue a message to the controller without sending it
+*
+*	@param type - the message type.
+*	@param xid - the transaction ID.
+*	@param *body - pointer to the message body.
+*	@param len - length of the message body.
+*
+*	Returns ERR_CONN if there is no controller, ERR_MEM if the send buffer is full.
+*
+*/
+err_t controller_queue(uint8_t type, uint32_t xid, const void *body, uint16_t len)
+{
+	struct ctrl_header header;
+	err_t err;
+
+	if (ctrl_pcb == NULL) return ERR_CONN;
+	if (tcp_sndbuf(ctrl_pcb) < sizeof(header) + len || tcp_sndqueuelen(ctrl_pcb) > TCP_SND_QUEUELEN - 2) return ERR_MEM;
+
+	header.version = CTRL_VERSION;
+	header.type = type;
+	header.length = htons(sizeof(header) + len);
+	header.xid = htonl(xid);
+
+	err = tcp_write(ctrl_pcb, &header, sizeof(header), TCP_WRITE_FLAG_COPY | TCP_WRITE_FLAG_MORE);
+	if (err == ERR_OK && len > 0) err = tcp_write(ctrl_pcb, body, len, TCP_WRITE_FLAG_COPY | TCP_WRITE_FLAG_MORE);
+	if (err != ERR_OK) return err;
+	ctrl_stats.tx_msgs++;
+	return ERR_OK;
+}
+
+/*
+*	Send a message to the controller
+*
+*	@param type - the message type.
+*	@param xid - the transaction ID.
+*	@param *body - pointer to the message body.
+*	@param len - length of the message body.
+*
+*	Returns ERR_CONN if there is no controller, ERR_MEM if the send buffer is full.
+*
+*/
+err_t controller_send(uint8_t type, uint32_t xid, const void *body, uint16_t len)
+{
+	err_t err = controller_queue(type, xid, body, len);
+
+	if (err != ERR_OK) return err;
+	return tcp_output(ctrl_pcb);
+}
+
+/*
+*	Controller task, called from the main loop
+*
+*/
+void task_controller(void)
+{
+	uint32_t start = DWT->CYCCNT;
+
+	p4_tables_task();
+	ctrl_slice(start);
+
+	/* Carry on with requests held back by a shadow copy */
+	if (ctrl_rx != NULL && ctrl_pcb != NULL && !p4_tables_busy()) controller_process(ctrl_pcb);
+
+	digest_flush();
+	punt_flush();
+	return;
+}
@@ -0,0 +1,192 @@
+/**
+ * @file
+ * controller.h
+ *
+ * This file contains the declarations for the management connection to the controller
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX P4 firmware.
+ * Copyright (c) 2019 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Paul Zanna <paul@northboundnetworks.com>
+ *
+ */
+
+#ifndef CONTROLLER_H_
+#define CONTROLLER_H_
+
+#include "lwip/err.h"
+#include <arch/cc.h>
+
+#define CONTROLLER_PORT		9559	// TCP port the controller connects to
+#define CTRL_VERSION		1
+#define CTRL_MAX_MSG		2048	// Largest message accepted, must fit in the TCP window
+#define CTRL_REPLY_MAX		512	// Largest reply body, space is reserved before each request is handled
+
+/* Management message types */
+enum ctrl_msg_type {
+	CTRL_HELLO,
+	CTRL_DIGEST,
+	CTRL_ACK,		// Result of a write or subscribe request
+	CTRL_TABLE_WRITE,	// Batch of table updates
+	CTRL_COUNTER_READ,
+	CTRL_COUNTER_REPLY,
+	CTRL_REGISTER_READ,
+	CTRL_REGISTER_REPLY,
+	CTRL_REGISTER_WRITE,
+	CTRL_DIGEST_SUBSCRIBE,
+	CTRL_TABLE_BEGIN,	// Start an RCU update of a table
+	CTRL_TABLE_COMMIT,	// Publish an RCU update
+	CTRL_PACKET_IN,		// Batch of frames punted by the program
+	CTRL_PUNT_CONFIG,	// Sampling, rate limit and snap length of a punt reason
+	CTRL_PROGRAM_LOAD,	// Replace the pipeline with a bytecode program
+	CTRL_PROGRAM_UNLOAD,	// Go back to the compiled pipeline
+	CTRL_FF_GROUP_SET,	// Set the ports of a fast failover group
+	CTRL_SELECTOR_MEMBER,	// Set or remove an action selector member
+	CTRL_SELECTOR_GROUP	// Set the members of an action selector group
+};
+
+/* Table update operations */
+enum ctrl_table_op {
+	CTRL_TABLE_ADD = 1,
+	CTRL_TABLE_MODIFY,
+	CTRL_TABLE_DELETE
+};
+
+/* Every management message starts with this header, all fields are network byte order */
+PACK_STRUCT_BEGIN
+struct ctrl_header {
+	uint8_t version;
+	uint8_t type;
+	uint16_t length;	// Including this header
+	uint32_t xid;
+} PACK_STRUCT_STRUCT;
+PACK_STRUCT_END
+
+/* Body of a CTRL_ACK message, echoes the xid of the request */
+PACK_STRUCT_BEGIN
+struct ctrl_ack {
+	uint8_t status;		// enum p4_status
+	uint8_t reserved;
+	uint16_t index;		// Updates applied before the first failure
+} PACK_STRUCT_STRUCT;
+PACK_STRUCT_END
+
+/* One update in a CTRL_TABLE_WRITE message, followed by the key and data_len bytes of action data */
+PACK_STRUCT_BEGIN
+struct ctrl_table_update {
+	uint8_t op;
+	uint8_t table_id;
+	uint8_t action_id;
+	uint8_t data_len;
+} PACK_STRUCT_STRUCT;
+PACK_STRUCT_END
+
+/*
+*	Body of counter and register reads, echoed at the start of the reply.
+*	A CTRL_REGISTER_WRITE has count 32 bit values after it.
+*/
+PACK_STRUCT_BEGIN
+struct ctrl_array_range {
+	uint8_t id;
+	uint8_t reserved;
+	uint16_t index;
+	uint16_t count;
+} PACK_STRUCT_STRUCT;
+PACK_STRUCT_END
+
+/* Body of a CTRL_DIGEST_SUBSCRIBE message */
+PACK_STRUCT_BEGIN
+struct ctrl_subscribe {
+	uint16_t digest_id;
+	uint8_t enable;
+	uint8_t reserved;
+} PACK_STRUCT_STRUCT;
+PACK_STRUCT_END
+
+/* Body of CTRL_TABLE_BEGIN and CTRL_TABLE_COMMIT messages */
+PACK_STRUCT_BEGIN
+struct ctrl_table_txn {
+	uint8_t table_id;
+	uint8_t reserved[3];
+} PACK_STRUCT_STRUCT;
+PACK_STRUCT_END
+
+/*
+*	Body of a CTRL_PROGRAM_LOAD message, followed by count instructions
+*	laid out as struct vm_insn with the 16 and 32 bit fields in network
+*	byte order
+*/
+PACK_STRUCT_BEGIN
+struct ctrl_program {
+	uint16_t count;
+	uint16_t reserved;
+} PACK_STRUCT_STRUCT;
+PACK_STRUCT_END
+
+/* Body of a CTRL_FF_GROUP_SET message, followed by count ports in order of preference, a count of 0 empties the group */
+PACK_STRUCT_BEGIN
+struct ctrl_ff_group {
+	uint8_t group_id;
+	uint8_t count;
+	uint16_t reserved;
+} PACK_STRUCT_STRUCT;
+PACK_STRUCT_END
+
+/* Body of a CTRL_SELECTOR_MEMBER message, followed by SELECTOR_DATA_LEN bytes of action data when valid is set */
+PACK_STRUCT_BEGIN
+struct ctrl_selector_member {
+	uint8_t selector_id;
+	uint8_t member_id;
+	uint8_t action_id;
+	uint8_t valid;	// 0 removes the member
+} PACK_STRUCT_STRUCT;
+PACK_STRUCT_END
+
+/* Body of a CTRL_SELECTOR_GROUP message, followed by count member IDs */
+PACK_STRUCT_BEGIN
+struct ctrl_selector_group {
+	uint8_t selector_id;
+	uint8_t group_id;
+	uint8_t count;
+	uint8_t reserved;
+} PACK_STRUCT_STRUCT;
+PACK_STRUCT_END
+
+/* Controller channel counters */
+struct ctrl_stats {
+	uint32_t connects;	// Number of times a controller has connected
+	uint32_t tx_msgs;	// Messages sent to the controller
+	uint32_t rx_msgs;	// Requests handled
+	uint32_t updates;	// Table updates applied
+	uint32_t errors;	// Requests that failed
+	uint32_t stalls;	// Times request handling waited for send buffer space
+	uint32_t copies;	// Fields gathered because they crossed a segment boundary
+	uint32_t max_slice;	// Longest time spent handling requests in one pass, in CPU cycles
+};
+
+extern struct ctrl_stats ctrl_stats;
+
+void controller_init(void);
+void task_controller(void);
+bool controller_connected(void);
+uint16_t controller_space(void);
+err_t controller_queue(uint8_t type, uint32_t xid, const void *body, uint16_t len);
+err_t controller_send(uint8_t type, uint32_t xid, const void *body, uint16_t len);
+
+#endif /* CONTROLLER_H_ */
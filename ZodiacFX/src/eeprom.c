@@ -64,55 +64,6 @@ void eeprom_init(void)
 	return;
 }
 
-/*
-*	EEROM write function
-*
-*/
-int eeprom_write(void)
-{
-	twi_packet_t packet_tx;
-	uint16_t pMemAddress;
-	uint8_t *pZodiac_Config;
-	int pagecount = 0;
-	int configsize = sizeof(Zodiac_Config);
-
-	/* Configure the data packet to be transmitted */
-	packet_tx.chip        = AT24C_ADDRESS;
-	packet_tx.addr_length = EEPROM_MEM_ADDR_LENGTH;
-
-	printf("Writing Configuration to EEPROM (%d bytes)\r\n",configsize);
-
-	while (pagecount < configsize)
-	{
-		pZodiac_Config = &Zodiac_Config;
-		pMemAddress = pagecount;
-		pZodiac_Config = pZodiac_Config + pagecount;
-		packet_tx.addr[0]     = pMemAddress;
-		packet_tx.addr[1]     = pMemAddress >> 8;
-		packet_tx.buffer      = pZodiac_Config;
-
-		if ((configsize - pagecount) >= 16)
-		{
-			packet_tx.length = 16;
-		} else {
-			packet_tx.length = configsize - pagecount;
-		}
-
-		if (twi_master_write(TWI0, &packet_tx) != TWI_SUCCESS)
-		{
-			printf("-%d-\tTWI master write packet failed.\r\n", pagecount);
-			return -1;
-		}
-
-		pagecount = pagecount + 16;
-		for(int x = 0;x<1000000;x++);
-	}
-
-	printf("Done!\r");
-	return 0;
-
-}
-
 /*
 *	EEROM read function
 *
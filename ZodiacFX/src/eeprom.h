@@ -34,7 +34,6 @@
 
 void eeprom_init(void);
 int eeprom_read(void);
-int eeprom_write(void);
 
 
 #endif /* EEPROM_H_ */
@@ -0,0 +1,731 @@
+/**
+ * @file
+ * egress.c
+ *
+ * This file contains the egress queue and scheduler functions
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX P4 firmware.
+ * Copyright (c) 2019 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Paul Zanna <paul@northboundnetworks.com>
+ *
+ */
+
+#include <asf.h>
+#include <string.h>
+#include "egress.h"
+#include "pktbuf.h"
+#include "switch.h"
+#include "timers.h"
+
+// Global variables
+extern gmac_device_t gs_gmac_dev;
+
+// Local variables
+struct egress_port egress_ports[EGRESS_PORTS];
+struct egress_stats egress_stats;
+const char *const egress_sched_name[EGRESS_SCHEDS] = {"strict", "wrr", "drr"};
+const char *const egress_aqm_name[EGRESS_AQMS] = {"off", "codel", "fq-codel"};
+static uint8_t egress_sched = EGRESS_STRICT;
+static uint8_t egress_aqm = EGRESS_AQM_OFF;
+static uint8_t egress_weights[EGRESS_CLASSES] = {0, 4, 2, 1};	// Class 0 is always sent first
+static const uint8_t egress_default_weights[EGRESS_CLASSES] = {0, 4, 2, 1};
+static uint8_t egress_backlog = 0;	// Frames in all the queues
+static uint8_t egress_next_port = 0;	// Port the next frame is taken from
+static uint8_t egress_class_depth[EGRESS_CLASSES];	// Frames of each class in all the queues
+
+/* Class of a priority, 802.1p puts background (1) and spare (2) below best effort (0) */
+static const uint8_t egress_pcp_class[8] = {2, 3, 3, 2, 1, 1, 0, 0};
+static const uint8_t egress_prec_class[8] = {2, 3, 2, 2, 1, 1, 0, 0};	// IP precedence, CS1 is bulk
+
+/*
+*	Empty the queues
+*
+*/
+void egress_init(void)
+{
+	memset(egress_ports, 0, sizeof(egress_ports));
+	for (int x=0;x<EGRESS_PORTS;x++)
+	{
+		egress_ports[x].current = 1;
+		for (int c=0;c<EGRESS_CLASSES;c++)
+		{
+			struct egress_queue *q = &egress_ports[x].queue[c];
+			for (int l=0;l<EGRESS_LISTS;l++) q->list_head[l] = q->list_tail[l] = EGRESS_FLOWS;
+			for (int f=0;f<EGRESS_FLOWS;f++) q->flow[f].list = EGRESS_LISTS;
+		}
+	}
+	memset(&egress_stats, 0, sizeof(egress_stats));
+	memset(egress_class_depth, 0, sizeof(egress_class_depth));
+	egress_backlog = 0;
+	egress_next_port = 0;
+	return;
+}
+
+/*
+*	Set the scheduler, takes effect from the next frame
+*
+*	@param sched - enum egress_sched.
+*	@param *weights - EGRESS_CLASSES weights, 0 for the default. Class 0 has none.
+*
+*/
+void egress_configure(uint8_t sched, const uint8_t *weights)
+{
+	egress_sched = (sched < EGRESS_SCHEDS) ? sched : EGRESS_STRICT;
+	for (int x=1;x<EGRESS_CLASSES;x++)
+	{
+		egress_weights[x] = (weights[x] != 0) ? weights[x] : egress_default_weights[x];
+	}
+	return;
+}
+
+/*
+*	Weight in use for a class
+*
+*	@param class - the class.
+*
+*/
+uint8_t egress_weight(uint8_t class)
+{
+	return egress_weights[class];
+}
+
+/*
+*	Turn active queue management on or off, frames already queued stay where they are
+*
+*	@param aqm - enum egress_aqm.
+*
+*/
+void egress_set_aqm(uint8_t aqm)
+{
+	egress_aqm = (aqm < EGRESS_AQMS) ? aqm : EGRESS_AQM_OFF;
+	for (int x=0;x<EGRESS_PORTS;x++)
+	{
+		for (int c=0;c<EGRESS_CLASSES;c++)
+		{
+			for (int f=0;f<EGRESS_FLOWS;f++) memset(&egress_ports[x].queue[c].flow[f].codel, 0, sizeof(struct egress_codel));
+		}
+	}
+	return;
+}
+
+/*
+*	Pick the class of a frame from its 802.1p priority or IP precedence
+*
+*	@param *p_frame - pointer to the frame.
+*	@param size - size of the frame.
+*
+*/
+HOT_PATH
+uint8_t egress_classify(const uint8_t *p_frame, uint16_t size)
+{
+	uint16_t type;
+
+	if (size < 14) return EGRESS_CLASS_DEFAULT;
+	if (p_frame[0] == 0x01 && p_frame[1] == 0x80 && p_frame[2] == 0xC2) return 0;	// Bridge protocols, STP, LACP and LLDP
+	type = (p_frame[12] << 8) | p_frame[13];
+	if (type == 0x8100 && size >= 18) return egress_pcp_class[p_frame[14] >> 5];
+	if (type == 0x0806) return 0;	// ARP
+	if (type == 0x0800 && size >= 16) return egress_prec_class[p_frame[15] >> 5];
+	return EGRESS_CLASS_DEFAULT;
+}
+
+/*
+*	Flow queue of a frame, from its IPv4 addresses and ports or else its MAC addresses
+*
+*	@param *p_frame - pointer to the frame.
+*	@param size - size of the frame.
+*
+*/
+static uint8_t egress_flow_hash(const uint8_t *p_frame, uint16_t size)
+{
+	const uint8_t *ip = p_frame + 14;
+	uint32_t h;
+	uint8_t ihl;
+
+	if (size >= 18 && p_frame[12] == 0x81 && p_frame[13] == 0x00) ip += 4;
+	if (ip + 20 <= p_frame + size && ip[-2] == 0x08 && ip[-1] == 0x00)
+	{
+		h = ((ip[12] << 24) | (ip[13] << 16) | (ip[14] << 8) | ip[15]) ^ ((ip[16] << 24) | (ip[17] << 16) | (ip[18] << 8) | ip[19]) ^ ip[9];
+		ihl = (ip[0] & 0x0F) * 4;
+		if ((ip[9] == 6 || ip[9] == 17) && (ip[6] & 0x1F) == 0 && ip[7] == 0 && ip + ihl + 4 <= p_frame + size)
+		{
+			h ^= (ip[ihl] << 24) | (ip[ihl + 1] << 16) | (ip[ihl + 2] << 8) | ip[ihl + 3];	// Not on later fragments
+		}
+	} else {
+		h = ((p_frame[2] << 24) | (p_frame[3] << 16) | (p_frame[4] << 8) | p_frame[5]) ^ ((p_frame[8] << 24) | (p_frame[9] << 16) | (p_frame[10] << 8) | p_frame[11]);
+	}
+	h *= 0x9E3779B1;
+	return (h >> 24) % EGRESS_FLOWS;
+}
+
+/*
+*	Add a flow to the end of a list
+*
+*	@param *q - the queue.
+*	@param list - enum egress_list.
+*	@param flow - index of the flow.
+*
+*/
+static void egress_list_add(struct egress_queue *q, uint8_t list, uint8_t flow)
+{
+	q->flow[flow].next = EGRESS_FLOWS;
+	q->flow[flow].list = list;
+	if (q->list_head[list] == EGRESS_FLOWS)
+	{
+		q->list_head[list] = flow;
+	} else {
+		q->flow[q->list_tail[list]].next = flow;
+	}
+	q->list_tail[list] = flow;
+	return;
+}
+
+/*
+*	Take the flow at the front of a list off it
+*
+*	@param *q - the queue.
+*	@param list - enum egress_list, it must not be empty.
+*
+*/
+static uint8_t egress_list_remove(struct egress_queue *q, uint8_t list)
+{
+	uint8_t flow = q->list_head[list];
+
+	q->list_head[list] = q->flow[flow].next;
+	q->flow[flow].list = EGRESS_LISTS;
+	return flow;
+}
+
+/*
+*	Take the oldest frame from a flow
+*
+*	@param *ep - the port.
+*	@param *q - the queue the flow is in.
+*	@param *f - the flow.
+*
+*	Returns the frame, or NULL if the flow is empty.
+*
+*/
+HOT_PATH
+static struct pktbuf *egress_pop(struct egress_port *ep, struct egress_queue *q, struct egress_flow *f)
+{
+	struct pktbuf *b = f->head;
+
+	if (b == NULL) return NULL;
+	f->head = b->next;
+	if (f->head == NULL) f->tail = NULL;
+	f->bytes -= b->size;
+	q->depth--;
+	ep->backlog--;
+	egress_class_depth[q - ep->queue]--;
+	egress_backlog--;
+	return b;
+}
+
+/*
+*	Flow with the most bytes queued
+*
+*	@param *q - the queue, it must have a frame queued.
+*
+*/
+static struct egress_flow *egress_fattest(struct egress_queue *q)
+{
+	struct egress_flow *fat = &q->flow[0];
+
+	for (int x=1;x<EGRESS_FLOWS;x++)
+	{
+		if (q->flow[x].bytes > fat->bytes) fat = &q->flow[x];
+	}
+	return fat;
+}
+
+/*
+*	Current time in queue ticks
+*
+*/
+static uint32_t egress_now(void)
+{
+	return (uint32_t)(sys_get_ns() >> EGRESS_TICK_SHIFT);
+}
+
+/*
+*	CoDel control law, the next drop comes interval / sqrt(count) after the last
+*
+*	@param t - time of the last drop.
+*	@param count - drops so far.
+*
+*/
+static uint32_t egress_control_law(uint32_t t, uint16_t count)
+{
+	uint32_t x = (uint32_t)count << 16;
+	uint32_t root = 0;
+	uint32_t bit = 1UL << 30;
+
+	/* Integer square root, root is sqrt(count) * 256 */
+	while (bit > x) bit >>= 2;
+	while (bit != 0)
+	{
+		if (x >= root + bit)
+		{
+			x -= root + bit;
+			root = (root >> 1) + bit;
+		} else {
+			root >>= 1;
+		}
+		bit >>= 2;
+	}
+	return t + (EGRESS_CODEL_INTERVAL * 256) / root;
+}
+
+/*
+*	Set Congestion Experienced on an ECN capable IPv4 frame
+*
+*	@param *b - block holding the frame.
+*
+*	Returns true if the frame was marked, false if it has to be dropped.
+*
+*/
+static bool egress_mark(struct pktbuf *b)
+{
+	uint8_t *p_frame = pktbuf_frame(b);
+	uint8_t *ip = p_frame + 14;
+	uint16_t old_word;
+	uint32_t sum;
+
+	if (b->size >= 18 && p_frame[12] == 0x81 && p_frame[13] == 0x00) ip += 4;
+	if (ip + 20 > p_frame + b->size || ip[-2] != 0x08 || ip[-1] != 0x00) return false;
+	if ((ip[1] & 0x03) == 0) return false;	// Not ECN capable
+	if ((ip[1] & 0x03) == 0x03) return true;	// Already marked
+
+	/* Update the header checksum for the changed word, RFC 1624 */
+	old_word = (ip[0] << 8) | ip[1];
+	ip[1] |= 0x03;
+	sum = (uint16_t)~((ip[10] << 8) | ip[11]) + (uint16_t)~old_word + ((ip[0] << 8) | ip[1]);
+	sum = (sum & 0xFFFF) + (sum >> 16);
+	sum = (sum & 0xFFFF) + (sum >> 16);
+	sum = ~sum;
+	ip[10] = sum >> 8;
+	ip[11] = sum & 0xFF;
+	return true;
+}
+
+/*
+*	Take the oldest frame from a flow and check it against the CoDel target
+*
+*	@param *ep - the port.
+*	@param *q - the queue the flow is in.
+*	@param *f - the flow.
+*	@param now - current time in queue ticks.
+*	@param *drop - set if the queued time has been above target for an interval.
+*
+*/
+HOT_PATH
+static struct pktbuf *egress_codel_pop(struct egress_port *ep, struct egress_queue *q, struct egress_flow *f, uint32_t now, bool *drop)
+{
+	struct egress_codel *c = &f->codel;
+	struct pktbuf *b = egress_pop(ep, q, f);
+
+	*drop = false;
+	if (b == NULL || (int32_t)(now - b->stamp) < (int32_t)EGRESS_CODEL_TARGET || f->bytes <= EGRESS_QUANTUM)
+	{
+		c->first_above = 0;	// Below target, or less than a frame left to drain
+	} else if (c->first_above == 0) {
+		c->first_above = (now + EGRESS_CODEL_INTERVAL) | 1;
+	} else if ((int32_t)(now - c->first_above) >= 0) {
+		*drop = true;
+	}
+	return b;
+}
+
+/*
+*	Take the next frame to send from a flow, dropping or marking frames as CoDel decides
+*
+*	@param *ep - the port.
+*	@param *q - the queue the flow is in.
+*	@param *f - the flow.
+*	@param now - current time in queue ticks.
+*
+*	Returns the frame, or NULL if the flow is empty.
+*
+*/
+HOT_PATH
+static struct pktbuf *egress_codel(struct egress_port *ep, struct egress_queue *q, struct egress_flow *f, uint32_t now)
+{
+	struct egress_codel *c = &f->codel;
+	struct pktbuf *b;
+	uint16_t delta;
+	bool drop;
+
+	if (egress_aqm == EGRESS_AQM_OFF) return egress_pop(ep, q, f);
+
+	b = egress_codel_pop(ep, q, f, now, &drop);
+	if (c->dropping)
+	{
+		if (!drop) c->dropping = false;
+		while (c->dropping && (int32_t)(now - c->drop_next) >= 0)
+		{
+			if (c->count != 0xFFFF) c->count++;
+			if (egress_mark(b))
+			{
+				q->marks++;
+				c->drop_next = egress_control_law(c->drop_next, c->count);
+				break;
+			}
+			q->aqm_drops++;
+			pktbuf_free(b);
+			b = egress_codel_pop(ep, q, f, now, &drop);
+			if (!drop)
+			{
+				c->dropping = false;
+			} else {
+				c->drop_next = egress_control_law(c->drop_next, c->count);
+			}
+		}
+	} else if (drop) {
+		if (egress_mark(b))
+		{
+			q->marks++;
+		} else {
+			q->aqm_drops++;
+			pktbuf_free(b);
+			b = egress_codel_pop(ep, q, f, now, &drop);
+		}
+		c->dropping = true;
+
+		/* Start near the old drop rate if dropping stopped only recently */
+		delta = c->count - c->last_count;
+		if (delta > 1 && (int32_t)(now - c->drop_next) < (int32_t)(16 * EGRESS_CODEL_INTERVAL))
+		{
+			c->count = delta;
+		} else {
+			c->count = 1;
+		}
+		c->last_count = c->count;
+		c->drop_next = egress_control_law(now, c->count);
+	}
+	return b;
+}
+
+/*
+*	Take the next frame to send from a queue, its flows take turns by bytes
+*
+*	Without FQ-CoDel every frame is in the first flow.
+*
+*	@param *ep - the port.
+*	@param *q - the queue.
+*	@param now - current time in queue ticks.
+*
+*	Returns the frame, or NULL if the queue is empty or CoDel dropped what was left.
+*
+*/
+HOT_PATH
+static struct pktbuf *egress_dequeue(struct egress_port *ep, struct egress_queue *q, uint32_t now)
+{
+	struct egress_flow *f;
+	struct pktbuf *b;
+	uint8_t list;
+	uint8_t flow;
+
+	for (;;)
+	{
+		if (q->list_head[EGRESS_LIST_NEW] != EGRESS_FLOWS)
+		{
+			list = EGRESS_LIST_NEW;
+		} else if (q->list_head[EGRESS_LIST_OLD] != EGRESS_FLOWS) {
+			list = EGRESS_LIST_OLD;
+		} else {
+			return NULL;
+		}
+		flow = q->list_head[list];
+		f = &q->flow[flow];
+		if (f->deficit <= 0)
+		{
+			f->deficit += EGRESS_QUANTUM;
+			egress_list_remove(q, list);
+			egress_list_add(q, EGRESS_LIST_OLD, flow);
+			continue;
+		}
+		b = egress_codel(ep, q, f, now);
+		if (b == NULL)
+		{
+			/* A new flow that empties goes to the back of the old ones, so it can't jump the queue again straight away */
+			egress_list_remove(q, list);
+			if (list == EGRESS_LIST_NEW && q->list_head[EGRESS_LIST_OLD] != EGRESS_FLOWS) egress_list_add(q, EGRESS_LIST_OLD, flow);
+			continue;
+		}
+		f->deficit -= b->size;
+		return b;
+	}
+}
+
+/*
+*	Frames of a class queued on all the ports, scaled by its weight
+*
+*	@param class - the class.
+*
+*/
+static uint16_t egress_load(uint8_t class)
+{
+	return (egress_class_depth[class] * 256) / egress_weights[class];
+}
+
+/*
+*	Drop the oldest frame of the class that should give up its block
+*
+*	With strict priority that is the lowest class queued below the one
+*	that needs a block. With WRR and DRR it is the class furthest over
+*	its weighted share, if that is more than the class that needs a
+*	block. Network control frames are never dropped for another class.
+*
+*	@param class - the class that needs a block.
+*
+*	Returns true if a block was returned to the pool.
+*
+*/
+static bool egress_evict(uint8_t class)
+{
+	struct egress_port *ep = NULL;
+	struct egress_queue *q;
+	int victim = -1;
+
+	for (int c=EGRESS_CLASSES-1;c>0;c--)
+	{
+		if (c == class || egress_class_depth[c] == 0) continue;
+		if (egress_sched == EGRESS_STRICT)
+		{
+			if (c > class) victim = c;
+			break;
+		}
+		if (victim < 0 || egress_load(c) > egress_load(victim)) victim = c;
+	}
+	if (victim < 0) return false;
+	if (egress_sched != EGRESS_STRICT && class != 0 && egress_load(victim) <= egress_load(class)) return false;
+
+	/* Take it from the port with the most of that class waiting */
+	for (int x=0;x<EGRESS_PORTS;x++)
+	{
+		if (ep == NULL || egress_ports[x].queue[victim].depth > ep->queue[victim].depth) ep = &egress_ports[x];
+	}
+	q = &ep->queue[victim];
+	q->evicted++;
+	pktbuf_free(egress_pop(ep, q, egress_fattest(q)));
+	return true;
+}
+
+/*
+*	Take a block to build a frame of a class in
+*
+*	@param class - class of the frame.
+*
+*	Returns the block, or NULL if the pool is empty and nothing of a lower class is queued.
+*
+*/
+HOT_PATH
+struct pktbuf *egress_alloc(uint8_t class)
+{
+	struct pktbuf *b = pktbuf_alloc(PKTBUF_TX);
+
+	if (b == NULL && egress_evict(class)) b = pktbuf_alloc(PKTBUF_TX);
+	if (b == NULL) egress_stats.no_block++;
+	return b;
+}
+
+/*
+*	Queue index of a tail tag, frames for several ports share the last one
+*
+*	@param port - tail tag port bitmap.
+*
+*/
+static uint8_t egress_port_index(uint8_t port)
+{
+	for (int x=0;x<TOTAL_PORTS;x++)
+	{
+		if (port == (1 << x)) return x;
+	}
+	return EGRESS_PORTS - 1;
+}
+
+/*
+*	Room on the transmit ring for another queued frame
+*
+*/
+static bool egress_ring_ready(void)
+{
+	return gmac_dev_get_tx_load(&gs_gmac_dev) < EGRESS_RING_FRAMES;
+}
+
+/*
+*	Choose the class a port sends from next
+*
+*	@param *ep - the port, it must have a frame queued.
+*
+*/
+static uint8_t egress_pick(struct egress_port *ep)
+{
+	struct egress_queue *q;
+
+	/* Network control goes first whatever the scheduler */
+	if (egress_sched == EGRESS_STRICT || ep->queue[0].depth != 0)
+	{
+		for (int c=0;c<EGRESS_CLASSES;c++)
+		{
+			if (ep->queue[c].depth != 0) return c;
+		}
+	}
+
+	/* The other classes take turns, two rounds at most as the first may only top up the queue being served */
+	for (int n=0;n<EGRESS_CLASSES*2;n++)
+	{
+		q = &ep->queue[ep->current];
+		if (egress_sched == EGRESS_WRR)
+		{
+			if (q->depth != 0 && q->credit != 0)
+			{
+				q->credit--;
+				return ep->current;
+			}
+			q->credit = egress_weights[ep->current];
+		} else {
+			if (q->depth == 0)
+			{
+				q->deficit = 0;
+			} else {
+				if (!ep->topped_up)
+				{
+					q->deficit += egress_weights[ep->current] * EGRESS_QUANTUM;
+					ep->topped_up = true;
+				}
+				if (q->deficit > 0) return ep->current;	// Charged for the frame once it is taken, flows may go first
+			}
+			ep->topped_up = false;
+		}
+		ep->current = (ep->current % (EGRESS_CLASSES - 1)) + 1;
+	}
+	return ep->current;	// Not reached with a frame queued
+}
+
+/*
+*	Send queued frames while there is room on the ring
+*
+*/
+HOT_PATH
+static void egress_drain(void)
+{
+	struct egress_port *ep;
+	struct egress_queue *q;
+	struct pktbuf *b;
+	uint32_t now = (egress_aqm != EGRESS_AQM_OFF) ? egress_now() : 0;
+
+	while (egress_backlog != 0 && egress_ring_ready())
+	{
+		/* Take turns between the ports with frames queued */
+		ep = &egress_ports[egress_next_port];
+		egress_next_port = (egress_next_port + 1) % EGRESS_PORTS;
+		if (ep->backlog == 0) continue;
+
+		q = &ep->queue[egress_pick(ep)];
+		b = egress_dequeue(ep, q, now);
+		if (b == NULL) continue;	// CoDel dropped the rest of the queue
+		if (egress_sched == EGRESS_DRR && q != &ep->queue[0]) q->deficit -= b->size;
+		egress_stats.sent++;
+		gmac_send_pktbuf(b, b->size, b->port);
+	}
+	return;
+}
+
+/*
+*	Send a frame, or queue it behind the frames already waiting
+*
+*	@param *b - block holding the frame, the queue takes its reference.
+*	@param size - size of the frame.
+*	@param port - tail tag port bitmap.
+*	@param class - class of the frame.
+*
+*/
+HOT_PATH
+void egress_enqueue(struct pktbuf *b, uint16_t size, uint8_t port, uint8_t class)
+{
+	struct egress_port *ep;
+	struct egress_queue *q;
+	struct egress_flow *f;
+	struct egress_flow *fat;
+	uint8_t flow = 0;
+
+	if (egress_backlog == 0 && egress_ring_ready())
+	{
+		egress_stats.direct++;
+		gmac_send_pktbuf(b, size, port);
+		return;
+	}
+
+	ep = &egress_ports[egress_port_index(port)];
+	q = &ep->queue[class];
+	if (egress_aqm == EGRESS_AQM_FQ_CODEL) flow = egress_flow_hash(pktbuf_frame(b), size);
+	f = &q->flow[flow];
+	if (q->depth >= EGRESS_QUEUE_DEPTH)
+	{
+		/* FQ-CoDel makes room by dropping from the flow with the most queued */
+		q->drops++;
+		fat = egress_fattest(q);
+		if (egress_aqm != EGRESS_AQM_FQ_CODEL || fat == f)
+		{
+			pktbuf_free(b);
+			return;
+		}
+		pktbuf_free(egress_pop(ep, q, fat));
+	}
+
+	b->next = NULL;
+	b->size = size;
+	b->port = port;
+	if (egress_aqm != EGRESS_AQM_OFF) b->stamp = egress_now();
+	if (f->tail == NULL)
+	{
+		f->head = b;
+	} else {
+		f->tail->next = b;
+	}
+	f->tail = b;
+	f->bytes += size;
+	if (f->list == EGRESS_LISTS)
+	{
+		f->deficit = EGRESS_QUANTUM;
+		egress_list_add(q, EGRESS_LIST_NEW, flow);
+	}
+	q->depth++;
+	if (q->depth > q->peak) q->peak = q->depth;
+	q->frames++;
+	ep->backlog++;
+	egress_class_depth[class]++;
+	egress_backlog++;
+
+	egress_drain();
+	return;
+}
+
+/*
+*	Send queued frames as the ring empties, called from the main loop
+*
+*/
+void egress_task(void)
+{
+	if (egress_backlog != 0) egress_drain();
+	return;
+}
@@ -0,0 +1,148 @@
+/**
+ * @file
+ * egress.h
+ *
+ * This file contains the declarations for the egress queue functions
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX P4 firmware.
+ * Copyright (c) 2019 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Paul Zanna <paul@northboundnetworks.com>
+ *
+ */
+
+#ifndef EGRESS_H_
+#define EGRESS_H_
+
+#include <asf.h>
+#include "config_zodiac.h"
+
+/*
+*	Frames sent by the dataplane wait in a queue per egress port and
+*	class in front of the GMAC transmit ring. Only EGRESS_RING_FRAMES of
+*	them are put on the ring at a time, so the rest can still be
+*	scheduled, and a frame that finds the pool empty pushes out a queued
+*	frame of a lower class. Class 0 is network control, 3 is bulk.
+*	Network control is always sent first, WRR and DRR share the link
+*	between the other classes by weight.
+*
+*	With AQM on, each queue runs CoDel at dequeue, dropping or ECN marking
+*	frames once the time they spent queued has stayed above target for an
+*	interval. FQ-CoDel also splits each queue into a few flow queues by a
+*	hash of the addresses and ports, served in DRR turns, so one busy
+*	flow does not hold back the others in its class.
+*/
+#define EGRESS_PORTS		(TOTAL_PORTS + 1)	// The last queues hold frames for several ports
+#define EGRESS_QUEUE_DEPTH	6		// Frames per queue
+#define EGRESS_RING_FRAMES	4		// Queued frames on the ring at once, the rest of it is left for lwIP
+#define EGRESS_QUANTUM		1518		// DRR bytes per weight, at least one frame
+#define EGRESS_CLASS_DEFAULT	2		// Best effort
+#define EGRESS_FLOWS		4		// Flow queues per queue with FQ-CoDel
+#define EGRESS_TICK_SHIFT	10		// Queue times are in units of 1024 ns
+#define EGRESS_TICKS(us)	((uint32_t)(us) * 1000 >> EGRESS_TICK_SHIFT)
+#define EGRESS_CODEL_TARGET	EGRESS_TICKS(1000)	// Queued time CoDel aims for, a few frame times at 100 Mb/s
+#define EGRESS_CODEL_INTERVAL	EGRESS_TICKS(20000)	// Time above target before CoDel starts dropping
+
+/* How the classes of a port share it */
+enum egress_sched {
+	EGRESS_STRICT,		// Lowest class first
+	EGRESS_WRR,		// Up to weight frames from each class in turn
+	EGRESS_DRR,		// Weight * EGRESS_QUANTUM bytes from each class in turn
+	EGRESS_SCHEDS
+};
+
+/* Active queue management */
+enum egress_aqm {
+	EGRESS_AQM_OFF,		// Drop when the queue is full
+	EGRESS_AQM_CODEL,	// CoDel on each queue
+	EGRESS_AQM_FQ_CODEL,	// CoDel on each flow queue
+	EGRESS_AQMS
+};
+
+struct pktbuf;
+
+/* CoDel state, times are in EGRESS_TICK_SHIFT units */
+struct egress_codel {
+	uint32_t first_above;	// When dropping may start if the queued time stays above target, 0 if it is below
+	uint32_t drop_next;	// When the next frame is dropped while dropping
+	uint16_t count;		// Frames dropped since dropping started
+	uint16_t last_count;	// Count when dropping last stopped
+	bool dropping;
+};
+
+struct egress_flow {
+	struct pktbuf *head;
+	struct pktbuf *tail;
+	uint16_t bytes;		// Bytes queued
+	int16_t deficit;	// FQ-CoDel bytes left this turn
+	uint8_t next;		// Next flow on the same list
+	uint8_t list;		// List the flow is on, EGRESS_LISTS if none
+	struct egress_codel codel;
+};
+
+/* FQ-CoDel serves new flows before the ones that have already had a turn */
+enum egress_list {
+	EGRESS_LIST_NEW,
+	EGRESS_LIST_OLD,
+	EGRESS_LISTS
+};
+
+struct egress_queue {
+	struct egress_flow flow[EGRESS_FLOWS];	// Only the first is used without FQ-CoDel
+	uint8_t list_head[EGRESS_LISTS];	// EGRESS_FLOWS if the list is empty
+	uint8_t list_tail[EGRESS_LISTS];
+	uint8_t depth;
+	uint8_t peak;		// Deepest the queue has been
+	uint8_t credit;		// WRR frames left this turn
+	int32_t deficit;	// DRR bytes left this turn
+	uint32_t frames;	// Frames queued
+	uint32_t drops;		// Frames dropped with the queue full
+	uint32_t evicted;	// Frames pushed out for a higher class
+	uint32_t aqm_drops;	// Frames dropped by CoDel
+	uint32_t marks;		// Frames ECN marked by CoDel instead
+};
+
+struct egress_port {
+	struct egress_queue queue[EGRESS_CLASSES];
+	uint8_t backlog;	// Frames in all the queues
+	uint8_t current;	// Class being served by WRR or DRR, 1 - EGRESS_CLASSES-1
+	bool topped_up;		// DRR quantum added for this turn
+};
+
+struct egress_stats {
+	uint32_t direct;	// Frames sent with nothing queued
+	uint32_t sent;		// Frames sent from the queues
+	uint32_t no_block;	// Frames dropped with no block to evict
+};
+
+extern struct egress_port egress_ports[EGRESS_PORTS];
+extern struct egress_stats egress_stats;
+extern const char *const egress_sched_name[EGRESS_SCHEDS];
+extern const char *const egress_aqm_name[EGRESS_AQMS];
+
+void egress_init(void);
+void egress_configure(uint8_t sched, const uint8_t *weights);
+uint8_t egress_weight(uint8_t class);
+void egress_set_aqm(uint8_t aqm);
+uint8_t egress_classify(const uint8_t *p_frame, uint16_t size);
+struct pktbuf *egress_alloc(uint8_t class);
+void egress_enqueue(struct pktbuf *b, uint16_t size, uint8_t port, uint8_t class);
+void egress_task(void);
+
+#endif /* EGRESS_H_ */
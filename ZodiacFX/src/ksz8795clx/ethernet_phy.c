@@ -45,17 +45,29 @@
  */
 
 #include <asf.h>
+#include <string.h>
 #include "ethernet_phy.h"
 #include "gmac.h"
 #include "conf_eth.h"
 #include "switch.h"
 #include "command.h"
+#include "boot.h"
+#include "pktbuf.h"
 
 /** The GMAC driver instance */
 extern gmac_device_t gs_gmac_dev;
 extern struct zodiac_config Zodiac_Config;
 extern uint8_t NativePortMatrix;
 
+#define MGMT_TAIL_TAG	128	// Tail tag on frames sent by lwIP
+#define MIN_FRAME_SIZE	60	// Frames are padded before the tail tag, the GMAC would pad after it
+
+/** Fragments appended to lwIP frames, the GMAC reads them by DMA so they live in RAM */
+static uint8_t tx_tail_tag = MGMT_TAIL_TAG;
+static uint8_t tx_padding[MIN_FRAME_SIZE];
+
+static void gmac_low_level_free(void *p_context);
+
 /// @cond 0
 /**INDENT-OFF**/
 #ifdef __cplusplus
@@ -219,7 +231,7 @@ uint8_t ethernet_phy_reset(Gmac *p_gmac, uint8_t uc_phy_addr)
 	UNUSED(uc_phy_addr);
 	
 	switch_write(2,76);
-	for(int x = 0;x<100000;x++);
+	boot_delay_us(1000);
 	switch_write(2,12);
 	
 	return 0;
@@ -266,6 +278,7 @@ err_t ethernetif_init(struct netif *netif)
 	 * is available...) */
 	netif->output = etharp_output;
 	netif->linkoutput = gmac_low_level_output;
+	gmac_dev_set_tx_free_callback(&gs_gmac_dev, gmac_low_level_free);
 	/* Initialize the hardware */
 	//gmac_low_level_init(netif);
 	
@@ -287,9 +300,92 @@ err_t ethernetif_init(struct netif *netif)
 	return ERR_OK;
 }
 
+/**
+ * \brief Release a pbuf chain once the GMAC has sent it.
+ *
+ * \param p_context the pbuf passed to gmac_dev_write_sg().
+ */
+static void gmac_low_level_free(void *p_context)
+{
+	pbuf_free((struct pbuf *)p_context);
+}
+
+/**
+ * \brief Send a frame from lwIP.
+ *
+ * Each pbuf in the chain becomes one TX descriptor pointing at its
+ * payload, followed by padding if needed and the tail tag, so nothing is
+ * copied. The chain is referenced until the GMAC has sent it. Chains
+ * with more pbufs than free descriptors are copied into one pool block,
+ * and so are TCP segments, as lwIP rewrites an unacked segment in place
+ * when it retransmits it, even if the GMAC is still sending the last copy.
+ *
+ * \param netif the lwIP network interface structure for this ethernetif.
+ * \param p the pbuf chain to send.
+ *
+ * \return ERR_OK, or ERR_MEM if the frame could not be queued.
+ */
 static err_t gmac_low_level_output(struct netif *netif, struct pbuf *p)
 {
-	gmac_write(p->payload, p->len, 128);
+	gmac_tx_frag_t frags[GMAC_TX_BUFFERS];
+	struct pbuf *q;
+	uint32_t count = 0;
+	uint16_t size = p->tot_len;
+	struct pktbuf *b;
+	bool tcp;
+
+	LWIP_UNUSED_ARG(netif);
+
+	if (size >= GMAC_FRAME_LENTGH_MAX) return ERR_MEM;
+
+	/* Leave room for the padding and tail tag fragments */
+	tcp = (size >= 24 && pbuf_get_at(p, 12) == 0x08 && pbuf_get_at(p, 13) == 0x00 && pbuf_get_at(p, 23) == IP_PROTO_TCP);
+	for (q = p; !tcp && q != NULL && count < GMAC_TX_BUFFERS - 3; q = q->next)
+	{
+		if (q->len == 0) continue;
+		frags[count].p_buffer = q->payload;
+		frags[count].ul_size = q->len;
+		count++;
+	}
+
+	if (!tcp && q == NULL)
+	{
+		if (size < MIN_FRAME_SIZE)
+		{
+			frags[count].p_buffer = tx_padding;
+			frags[count].ul_size = MIN_FRAME_SIZE - size;
+			count++;
+		}
+		frags[count].p_buffer = &tx_tail_tag;
+		frags[count].ul_size = 1;
+		count++;
+
+		pbuf_ref(p);
+		if (gmac_dev_write_sg(&gs_gmac_dev, frags, count, p) == GMAC_OK)
+		{
+			mgmt_stats.tx_frames++;
+			return ERR_OK;
+		}
+		pbuf_free(p);
+		mgmt_stats.tx_busy++;
+		return ERR_MEM;
+	}
+
+	/* Too many fragments or a TCP segment, gather the chain into a pool block */
+	b = pktbuf_alloc(PKTBUF_TX);
+	if (b == NULL)
+	{
+		mgmt_stats.tx_busy++;
+		return ERR_MEM;
+	}
+	pbuf_copy_partial(p, pktbuf_frame(b), size, 0);
+	if (!gmac_send_pktbuf(b, size, MGMT_TAIL_TAG))
+	{
+		mgmt_stats.tx_busy++;
+		return ERR_MEM;
+	}
+	mgmt_stats.tx_copied++;
+	return ERR_OK;
 }
 
 
@@ -39,10 +39,21 @@
 #include "lwip/tcp.h"
 #include "lwip/err.h"
 
+#include "boot.h"
+#include "cache.h"
 #include "command.h"
+#include "controller.h"
 #include "eeprom.h"
+#include "egress.h"
+#include "memory.h"
+#include "config_log.h"
+#include "console.h"
+#include "sched.h"
 #include "switch.h"
+#include "wheel.h"
+#include "update.h"
 #include "P4/zodiacfx-p4.h"
+#include "P4/zodiacfx-persist.h"
 #include "ksz8795clx/ethernet_phy.h"
 
 // Global variables
@@ -53,6 +64,18 @@ int portmap[4];
 int32_t ul_temp;
 uint32_t uid_buf[4];
 
+/* Steps of the boot that run after the dataplane has started */
+enum boot_stage {
+	BOOT_LWIP,
+	BOOT_CONTROLLER,
+	BOOT_TEMP,
+	BOOT_DONE
+};
+
+static uint8_t boot_stage = BOOT_LWIP;
+static char cCommand[64];
+static char cCommand_last[64];
+
 /** Reference voltage for AFEC,in mv. */
 #define VOLT_REF        (3300)
 /** The maximal digital value */
@@ -117,60 +140,154 @@ void HardFault_Handler(void)
 	while(1);
 }
 
+/*
+*	Bring up the parts of the switch that are not needed to forward
+*	frames, one step per main loop pass so the dataplane keeps running
+*
+*/
+static void boot_task(void)
+{
+	struct ip_addr x_ip_addr, x_net_mask, x_gateway;
+
+	switch (boot_stage)
+	{
+		case BOOT_LWIP:
+		IP4_ADDR(&x_ip_addr, Zodiac_Config.IP_address[0], Zodiac_Config.IP_address[1],Zodiac_Config.IP_address[2], Zodiac_Config.IP_address[3]);
+		IP4_ADDR(&x_net_mask, Zodiac_Config.netmask[0], Zodiac_Config.netmask[1],Zodiac_Config.netmask[2], Zodiac_Config.netmask[3]);
+		IP4_ADDR(&x_gateway, Zodiac_Config.gateway_address[0], Zodiac_Config.gateway_address[1],Zodiac_Config.gateway_address[2], Zodiac_Config.gateway_address[3]);
+
+		/* Initialize lwIP. */
+		lwip_init();
+
+		/* Add data to netif */
+		netif_add(&gs_net_if, &x_ip_addr, &x_net_mask, &x_gateway, NULL, ethernetif_init, ethernet_input);
+
+		/* Make it the default interface */
+		netif_set_default(&gs_net_if);
+
+		netif_set_up(&gs_net_if);
+		boot_mark("lwIP");
+		break;
+
+		case BOOT_CONTROLLER:
+		/* Listen for the controller */
+		controller_init();
+		update_init();
+		flow_init();
+		boot_mark("Controller");
+		break;
+
+		case BOOT_TEMP:
+		temp_init();
+		boot_mark("Boot complete");
+		break;
+	}
+	boot_stage++;
+	return;
+}
+
+/*
+*	Receive and forward the next frame
+*
+*/
+static void run_switch(void)
+{
+	task_switch(&gs_net_if);
+	return;
+}
+
+/*
+*	Handle key presses on the command line
+*
+*/
+static void run_command(void)
+{
+	task_command(cCommand, cCommand_last);
+	return;
+}
+
+/*
+*	Add the tasks that run once the boot has finished
+*
+*	Budgets are the time one run should take, runs that take longer
+*	are reported by 'show tasks'.
+*
+*/
+static void add_tasks(void)
+{
+	sched_add("Controller", task_controller, SCHED_CONTROL, 500);
+	sched_add("Command line", run_command, SCHED_CONTROL, 2000);
+	sched_add("lwIP timers", sys_check_timeouts, SCHED_CONTROL, 500);
+	sched_add("Flow export", flow_task, SCHED_CONTROL, 500);
+	sched_add("Timing wheel", wheel_task, SCHED_CONTROL, 200);
+	sched_add("Table save", persist_task, SCHED_BACKGROUND, 5000);
+	sched_add("Config save", cfglog_task, SCHED_BACKGROUND, 5000);
+	sched_add("Firmware update", update_task, SCHED_BACKGROUND, 5000);
+	return;
+}
+
 /*
 *	Main program loop
 *
 */
 int main (void)
 {
-	char cCommand[64];
-	char cCommand_last[64];
+	memory_paint_stack();
 	memset(&cCommand, 0, sizeof(cCommand));
 	memset(&cCommand_last, 0, sizeof(cCommand_last));
 	cCommand[0] = '\0';
 	charcount = 0;
-	struct ip_addr x_ip_addr, x_net_mask, x_gateway;
 
 	sysclk_init();
 	board_init();
+	update_boot();	// May swap back to the previous image and restart
+	boot_init();
 	get_serial(&uid_buf);
+	cache_init();	// After the last EFC command that remaps the flash
 	
 	irq_initialize_vectors(); // Initialize interrupt vector table support.
 
 	cpu_irq_enable(); // Enable interrupts
 
+	/* Only starts the USB device, the host enumerates it in the background */
 	stdio_usb_init();
+	console_init();
 	spi_init();
 	eeprom_init();
-	temp_init();
 
+	cfglog_init();
 	loadConfig(); // Load Config
-
-	IP4_ADDR(&x_ip_addr, Zodiac_Config.IP_address[0], Zodiac_Config.IP_address[1],Zodiac_Config.IP_address[2], Zodiac_Config.IP_address[3]);
-	IP4_ADDR(&x_net_mask, Zodiac_Config.netmask[0], Zodiac_Config.netmask[1],Zodiac_Config.netmask[2], Zodiac_Config.netmask[3]);
-	IP4_ADDR(&x_gateway, Zodiac_Config.gateway_address[0], Zodiac_Config.gateway_address[1],Zodiac_Config.gateway_address[2], Zodiac_Config.gateway_address[3]);
+	boot_mark("Config");
 
 	/* Initialize KSZ8795. */
 	switch_init();
 
-	/* Initialize lwIP. */
-	lwip_init();
-
-	/* Add data to netif */
-	netif_add(&gs_net_if, &x_ip_addr, &x_net_mask, &x_gateway, NULL, ethernetif_init, ethernet_input);
+	/* Initialize timer. */
+	sys_init_timing();
+	wheel_init();
 
-	/* Make it the default interface */
-	netif_set_default(&gs_net_if);
+	/* Reload the tables saved before the last restart */
+	pipeline_init();
+	persist_restore();
+	switch_vlan_restore();
+	boot_mark("Forwarding");
 
-	netif_set_up(&gs_net_if);
+	sched_add("Switch", run_switch, SCHED_DATAPLANE, 100);
+	sched_add("Egress queues", egress_task, SCHED_DATAPLANE, 50);
+	sched_add("Quiescent state", p4_quiescent, SCHED_DATAPLANE, 20);
+	sched_add("Link status", update_port_status, SCHED_DATAPLANE, 100);
+	sched_add("Console", console_task, SCHED_CONTROL, 100);
 
-	/* Initialize timer. */
-	sys_init_timing();
+	/* Forward while the rest of the switch is started */
+	while (boot_stage != BOOT_DONE)
+	{
+		sched_run();
+		boot_task();
+	}
+	add_tasks();
 
 	while(1)
 	{
-		task_switch(&gs_net_if);
-		task_command(cCommand, cCommand_last);
-		sys_check_timeouts();
+		sched_run();
 	}
 }
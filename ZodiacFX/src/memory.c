@@ -0,0 +1,96 @@
+/**
+ * @file
+ * memory.c
+ *
+ * This file contains the SRAM accounting functions
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX P4 firmware.
+ * Copyright (c) 2019 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Paul Zanna <paul@northboundnetworks.com>
+ *
+ */
+
+#include <asf.h>
+#include <sys/types.h>
+#include "memory.h"
+#include "cache.h"
+
+// Global variables, set in flash.ld
+extern uint32_t _srelocate;
+extern uint32_t _erelocate;
+extern uint32_t _sbss;
+extern uint32_t _ebss;
+extern uint32_t _sstack;
+extern uint32_t _estack;
+extern uint32_t _end;
+extern uint32_t __ram_end__;
+
+extern caddr_t _sbrk(int incr);
+
+/*
+*	Fill the stack below the current stack pointer with MEMORY_STACK_PAINT
+*
+*	Called first thing in main(), nothing below it has been used yet.
+*
+*/
+__no_inline
+void memory_paint_stack(void)
+{
+	uint32_t *p = &_sstack;
+	uint32_t *top = (uint32_t *)(__get_MSP() - MEMORY_PAINT_MARGIN);
+
+	while (p < top) *p++ = MEMORY_STACK_PAINT;
+	return;
+}
+
+/*
+*	Deepest the stack has been since memory_paint_stack(), in bytes
+*
+*	Interrupt handlers run on the same stack, so this includes them.
+*
+*/
+uint32_t memory_stack_peak(void)
+{
+	uint32_t *p = &_sstack;
+
+	while (p < &_estack && *p == MEMORY_STACK_PAINT) p++;
+	return (uint32_t)&_estack - (uint32_t)p;
+}
+
+/*
+*	Break the SRAM down by use
+*
+*	@param *usage - filled in with the sizes.
+*
+*/
+void memory_usage(struct memory_usage *usage)
+{
+	caddr_t heap_end = _sbrk(0);
+	uint32_t heap_top = (uint32_t)heap_end;
+
+	usage->ramfunc = ramfunc_size();
+	usage->data = (uint32_t)&_erelocate - (uint32_t)&_srelocate - usage->ramfunc;
+	usage->bss = (uint32_t)&_ebss - (uint32_t)&_sbss;
+	usage->stack = (uint32_t)&_estack - (uint32_t)&_sstack;
+	usage->stack_peak = memory_stack_peak();
+	usage->heap = heap_top - (uint32_t)&_end;
+	usage->free = (uint32_t)&__ram_end__ + 4 - heap_top;
+	return;
+}
@@ -0,0 +1,53 @@
+/**
+ * @file
+ * memory.h
+ *
+ * This file contains the declarations for the SRAM accounting functions
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX P4 firmware.
+ * Copyright (c) 2019 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Paul Zanna <paul@northboundnetworks.com>
+ *
+ */
+
+#ifndef MEMORY_H_
+#define MEMORY_H_
+
+#include <asf.h>
+
+#define MEMORY_STACK_PAINT	0xDEADBEEF	// Fill for the unused stack, found again by memory_stack_peak()
+#define MEMORY_PAINT_MARGIN	64		// Bytes below the stack pointer left unpainted
+
+/* Where the 128 KB of SRAM has gone, in bytes */
+struct memory_usage {
+	uint32_t ramfunc;	// Code copied from flash at startup
+	uint32_t data;		// Initialised variables
+	uint32_t bss;		// Zeroed variables
+	uint32_t stack;		// Reserved for the stack
+	uint32_t stack_peak;	// Stack used at the deepest point since boot
+	uint32_t heap;		// Handed out by _sbrk(), mostly to the C library
+	uint32_t free;		// Not used by anything
+};
+
+void memory_paint_stack(void);
+uint32_t memory_stack_peak(void);
+void memory_usage(struct memory_usage *usage);
+
+#endif /* MEMORY_H_ */
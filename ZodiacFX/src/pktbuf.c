@@ -0,0 +1,236 @@
+/**
+ * @file
+ * pktbuf.c
+ *
+ * This file contains the packet buffer pool functions
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX P4 firmware.
+ * Copyright (c) 2019 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Paul Zanna <paul@northboundnetworks.com>
+ *
+ */
+
+#include <asf.h>
+#include <string.h>
+#include "pktbuf.h"
+#include "switch.h"
+#include "config_zodiac.h"
+
+#if !LWIP_SUPPORT_CUSTOM_PBUF
+#error "Pool blocks are passed to lwIP and the GMAC in custom pbufs"
+#endif
+
+// Global variables
+extern gmac_device_t gs_gmac_dev;
+struct pktbuf_stats pktbuf_stats;
+
+/* Most blocks each owner may hold, together they add up to more than the pool so idle blocks can be lent */
+const uint8_t pktbuf_quota[PKTBUF_OWNERS] = {
+	[PKTBUF_RX] = 2,
+	[PKTBUF_LWIP] = 8,
+	[PKTBUF_TX] = 12
+};
+
+const char *const pktbuf_owner_name[PKTBUF_OWNERS] = {"Free", "Receive", "lwIP", "Transmit"};
+
+// Local variables
+/* Received frames are gathered by memcpy and sent by the GMAC DMA, blocks are kept 8-byte aligned for both */
+COMPILER_ALIGNED(8)
+static uint8_t pktbuf_mem[PKTBUF_COUNT][PKTBUF_SIZE];
+static struct pktbuf pktbuf_pool[PKTBUF_COUNT];
+static uint8_t pktbuf_free_list[PKTBUF_COUNT];	// Indexes of the free blocks, used as a stack
+
+// Internal Functions
+static void pktbuf_pbuf_free(struct pbuf *p);
+
+/*
+*	Move a block's place in the occupancy counts
+*
+*	@param *b - pointer to the block.
+*	@param owner - new owner.
+*
+*/
+HOT_PATH
+static void pktbuf_account(struct pktbuf *b, uint8_t owner)
+{
+	pktbuf_stats.held[b->owner]--;
+	if (pktbuf_stats.held[PKTBUF_FREE] < pktbuf_stats.low) pktbuf_stats.low = pktbuf_stats.held[PKTBUF_FREE];
+	pktbuf_stats.held[owner]++;
+	if (pktbuf_stats.held[owner] > pktbuf_stats.peak[owner]) pktbuf_stats.peak[owner] = pktbuf_stats.held[owner];
+	b->owner = owner;
+	return;
+}
+
+/*
+*	Check if an owner can take another block
+*
+*	@param owner - the owner asking.
+*
+*/
+HOT_PATH
+static bool pktbuf_can_take(uint8_t owner)
+{
+	if (pktbuf_stats.held[owner] >= pktbuf_quota[owner])
+	{
+		pktbuf_stats.quota[owner]++;
+		return false;
+	}
+	return true;
+}
+
+/*
+*	Put every block in the pool
+*
+*/
+void pktbuf_init(void)
+{
+	memset(&pktbuf_stats, 0, sizeof(pktbuf_stats));
+	for (int x=0;x<PKTBUF_COUNT;x++)
+	{
+		pktbuf_pool[x].owner = PKTBUF_FREE;
+		pktbuf_pool[x].ref = 0;
+		pktbuf_free_list[x] = x;
+	}
+	pktbuf_stats.held[PKTBUF_FREE] = PKTBUF_COUNT;
+	pktbuf_stats.low = PKTBUF_COUNT;
+	return;
+}
+
+/*
+*	Take a block from the pool
+*
+*	Blocks of sent frames are only released when the GMAC driver is next
+*	written to, so they are reclaimed here before a request is refused.
+*
+*	@param owner - the owner the block is counted against.
+*
+*	Returns the block with one reference, or NULL.
+*
+*/
+HOT_PATH
+struct pktbuf *pktbuf_alloc(uint8_t owner)
+{
+	struct pktbuf *b;
+	uint8_t reserve = (owner == PKTBUF_RX) ? 0 : PKTBUF_RX_RESERVE;
+
+	if (pktbuf_stats.held[owner] >= pktbuf_quota[owner] || pktbuf_stats.held[PKTBUF_FREE] <= reserve)
+	{
+		gmac_dev_tx_reclaim(&gs_gmac_dev);
+	}
+	if (!pktbuf_can_take(owner)) return NULL;
+	if (pktbuf_stats.held[PKTBUF_FREE] <= reserve)
+	{
+		pktbuf_stats.empty++;
+		return NULL;
+	}
+
+	b = &pktbuf_pool[pktbuf_free_list[pktbuf_stats.held[PKTBUF_FREE] - 1]];
+	b->ref = 1;
+	pktbuf_account(b, owner);
+	pktbuf_stats.allocs[owner]++;
+	return b;
+}
+
+/*
+*	Add a reference to a block
+*
+*	@param *b - pointer to the block.
+*
+*/
+void pktbuf_ref(struct pktbuf *b)
+{
+	b->ref++;
+	return;
+}
+
+/*
+*	Drop a reference to a block, the last one returns it to the pool
+*
+*	@param *b - pointer to the block.
+*
+*/
+HOT_PATH
+void pktbuf_free(struct pktbuf *b)
+{
+	if (b->ref == 0 || --b->ref > 0) return;
+
+	pktbuf_account(b, PKTBUF_FREE);
+	pktbuf_free_list[pktbuf_stats.held[PKTBUF_FREE] - 1] = b - pktbuf_pool;
+	return;
+}
+
+/*
+*	Count a block against another owner
+*
+*	@param *b - pointer to the block.
+*	@param owner - the new owner.
+*
+*	Returns false if the new owner is at its quota.
+*
+*/
+bool pktbuf_give(struct pktbuf *b, uint8_t owner)
+{
+	if (b->owner == owner) return true;
+	if (!pktbuf_can_take(owner)) return false;
+	pktbuf_account(b, owner);
+	return true;
+}
+
+/*
+*	Start of the frame area of a block
+*
+*	@param *b - pointer to the block.
+*
+*/
+HOT_PATH
+uint8_t *pktbuf_frame(struct pktbuf *b)
+{
+	return pktbuf_mem[b - pktbuf_pool];
+}
+
+/*
+*	Release a block held in a custom pbuf
+*
+*	@param *p - pointer to the custom pbuf.
+*
+*/
+static void pktbuf_pbuf_free(struct pbuf *p)
+{
+	pktbuf_free((struct pktbuf*)p);
+	return;
+}
+
+/*
+*	Wrap part of a block in a custom pbuf
+*
+*	The pbuf takes over one of the caller's references and gives it back
+*	when it is freed. A block has only one pbuf header, so it can only be
+*	in one pbuf at a time.
+*
+*	@param *b - pointer to the block.
+*	@param *payload - start of the data in the block.
+*	@param size - size of the data.
+*
+*/
+struct pbuf *pktbuf_pbuf(struct pktbuf *b, uint8_t *payload, uint16_t size)
+{
+	b->pc.custom_free_function = pktbuf_pbuf_free;
+	return pbuf_alloced_custom(PBUF_RAW, size, PBUF_REF, &b->pc, payload, size);
+}
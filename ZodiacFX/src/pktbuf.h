@@ -0,0 +1,92 @@
+/**
+ * @file
+ * pktbuf.h
+ *
+ * This file contains the packet buffer pool functions
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX P4 firmware.
+ * Copyright (c) 2019 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Paul Zanna <paul@northboundnetworks.com>
+ *
+ */
+
+#ifndef PKTBUF_H_
+#define PKTBUF_H_
+
+#include <asf.h>
+#include "switch.h"
+#include "lwip/pbuf.h"
+
+/*
+*	Every frame the switch holds on to lives in one pool of fixed size
+*	blocks. The receive path reads each frame into a block, lwIP keeps the
+*	blocks of frames it has not finished with, and frames sent by the
+*	dataplane are built in a block the GMAC sends without a copy. Each
+*	owner has a quota so no one of them can take the whole pool, and
+*	PKTBUF_RX_RESERVE blocks are only handed to the receive path so it
+*	can always make progress.
+*/
+#define PKTBUF_COUNT		16
+#define PKTBUF_SIZE		((GMAC_FRAME_LENTGH_MAX + 7) & ~7)
+#define PKTBUF_RX_RESERVE	2
+
+/* Holder of a block, blocks are counted against their owner's quota */
+enum pktbuf_owner {
+	PKTBUF_FREE,
+	PKTBUF_RX,	// Frame being read or processed by the dataplane
+	PKTBUF_LWIP,	// Received frame held by lwIP
+	PKTBUF_TX,	// Frame queued on the GMAC
+	PKTBUF_OWNERS
+};
+
+/* One block, the custom pbuf lets lwIP and the GMAC free callback hold it */
+struct pktbuf {
+	struct pbuf_custom pc;
+	uint8_t owner;		// enum pktbuf_owner
+	uint8_t ref;		// References, the block is returned to the pool when it reaches 0
+	uint8_t port;		// Tail tag, while waiting in an egress queue
+	uint16_t size;		// Frame size, while waiting in an egress queue
+	struct pktbuf *next;	// Next frame in the egress queue
+	uint32_t stamp;		// When it was queued, for CoDel
+};
+
+struct pktbuf_stats {
+	uint8_t held[PKTBUF_OWNERS];	// Blocks held by each owner, held[PKTBUF_FREE] is the free count
+	uint8_t peak[PKTBUF_OWNERS];	// Most blocks held at once
+	uint8_t low;			// Fewest free blocks
+	uint32_t allocs[PKTBUF_OWNERS];
+	uint32_t quota[PKTBUF_OWNERS];	// Requests refused because the owner was at its quota
+	uint32_t empty;			// Requests refused because the pool was empty
+	uint32_t tx_busy;		// Frames dropped with no free TX descriptors
+};
+
+extern struct pktbuf_stats pktbuf_stats;
+extern const uint8_t pktbuf_quota[PKTBUF_OWNERS];
+extern const char *const pktbuf_owner_name[PKTBUF_OWNERS];
+
+void pktbuf_init(void);
+struct pktbuf *pktbuf_alloc(uint8_t owner);
+void pktbuf_ref(struct pktbuf *b);
+void pktbuf_free(struct pktbuf *b);
+bool pktbuf_give(struct pktbuf *b, uint8_t owner);
+uint8_t *pktbuf_frame(struct pktbuf *b);
+struct pbuf *pktbuf_pbuf(struct pktbuf *b, uint8_t *payload, uint16_t size);
+
+#endif /* PKTBUF_H_ */
@@ -0,0 +1,259 @@
+/**
+ * @file
+ * sched.c
+ *
+ * This file contains the main loop scheduler functions
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX P4 firmware.
+ * Copyright (c) 2019 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Paul Zanna <paul@northboundnetworks.com>
+ *
+ */
+
+#include <asf.h>
+#include <string.h>
+#include "sched.h"
+#include "common.h"
+#include "timers.h"
+
+#define SCHED_CYCLES_PER_US	(sysclk_get_cpu_hz() / 1000000)
+
+/* A deferred work item */
+struct sched_work {
+	sched_work_t work;
+	void *arg;
+};
+
+// Global variables
+struct sched_task sched_tasks[SCHED_MAX_TASKS];
+uint8_t sched_task_count = 0;
+struct sched_stats sched_stats;
+const char *const sched_class_name[SCHED_CLASSES] = {"Dataplane", "Control", "Background"};
+
+// Local variables
+static struct sched_work sched_work_queue[SCHED_MAX_WORK];
+static uint8_t sched_work_head = 0;
+static uint8_t sched_work_count = 0;
+static uint8_t sched_next[SCHED_CLASSES];	// Task each class looks from for its next run
+static uint8_t sched_starved = 0;		// Passes background work has been held back for in a row
+static bool sched_work_turn = false;		// Background alternates between tasks and work items
+
+// Internal Functions
+static void sched_overrun(const char *name, uint32_t cycles, uint32_t budget);
+
+/*
+*	Convert a cycle count to us
+*
+*	@param cycles - CPU cycles.
+*
+*/
+uint32_t sched_cycles_to_us(uint32_t cycles)
+{
+	return cycles / SCHED_CYCLES_PER_US;
+}
+
+/*
+*	Add a task, called at boot before the task first runs
+*
+*	@param *name - name of the task, must be a string constant.
+*	@param run - function that does one step of the task's work.
+*	@param class - priority class, enum sched_class.
+*	@param budget_us - longest time a run should take.
+*
+*	Returns false if the task table is full.
+*
+*/
+bool sched_add(const char *name, void (*run)(void), uint8_t class, uint32_t budget_us)
+{
+	struct sched_task *t;
+
+	if (sched_task_count >= SCHED_MAX_TASKS || class >= SCHED_CLASSES) return false;
+
+	t = &sched_tasks[sched_task_count++];
+	memset(t, 0, sizeof(struct sched_task));
+	t->name = name;
+	t->run = run;
+	t->class = class;
+	t->budget = budget_us * SCHED_CYCLES_PER_US;
+	return true;
+}
+
+/*
+*	Queue work to run as background work on a later pass
+*
+*	Long operations are split into steps, the work function does one
+*	step per run and returns true until it is finished.
+*
+*	@param work - function to run.
+*	@param *arg - passed to the function.
+*
+*	Returns false if the queue is full.
+*
+*/
+bool sched_defer(sched_work_t work, void *arg)
+{
+	struct sched_work *w;
+
+	if (sched_work_count >= SCHED_MAX_WORK)
+	{
+		sched_stats.work_full++;
+		return false;
+	}
+
+	w = &sched_work_queue[(sched_work_head + sched_work_count) % SCHED_MAX_WORK];
+	w->work = work;
+	w->arg = arg;
+	sched_work_count++;
+	return true;
+}
+
+/*
+*	Record a run that took longer than its budget
+*
+*	@param *name - name of the task.
+*	@param cycles - time the run took.
+*	@param budget - budget of the task.
+*
+*/
+static void sched_overrun(const char *name, uint32_t cycles, uint32_t budget)
+{
+	sched_stats.overrun = name;
+	sched_stats.overrun_us = sched_cycles_to_us(cycles);
+	sched_stats.overrun_ms = sys_get_ms();
+	TRACE("sched.c: %s ran for %lu us, budget %lu us", name, sched_stats.overrun_us, sched_cycles_to_us(budget));
+	return;
+}
+
+/*
+*	Run a task once and time it
+*
+*	@param *t - pointer to the task.
+*
+*/
+static void sched_call(struct sched_task *t)
+{
+	uint32_t start = DWT->CYCCNT;
+	uint32_t cycles;
+
+	t->run();
+	cycles = DWT->CYCCNT - start;
+
+	t->runs++;
+	t->avg = (t->avg * 15 + cycles) / 16;
+	if (cycles > t->max) t->max = cycles;
+	if (cycles > t->budget)
+	{
+		t->overruns++;
+		sched_overrun(t->name, cycles, t->budget);
+	}
+	return;
+}
+
+/*
+*	Run the next task of a class, round robin
+*
+*	@param class - priority class.
+*
+*	Returns false if the class has no tasks.
+*
+*/
+static bool sched_run_next(uint8_t class)
+{
+	uint8_t x = sched_next[class];
+
+	for (int n=0;n<sched_task_count;n++)
+	{
+		if (x >= sched_task_count) x = 0;
+		if (sched_tasks[x].class == class)
+		{
+			sched_next[class] = x + 1;
+			sched_call(&sched_tasks[x]);
+			return true;
+		}
+		x++;
+	}
+	return false;
+}
+
+/*
+*	Run the deferred work item at the head of the queue
+*
+*/
+static void sched_run_work(void)
+{
+	struct sched_work *w = &sched_work_queue[sched_work_head];
+	uint32_t start = DWT->CYCCNT;
+	uint32_t cycles;
+	bool more;
+
+	more = w->work(w->arg);
+	cycles = DWT->CYCCNT - start;
+	sched_stats.work_runs++;
+	if (cycles > SCHED_WORK_BUDGET * SCHED_CYCLES_PER_US)
+	{
+		sched_overrun("Deferred work", cycles, SCHED_WORK_BUDGET * SCHED_CYCLES_PER_US);
+	}
+
+	/* Unfinished work keeps its place so it is resumed next */
+	if (more) return;
+	sched_work_head = (sched_work_head + 1) % SCHED_MAX_WORK;
+	sched_work_count--;
+	return;
+}
+
+/*
+*	One pass of the main loop
+*
+*/
+void sched_run(void)
+{
+	uint32_t start = DWT->CYCCNT;
+	uint32_t pass;
+
+	sched_stats.passes++;
+
+	for (int x=0;x<sched_task_count;x++)
+	{
+		if (sched_tasks[x].class == SCHED_DATAPLANE) sched_call(&sched_tasks[x]);
+	}
+
+	sched_run_next(SCHED_CONTROL);
+
+	pass = DWT->CYCCNT - start;
+	if (pass < SCHED_PASS_BUDGET * SCHED_CYCLES_PER_US || sched_starved >= SCHED_STARVE_PASSES)
+	{
+		sched_starved = 0;
+		sched_work_turn = !sched_work_turn;
+		if (sched_work_count > 0 && sched_work_turn)
+		{
+			sched_run_work();
+		} else if (!sched_run_next(SCHED_BACKGROUND) && sched_work_count > 0)
+		{
+			sched_run_work();
+		}
+	} else {
+		sched_starved++;
+		sched_stats.held++;
+	}
+
+	pass = DWT->CYCCNT - start;
+	if (pass > sched_stats.max_pass) sched_stats.max_pass = pass;
+	return;
+}
@@ -0,0 +1,92 @@
+/**
+ * @file
+ * sched.h
+ *
+ * This file contains the main loop scheduler functions
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX P4 firmware.
+ * Copyright (c) 2019 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Paul Zanna <paul@northboundnetworks.com>
+ *
+ */
+
+#ifndef SCHED_H_
+#define SCHED_H_
+
+#include <asf.h>
+
+/*
+*	Tasks run to completion from the main loop. Every pass runs all of
+*	the dataplane tasks, the next control task, then the next background
+*	task or work item. Background work is held back while the pass has
+*	already used SCHED_PASS_BUDGET, but never for more than
+*	SCHED_STARVE_PASSES passes in a row. Each run is timed with the
+*	cycle counter and runs longer than the task's budget are recorded.
+*/
+#define SCHED_MAX_TASKS		16
+#define SCHED_MAX_WORK		8	// Deferred work items waiting to run
+#define SCHED_PASS_BUDGET	100	// Time a pass can take before background work is held back (us)
+#define SCHED_STARVE_PASSES	8
+#define SCHED_WORK_BUDGET	1000	// Time a deferred work item should take per run (us)
+
+/* Priority classes, highest first */
+enum sched_class {
+	SCHED_DATAPLANE,
+	SCHED_CONTROL,
+	SCHED_BACKGROUND,
+	SCHED_CLASSES
+};
+
+/* Deferred work, returns true to be run again on a later pass */
+typedef bool (*sched_work_t)(void *arg);
+
+struct sched_task {
+	const char *name;
+	void (*run)(void);
+	uint8_t class;		// enum sched_class
+	uint32_t budget;	// Cycles
+	uint32_t runs;
+	uint32_t avg;		// Cycles, moving average over 16 runs
+	uint32_t max;		// Cycles
+	uint32_t overruns;	// Runs longer than the budget
+};
+
+struct sched_stats {
+	uint32_t passes;
+	uint32_t max_pass;	// Cycles
+	uint32_t held;		// Passes background work was held back for
+	uint32_t work_runs;
+	uint32_t work_full;	// Work items refused with the queue full
+	const char *overrun;	// Task that last overran its budget
+	uint32_t overrun_us;	// How long it ran for
+	uint32_t overrun_ms;	// When, in ms since boot
+};
+
+extern struct sched_task sched_tasks[SCHED_MAX_TASKS];
+extern uint8_t sched_task_count;
+extern struct sched_stats sched_stats;
+extern const char *const sched_class_name[SCHED_CLASSES];
+
+bool sched_add(const char *name, void (*run)(void), uint8_t class, uint32_t budget_us);
+bool sched_defer(sched_work_t work, void *arg);
+void sched_run(void);
+uint32_t sched_cycles_to_us(uint32_t cycles);
+
+#endif /* SCHED_H_ */
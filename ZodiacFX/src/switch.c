@@ -35,10 +35,24 @@
 #include "conf_eth.h"
 #include "command.h"
 #include "timers.h"
+#include "boot.h"
 #include "P4/zodiacfx-p4.h"
+#include "P4/zodiacfx-vm.h"
+#include "P4/zodiacfx-tables.h"
+#include "P4/zodiacfx-persist.h"
+#include "pktbuf.h"
+#include "egress.h"
 
 #include "ksz8795clx/ethernet_phy.h"
 #include "netif/etharp.h"
+#include "lwip/pbuf.h"
+
+/* Classification of a received frame */
+enum mgmt_class {
+	MGMT_NONE,	// Dataplane only
+	MGMT_LOCAL,	// Addressed to the switch, lwIP only
+	MGMT_SHARED	// Broadcast ARP for the switch, lwIP and then the dataplane
+};
 
 // Global variables
 extern struct tcp_conn tcp_conn;
@@ -50,9 +64,31 @@ extern uint8_t shared_buffer[SHARED_BUFFER_LEN];
 
 // Local variables
 gmac_device_t gs_gmac_dev;
-uint8_t gmacbuffer[GMAC_FRAME_LENTGH_MAX];
-static volatile uint8_t gs_uc_eth_buffer[GMAC_FRAME_LENTGH_MAX];
+static struct pktbuf *rx_block = NULL;	// Pool block the next frame is read into
+struct mgmt_stats mgmt_stats;
+struct latency_stats latency_stats;
+uint64_t switch_rx_ns;	// Ingress timestamp of the frame in the pipeline
 uint8_t stats_rr = 0;
+struct vlan_entry vlan_table[MAX_ACTIVE_VLANS];
+uint32_t vlan_hw_offload = 0;	// Tag push/pop requests handled by the KSZ8795
+uint32_t vlan_sw_rewrite = 0;	// Tag push/pop requests handled by rewriting the frame
+static uint8_t port_tag_insert = 0;	// Ports with hardware tag insertion enabled (bit 0 = port 1)
+static uint8_t port_tag_remove = 0;	// Ports with hardware tag removal enabled (bit 0 = port 1)
+static uint16_t cpu_default_tag = 0;	// Default tag the KSZ8795 inserts on frames sent by the CPU
+static struct p4_table_entry vlan_saved_entries[MAX_ACTIVE_VLANS];
+static struct p4_table vlan_saved = {	// VLANs added at runtime, keyed by VID so they are saved with the tables
+	.key_len = 2,
+	.size = MAX_ACTIVE_VLANS,
+	.entries = vlan_saved_entries,
+};
+uint8_t port_status[TOTAL_PORTS];	// Link state of each port, 1 = up
+uint32_t port_link_flaps[TOTAL_PORTS];	// Number of times the link has gone down
+uint32_t port_failover_ms[TOTAL_PORTS];	// Worst case time from link loss to detection, last event
+uint32_t port_failover_max_ms[TOTAL_PORTS];	// Worst case time from link loss to detection, all events
+static uint32_t port_last_seen[TOTAL_PORTS];	// Time the port status was last read
+static uint32_t link_poll_time = 0;
+static bool first_link = false;		// A link has come up since boot
+static bool first_frame = false;	// A frame has been passed to the dataplane since boot
 
 /* GMAC HW configurations */
 #define BOARD_GMAC_PHY_ADDR 0
@@ -60,6 +96,12 @@ uint8_t stats_rr = 0;
 #define USART_SPI                   USART0
 #define USART_SPI_DEVICE_ID         1
 #define USART_SPI_BAUDRATE          1000000
+/** Time between port status reads, the ports are read one at a time */
+#define LINK_POLL_INTERVAL	2
+/** KSZ8795 family ID in chip ID 0, read back once the switch is out of reset */
+#define KSZ8795_FAMILY_ID	0x87
+/** Longest time the switch can be held in reset (CAT811: Max 400ms) */
+#define SWITCH_READY_TIMEOUT	400000
 
 struct usart_spi_device USART_SPI_DEVICE = {
 	 /* Board specific select ID. */
@@ -134,11 +176,59 @@ int switch_write(uint8_t param1, uint8_t param2)
 
 	/* Deselect the checked DF memory. */
 	usart_spi_deselect_device(USART_SPI, &USART_SPI_DEVICE);
-	for(int x = 0;x<100000;x++);
 
 	return switch_read(param1);
 }
 
+/*
+*	Write consecutive switch registers in one SPI transfer
+*
+*	The KSZ8795 increments the register address after each data byte,
+*	so this takes one select and command instead of one per register.
+*	The registers are not read back.
+*
+*	@param param1 - the first register.
+*	@param *data - pointer to the values.
+*	@param len - number of registers to write.
+*
+*/
+void switch_write_burst(uint8_t param1, const uint8_t *data, uint8_t len)
+{
+	uint8_t reg[2];
+
+	if (param1 < 128) {
+		reg[0] = 64;
+		} else {
+		reg[0] = 65;
+	}
+
+	reg[1] = param1 << 1;
+
+	usart_spi_select_device(USART_SPI, &USART_SPI_DEVICE);
+	usart_spi_write_packet(USART_SPI, reg, 2);
+	usart_spi_write_packet(USART_SPI, data, len);
+	usart_spi_deselect_device(USART_SPI, &USART_SPI_DEVICE);
+	return;
+}
+
+/*
+*	Wait for the switch to come out of reset
+*
+*	Returns true when the chip ID reads back, false if it did not
+*	within SWITCH_READY_TIMEOUT us.
+*
+*/
+static bool switch_wait_ready(void)
+{
+	uint32_t start = boot_us();
+
+	while ((boot_us() - start) < SWITCH_READY_TIMEOUT)
+	{
+		if (switch_read(0) == KSZ8795_FAMILY_ID) return true;
+	}
+	return false;
+}
+
 /*
 *	Read the number of CRC errors from the switch
 *
@@ -224,6 +314,100 @@ int readtxdrop(int port)
 	return total;
 }
 
+/*
+*	Pad a frame in a pool block, add the tail tag and send it
+*
+*	The GMAC sends the frame straight from the block, which goes back to
+*	the pool once it has been sent. The caller's reference is passed on.
+*
+*	@param *b - pointer to the block, the frame starts at pktbuf_frame().
+*	@param ul_size - size of the frame.
+*	@param port - the port to send the data out from.
+*
+*	Returns true if the frame was queued.
+*
+*/
+HOT_PATH
+bool gmac_send_pktbuf(struct pktbuf *b, uint16_t ul_size, uint8_t port)
+{
+	uint8_t *p_frame = pktbuf_frame(b);
+	gmac_tx_frag_t frag;
+	struct pbuf *p;
+
+	// Add padding
+	if (ul_size < 60)
+	{
+		memset(p_frame + ul_size, 0, 60 - ul_size);
+		ul_size = 60;
+	}
+
+	p_frame[ul_size] = port;	// Tail tag
+	ul_size++; // Increase packet size by 1 to allow for the tail tag.
+
+	frag.p_buffer = p_frame;
+	frag.ul_size = ul_size;
+	p = pktbuf_pbuf(b, p_frame, ul_size);
+	if (gmac_dev_write_sg(&gs_gmac_dev, &frag, 1, p) != GMAC_OK)
+	{
+		pktbuf_stats.tx_busy++;
+		pbuf_free(p);
+		return false;
+	}
+	return true;
+}
+
+/*
+*	Read the link state of a port from the switch
+*
+*	@param port - the number of the port to read.
+*
+*/
+static uint8_t read_port_link(int port)
+{
+	return (switch_read(30 + (16*(port-1))) & 32) >> 5;	// Port status 2, link good
+}
+
+/*
+*	Poll the link state of the next port
+*
+*	Called from the main loop. Only one port register is read every
+*	LINK_POLL_INTERVAL ms so a lost link is seen within
+*	LINK_POLL_INTERVAL * TOTAL_PORTS ms for the cost of one SPI read.
+*
+*/
+void update_port_status(void)
+{
+	uint32_t now = sys_get_ms();
+	uint8_t link;
+
+	if ((now - link_poll_time) < LINK_POLL_INTERVAL) return;
+	link_poll_time = now;
+
+	link = read_port_link(stats_rr + 1);
+	if (link != port_status[stats_rr])
+	{
+		if (link == 0)
+		{
+			/* The link went down some time since it was last seen up */
+			port_link_flaps[stats_rr]++;
+			port_failover_ms[stats_rr] = now - port_last_seen[stats_rr];
+			if (port_failover_ms[stats_rr] > port_failover_max_ms[stats_rr]) port_failover_max_ms[stats_rr] = port_failover_ms[stats_rr];
+		}
+		port_status[stats_rr] = link;
+		if (link && !first_link)
+		{
+			first_link = true;
+			boot_mark("First link up");
+		}
+		TRACE("switch.c: port %d link %s", stats_rr + 1, link ? "up" : "down");
+	}
+	port_last_seen[stats_rr] = now;
+
+	stats_rr++;
+	if (stats_rr >= TOTAL_PORTS) stats_rr = 0;
+	return;
+}
+
 /*
 *	GMAC write function
 *
@@ -232,33 +416,350 @@ int readtxdrop(int port)
 *	@param port - the port to send the data out from.
 *
 */
+HOT_PATH
 void gmac_write(uint8_t *p_buffer, uint16_t ul_size, uint8_t port)
 {
-	if (ul_size > GMAC_FRAME_LENTGH_MAX)
+	struct pktbuf *b;
+	uint8_t class;
+
+	if (ul_size >= GMAC_FRAME_LENTGH_MAX)
 	{
 		return;
 	}
-	
-	// Add padding
-	if (ul_size < 60)
+
+	class = egress_classify(p_buffer, ul_size);
+	b = egress_alloc(class);
+	if (b == NULL) return;
+	memcpy(pktbuf_frame(b), p_buffer, ul_size);
+	egress_enqueue(b, ul_size, port, class);
+	return;
+}
+
+/*
+*	GMAC write function with a VLAN tag push or pop requested by the deparser
+*
+*	The KSZ8795 does the work where it can: a push is offloaded when every
+*	egress port has tag insertion enabled and the CPU port default tag matches
+*	the requested TCI, a pop when every egress port has tag removal enabled.
+*	Otherwise the tag is spliced in or left out while the frame is copied
+*	to its transmit block, so it is still copied only once.
+*
+*	@param *p_buffer - pointer to the buffer containing the data to send.
+*	@param ul_size - size of the data.
+*	@param port - the port to send the data out from.
+*	@param action - VLAN_ACTION_NONE, VLAN_ACTION_PUSH or VLAN_ACTION_POP.
+*	@param tci - the tag control information (PCP, DEI and VID) to push.
+*
+*/
+HOT_PATH
+void gmac_write_vlan(uint8_t *p_buffer, uint16_t ul_size, uint8_t port, uint8_t action, uint16_t tci)
+{
+	uint8_t egress = port & 0x0F;	// Tail tag port bitmap
+	struct pktbuf *b;
+	uint8_t *p_frame;
+	uint8_t class;
+
+	if (action == VLAN_ACTION_PUSH)
+	{
+		if (egress != 0 && (port_tag_insert & egress) == egress && tci == cpu_default_tag)
+		{
+			vlan_hw_offload++;
+			gmac_write(p_buffer, ul_size, port);
+			return;
+		}
+
+		if (ul_size < 12 || ul_size + VLAN_TAG_LEN >= GMAC_FRAME_LENTGH_MAX) return;
+		vlan_sw_rewrite++;
+		class = egress_classify(p_buffer, ul_size);
+		b = egress_alloc(class);
+		if (b == NULL) return;
+		p_frame = pktbuf_frame(b);
+		memcpy(p_frame, p_buffer, 12);
+		p_frame[12] = 0x81;
+		p_frame[13] = 0x00;
+		p_frame[14] = tci >> 8;
+		p_frame[15] = tci & 0xFF;
+		memcpy(p_frame + 16, p_buffer + 12, ul_size - 12);
+		egress_enqueue(b, ul_size + VLAN_TAG_LEN, port, class);
+		return;
+	}
+
+	if (action == VLAN_ACTION_POP && ul_size >= 18 && p_buffer[12] == 0x81 && p_buffer[13] == 0x00)
+	{
+		if (egress != 0 && (port_tag_remove & egress) == egress)
+		{
+			vlan_hw_offload++;
+			gmac_write(p_buffer, ul_size, port);
+			return;
+		}
+
+		vlan_sw_rewrite++;
+		class = egress_classify(p_buffer, ul_size);
+		b = egress_alloc(class);
+		if (b == NULL) return;
+		p_frame = pktbuf_frame(b);
+		memcpy(p_frame, p_buffer, 12);
+		memcpy(p_frame + 12, p_buffer + 12 + VLAN_TAG_LEN, ul_size - 12 - VLAN_TAG_LEN);
+		egress_enqueue(b, ul_size - VLAN_TAG_LEN, port, class);
+		return;
+	}
+
+	gmac_write(p_buffer, ul_size, port);
+	return;
+}
+
+/*
+*	Set the hardware tag insertion and removal for a port
+*
+*	@param port - the switch port (1 - 5).
+*	@param insert - 1 to insert the ingress port default tag on egress.
+*	@param remove - 1 to remove tags on egress.
+*
+*/
+void switch_set_port_tagging(uint8_t port, uint8_t insert, uint8_t remove)
+{
+	uint8_t reg = 16 * port;	// Port control 0
+	uint8_t mask = 1 << (port - 1);
+	int ctrl;
+	int new_ctrl;
+
+	if (port < 1 || port > CPU_PORT) return;
+
+	ctrl = switch_read(reg);
+	new_ctrl = ctrl & ~6;
+	if (insert) new_ctrl |= 4;	// Tag insertion
+	if (remove) new_ctrl |= 2;	// Tag removal
+	if (new_ctrl != ctrl) switch_write(reg, new_ctrl);
+
+	port_tag_insert = insert ? (port_tag_insert | mask) : (port_tag_insert & ~mask);
+	port_tag_remove = remove ? (port_tag_remove | mask) : (port_tag_remove & ~mask);
+	return;
+}
+
+/*
+*	Set the default ingress VID for a port
+*
+*	@param port - the switch port (1 - 5).
+*	@param vid - the VLAN ID.
+*
+*/
+static void switch_set_pvid(uint8_t port, uint16_t vid)
+{
+	uint8_t reg = 16 * port + 3;	// Port control 3, default tag [15:8]
+	uint8_t tag[2];
+
+	tag[0] = (switch_read(reg) & 0xF0) | ((vid >> 8) & 0x0F);
+	tag[1] = vid & 0xFF;	// Port control 4, default tag [7:0]
+	switch_write_burst(reg, tag, 2);
+	if (port == CPU_PORT) cpu_default_tag = (tag[0] << 8) | tag[1];
+	return;
+}
+
+/*
+*	Get the default ingress VID of a port
+*
+*	@param port - the switch port (1 - 5).
+*
+*/
+static uint16_t switch_get_pvid(uint8_t port)
+{
+	uint8_t reg = 16 * port + 3;	// Port control 3, default tag [15:8]
+
+	return ((switch_read(reg) & 0x0F) << 8) | switch_read(reg + 1);
+}
+
+/*
+*	Write an entry into the KSZ8795 VLAN table
+*
+*	@param *entry - pointer to the VLAN entry.
+*	@param valid - 0 to invalidate the entry in the switch.
+*
+*/
+static void switch_vlan_write_entry(struct vlan_entry *entry, uint8_t valid)
+{
+	int vlanoffset = entry->vid / 4;
+	int vlanindex = entry->vid - (vlanoffset*4);
+	uint8_t vlanmaphigh = 0;
+	uint8_t vlanmaplow = entry->fid & 0x7F;
+	uint8_t ctrl[2];
+	uint8_t map[2];
+
+	ctrl[0] = 20;	// Set read VLAN flag
+	ctrl[1] = vlanoffset;	// Read entries 0-3
+	switch_write_burst(110, ctrl, 2);
+
+	/* Calculate format */
+	if (valid)
+	{
+		vlanmaphigh = 16;	// Set valid bit
+		vlanmaphigh += (entry->members >> 1) & 15;	// Ports 2 - 5
+		if (entry->members & 1) vlanmaplow += 128;	// Port 1
+	}
+
+	/* Write settings back to registers */
+	map[0] = vlanmaphigh;
+	map[1] = vlanmaplow;
+	switch_write_burst((119-(vlanindex*2)), map, 2);
+	ctrl[0] = 4;	// Set write VLAN flag
+	switch_write_burst(110, ctrl, 2);	// Write entries 0-3
+	return;
+}
+
+/*
+*	Find an active VLAN in the runtime VLAN table
+*
+*	@param vid - the VLAN ID.
+*
+*/
+struct vlan_entry *switch_vlan_find(uint16_t vid)
+{
+	for (int x=0;x<MAX_ACTIVE_VLANS;x++)
+	{
+		if (vlan_table[x].active == 1 && vlan_table[x].vid == vid) return &vlan_table[x];
+	}
+	return NULL;
+}
+
+/*
+*	Add or update a VLAN in the KSZ8795 VLAN table
+*
+*	@param vid - the VLAN ID (1 - 4094).
+*	@param members - port membership bitmap, bit 0 = port 1 ... bit 4 = CPU port.
+*	@param tagged - member ports 1 - 4 that egress the VLAN tagged.
+*
+*	Returns 0 on success, -1 if the VID is invalid or the table is full.
+*
+*/
+int switch_vlan_add(uint16_t vid, uint8_t members, uint8_t tagged)
+{
+	struct vlan_entry *entry;
+
+	if (vid < 1 || vid > 4094) return -1;
+
+	entry = switch_vlan_find(vid);
+	if (entry == NULL)
+	{
+		for (int x=0;x<MAX_ACTIVE_VLANS;x++)
+		{
+			if (vlan_table[x].active == 0)
+			{
+				entry = &vlan_table[x];
+				entry->fid = x;	// FID = VLAN table index, the KSZ8795 has 128 (0 - 127)
+				break;
+			}
+		}
+	}
+	if (entry == NULL) return -1;	// All FIDs are in use
+
+	entry->vid = vid;
+	entry->members = members;
+	entry->tagged = tagged & members;
+	entry->active = 1;
+	switch_vlan_write_entry(entry, 1);
+
+	/* Set the member ports as VLAN tagged or untagged, untagged ports strip the tag on egress */
+	for (int i=0;i<TOTAL_PORTS;i++)
+	{
+		if (members & (1 << i)) switch_set_port_tagging(i+1, (entry->tagged >> i) & 1, !((entry->tagged >> i) & 1));
+	}
+	return 0;
+}
+
+/*
+*	Remove a VLAN from the KSZ8795 VLAN table
+*
+*	@param vid - the VLAN ID.
+*
+*	Returns 0 on success, -1 if the VLAN is not in the table.
+*
+*/
+int switch_vlan_delete(uint16_t vid)
+{
+	struct vlan_entry *entry = switch_vlan_find(vid);
+	struct vlan_entry *other;
+	uint8_t key[2];
+	uint8_t mask;
+
+	if (entry == NULL) return -1;
+	switch_vlan_write_entry(entry, 0);
+	entry->active = 0;
+	key[0] = vid >> 8;
+	key[1] = vid & 0xFF;
+	if (p4_table_delete(&vlan_saved, key) == P4_OK) persist_changed();
+
+	/* Hand the member ports to another VLAN they belong to, or back to the reset defaults */
+	for (int i=0;i<CPU_PORT;i++)
 	{
-		memset(&gmacbuffer, 0, 61);
-		memcpy(&gmacbuffer,p_buffer, ul_size);
-		uint8_t *last_byte;
-		last_byte = gmacbuffer + 60;
-		*last_byte = port;
-		gmac_dev_write(&gs_gmac_dev, &gmacbuffer, 61, NULL);
+		mask = 1 << i;
+		if ((entry->members & mask) == 0) continue;
+		other = NULL;
+		for (int x=0;x<MAX_ACTIVE_VLANS;x++)
+		{
+			if (vlan_table[x].active == 1 && (vlan_table[x].members & mask))
+			{
+				other = &vlan_table[x];
+				break;
+			}
+		}
+		if (switch_get_pvid(i+1) == vid) switch_set_pvid(i+1, (other != NULL) ? other->vid : 1);
+		if (i == CPU_PORT-1) continue;
+		if (other != NULL)
+		{
+			switch_set_port_tagging(i+1, (other->tagged & mask) != 0, (other->tagged & mask) == 0);
+		} else {
+			switch_set_port_tagging(i+1, 0, 0);
+		}
 	}
-	else
+	return 0;
+}
+
+/*
+*	Add or update a VLAN at runtime and save it with the tables, so it
+*	is added again after a restart by switch_vlan_restore()
+*
+*	@param vid - the VLAN ID (1 - 4094).
+*	@param members - port membership bitmap, bit 0 = port 1 ... bit 4 = CPU port.
+*	@param tagged - member ports 1 - 4 that egress the VLAN tagged.
+*
+*	Returns 0 on success, -1 if the VID is invalid, the table is full or
+*	the tables are being saved.
+*
+*/
+int switch_vlan_set(uint16_t vid, uint8_t members, uint8_t tagged)
+{
+	uint8_t key[2];
+	uint8_t data[2];
+	int status;
+
+	if (persist_busy()) return -1;
+	if (switch_vlan_add(vid, members, tagged) != 0) return -1;
+
+	key[0] = vid >> 8;
+	key[1] = vid & 0xFF;
+	data[0] = members;
+	data[1] = tagged & members;
+	status = p4_table_add(&vlan_saved, key, VLAN_TABLE_ACTION_MEMBERS, data, sizeof(data));
+	if (status == P4_ERR_EXISTS) status = p4_table_modify(&vlan_saved, key, VLAN_TABLE_ACTION_MEMBERS, data, sizeof(data));
+	if (status != P4_OK) return -1;
+	persist_changed();
+	return 0;
+}
+
+/*
+*	Add the VLANs saved by switch_vlan_set() to the switch, called after
+*	persist_restore() has reloaded the tables
+*
+*/
+void switch_vlan_restore(void)
+{
+	struct p4_table_entry *e;
+
+	for (int x=0;x<MAX_ACTIVE_VLANS;x++)
 	{
-		memcpy(&gmacbuffer,p_buffer, ul_size);
-		uint8_t *last_byte;
-		last_byte = gmacbuffer + ul_size;
-		*last_byte = port;
-		ul_size++; // Increase packet size by 1 to allow for the tail tag.
-		uint32_t write_size = gmac_dev_write(&gs_gmac_dev, &gmacbuffer, ul_size, NULL);
+		e = &vlan_saved_entries[x];
+		if (!e->used) continue;
+		switch_vlan_add((e->key[0] << 8) | e->key[1], e->data[0], e->data[1]);
 	}
-	
 	return;
 }
 
@@ -277,12 +778,10 @@ void GMAC_Handler(void)
 */
 void switch_init(void)
 {
-		volatile uint32_t ul_delay;
 		gmac_options_t gmac_option;
 
-		/* Wait for PHY to be ready (CAT811: Max400ms) */
-		ul_delay = sysclk_get_cpu_hz() / 1000 / 3 * 400;
-		while (ul_delay--);
+		/* Wait for the switch to come out of reset (CAT811: Max400ms) */
+		boot_mark(switch_wait_ready() ? "Switch ready" : "Switch ready timeout");
 
 		/* Enable GMAC clock */
 		pmc_enable_periph_clk(ID_GMAC);
@@ -303,11 +802,16 @@ void switch_init(void)
 		disables the check */
 		switch_write(4,242);
 
-		/* Init GMAC driver structure */
+		/* Init GMAC driver structure, frames are received into and sent from the buffer pool */
+		pktbuf_init();
+		egress_init();
+		egress_configure(Zodiac_Config.egress_sched, Zodiac_Config.egress_weight);
+		egress_set_aqm(Zodiac_Config.egress_aqm);
 		gmac_dev_init(GMAC, &gs_gmac_dev, &gmac_option);
 
 		/* Enable Interrupt */
 		NVIC_EnableIRQ(GMAC_IRQn);
+		boot_mark("GMAC");
 
 		/* Init MAC PHY driver */
 		if (ethernet_phy_init(GMAC, BOARD_GMAC_PHY_ADDR, sysclk_get_cpu_hz()) != GMAC_OK) {
@@ -322,93 +826,276 @@ void switch_init(void)
 		/* Create KSZ8795 VLANs */
 		switch_write(5,0);		// Disable 802.1q
 
+		memset(&vlan_table, 0, sizeof(vlan_table));
 		for (int x=0;x<MAX_VLANS;x++)
 		{
 			if (Zodiac_Config.vlan_list[x].uActive == 1)
 			{
-				if (Zodiac_Config.vlan_list[x].uVlanType == 1) switch_write(84,Zodiac_Config.vlan_list[x].uVlanID);	// If the VLAN is type Default then add the CPU port
+				uint8_t members = 0;
+				uint16_t vid = Zodiac_Config.vlan_list[x].uVlanID;
+
+				/* If the VLAN is type Default then add the CPU port */
+				if (Zodiac_Config.vlan_list[x].uVlanType == 1)
+				{
+					members |= 1 << (CPU_PORT-1);
+					switch_set_pvid(CPU_PORT, vid);
+				}
 				/* Assign the default ingress VID */
 				for (int i=0;i<4;i++)
 				{
 					if (Zodiac_Config.vlan_list[x].portmap[i] == 1)
 					{
-						switch_write(20 + (i*16),Zodiac_Config.vlan_list[x].uVlanID);	// Default ingress VID
+						members |= 1 << i;
+						switch_set_pvid(i+1, vid);
 					}
 				}
 				/* Add entry into the VLAN table */
-				int vlanoffset = Zodiac_Config.vlan_list[x].uVlanID / 4;
-				int vlanindex = Zodiac_Config.vlan_list[x].uVlanID - (vlanoffset*4);
-				switch_write(110,20);	// Set read VLAN flag
-				switch_write(111, vlanoffset);	// Read entries 0-3
-
-				/* Calculate format */
-				uint8_t vlanmaphigh;
-				uint8_t vlanmaplow;
-				vlanmaphigh = 16; // Set valid bit
-				if (Zodiac_Config.vlan_list[x].uVlanType == 1) vlanmaphigh += 8; 
-				if (Zodiac_Config.vlan_list[x].portmap[3] == 1) // Port 4
-				{
-					vlanmaphigh += 4;
-					if (Zodiac_Config.vlan_list[x].uTagged == 1) switch_write(64,4);	// Set port as VLAN tagged
-					if (Zodiac_Config.vlan_list[x].uTagged == 0) switch_write(64,0);	// Set port as VLAN untagged
-				}
-				if (Zodiac_Config.vlan_list[x].portmap[2] == 1) // Port 3;
-				{
-					vlanmaphigh += 2;
-					if (Zodiac_Config.vlan_list[x].uTagged == 1) switch_write(48,4);	// Set port as VLAN tagged
-					if (Zodiac_Config.vlan_list[x].uTagged == 0) switch_write(48,0);	// Set port as VLAN untagged
-				}
-				if (Zodiac_Config.vlan_list[x].portmap[1] == 1) // Port 2;
-				{
-					vlanmaphigh += 1;
-					if (Zodiac_Config.vlan_list[x].uTagged == 1) switch_write(32,4);	// Set port as VLAN tagged
-					if (Zodiac_Config.vlan_list[x].uTagged == 0) switch_write(32,0);	// Set port as VLAN untagged
-				}
-				vlanmaplow = x+1;	// FID = VLAN index number
-				if (Zodiac_Config.vlan_list[x].portmap[0] == 1) // Port 1;
-				{
-					vlanmaplow += 128;
-					if (Zodiac_Config.vlan_list[x].uTagged == 1) switch_write(16,4);	// Set port as VLAN tagged
-					if (Zodiac_Config.vlan_list[x].uTagged == 0) switch_write(16,0);	// Set port as VLAN untagged
-				}
-				/* Write settings back to registers */
-				switch_write((119-(vlanindex*2)),vlanmaphigh);
-				switch_write((120-(vlanindex*2)),vlanmaplow);
-				switch_write(110,4);	// Set read VLAN flag
-				switch_write(111,vlanoffset);	// Read entries 0-3
+				switch_vlan_add(vid, members, (Zodiac_Config.vlan_list[x].uTagged == 1) ? members : 0);
 			}
 		}
 
 		switch_write(5,128);	// Enable 802.1q
+		p4_add_table(VLAN_TABLE_ID, &vlan_saved);
+		boot_mark("VLANs");
+
+		/* Read the initial link state of the ports */
+		for (int x=0;x<TOTAL_PORTS;x++)
+		{
+			port_status[x] = read_port_link(x+1);
+		}
 		
 		/* Trap all packets using Authentication_mode and send them to the CPU. */
 		switch_write(21,3);
 		switch_write(37,3);
 		switch_write(53,3);
 		switch_write(69,3);
+		boot_mark("Switch");
 		return;
 }
+
+/*
+*	Check if a received frame is for the switch itself
+*
+*	@param *p_frame - pointer to the start of the frame.
+*	@param ul_size - size of the frame without the tail tag.
+*
+*/
+HOT_PATH
+static uint8_t mgmt_classify(uint8_t *p_frame, uint32_t ul_size)
+{
+	static const uint8_t broadcast[6] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+
+	if (memcmp(p_frame, Zodiac_Config.MAC_address, 6) == 0) return MGMT_LOCAL;
+
+	/* ARP requests are only taken when they ask for the switch's IP address */
+	if (ul_size >= 42 && p_frame[12] == 0x08 && p_frame[13] == 0x06 && memcmp(p_frame, broadcast, 6) == 0
+		&& memcmp(p_frame + 38, Zodiac_Config.IP_address, 4) == 0) return MGMT_SHARED;
+
+	return MGMT_NONE;
+}
+
+/*
+*	Pass a frame in the receive block to lwIP
+*
+*	The frame is wrapped in a custom pbuf that points at the block, so
+*	nothing is copied. If lwIP keeps the pbuf (TCP data waiting to be
+*	read, fragments being reassembled) the block is counted against lwIP
+*	and the next frame is read into a new one. When lwIP is at its quota,
+*	or the dataplane still needs the frame, it is copied into lwIP's heap
+*	instead.
+*
+*	@param *netif - pointer to the lwIP interface.
+*	@param *p_frame - pointer to the start of the frame.
+*	@param ul_size - size of the frame without the tail tag.
+*	@param copy - true to always give lwIP a copy.
+*
+*	Returns true if lwIP still holds the receive block.
+*
+*/
+static bool mgmt_input(struct netif *netif, uint8_t *p_frame, uint32_t ul_size, bool copy)
+{
+	struct pbuf *p;
+
+	/* lwIP is started after the dataplane */
+	if (!netif_is_up(netif))
+	{
+		mgmt_stats.dropped++;
+		return false;
+	}
+
+	if (!copy && pktbuf_stats.held[PKTBUF_LWIP] < pktbuf_quota[PKTBUF_LWIP])
+	{
+		pktbuf_ref(rx_block);
+		p = pktbuf_pbuf(rx_block, p_frame, ul_size);
+	} else {
+		p = pbuf_alloc(PBUF_RAW, ul_size, PBUF_RAM);
+		if (p == NULL)
+		{
+			mgmt_stats.dropped++;
+			return false;
+		}
+		pbuf_take(p, p_frame, ul_size);
+		if (!copy) mgmt_stats.copied++;
+	}
+
+	if (netif->input(p, netif) != ERR_OK) pbuf_free(p);
+
+	if (rx_block->ref > 1)
+	{
+		pktbuf_give(rx_block, PKTBUF_LWIP);
+		pktbuf_free(rx_block);
+		rx_block = NULL;
+		return true;
+	}
+	return false;
+}
+
+/*
+*	Add a frame's pipeline latency to the histogram
+*
+*	@param ingress_ns - time the frame was received.
+*	@param egress_ns - time the frame was sent.
+*
+*/
+HOT_PATH
+void switch_latency(uint64_t ingress_ns, uint64_t egress_ns)
+{
+	uint32_t ns = (uint32_t)(egress_ns - ingress_ns);
+	uint32_t us = ns / 1000;
+	uint8_t bucket = 0;
+
+	while (us != 0 && bucket < LATENCY_BUCKETS-1)
+	{
+		us >>= 1;
+		bucket++;
+	}
+	latency_stats.frames++;
+	latency_stats.last_ns = ns;
+	if (ns > latency_stats.max_ns) latency_stats.max_ns = ns;
+	latency_stats.buckets[bucket]++;
+	return;
+}
+
+/*
+*	Time reading frames from a receive ring with buffers of one size
+*
+*	The descriptors are set up in RAM as the GMAC leaves them after
+*	receiving a frame, so only gmac_dev_read() is timed.
+*
+*	@param size - size of the frame, with the tail tag.
+*	@param unit - size of each receive buffer.
+*	@param runs - frames to read.
+*
+*	Returns the average cycles per frame, 0 if there were no blocks free.
+*
+*/
+uint32_t switch_rx_bench(uint16_t size, uint16_t unit, uint32_t runs)
+{
+	gmac_rx_descriptor_t desc[RX_BENCH_DESCRIPTORS];
+	gmac_device_t dev;
+	struct pktbuf *ring = pktbuf_alloc(PKTBUF_RX);
+	struct pktbuf *dst = pktbuf_alloc(PKTBUF_RX);
+	uint16_t count = (size + unit - 1) / unit;	// Buffers the frame takes
+	uint8_t *p_ring;
+	uint32_t base;
+	uint32_t rcv_size;
+	uint32_t start;
+	uint32_t cycles = 0;
+
+	if (ring == NULL || dst == NULL || count >= RX_BENCH_DESCRIPTORS || size > GMAC_FRAME_LENTGH_MAX)
+	{
+		if (ring != NULL) pktbuf_free(ring);
+		if (dst != NULL) pktbuf_free(dst);
+		return 0;
+	}
+
+	/* The buffers share one block, the frame is only read from them */
+	p_ring = pktbuf_frame(ring);
+	base = ((uint32_t)p_ring + 3) & GMAC_RXD_ADDR_MASK;
+	memset(&dev, 0, sizeof(dev));
+	dev.p_rx_dscr = desc;
+	dev.us_rx_list_size = count + 1;	// The last one is left empty, as the next frame's would be
+	dev.us_rx_buf_size = unit;
+
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+	for (uint32_t x=0;x<runs;x++)
+	{
+		for (int i=0;i<=count;i++)
+		{
+			desc[i].addr.val = ((base + i * unit) & GMAC_RXD_ADDR_MASK) | ((i < count) ? GMAC_RXD_OWNERSHIP : 0);
+			desc[i].status.val = 0;
+		}
+		desc[count].addr.val |= GMAC_RXD_WRAP;
+		desc[0].status.val |= GMAC_RXD_SOF;
+		desc[count - 1].status.val |= GMAC_RXD_EOF | size;
+		dev.us_rx_idx = 0;
+
+		start = DWT->CYCCNT;
+		gmac_dev_read(&dev, pktbuf_frame(dst), GMAC_FRAME_LENTGH_MAX, &rcv_size);
+		cycles += DWT->CYCCNT - start;
+	}
+	pktbuf_free(ring);
+	pktbuf_free(dst);
+	return cycles / runs;
+}
+
 /*
 *	Main switching loop
 *
 *	@param *netif - pointer to the network interface struct.
 *
 */
+HOT_PATH
 void task_switch(struct netif *netif)
 {
-	uint16_t ul_rcv_size = 0;
+	uint32_t ul_rcv_size = 0;
+	uint8_t mgmt;
 
 	/* Main packet processing loop */
-	uint32_t dev_read = gmac_dev_read(&gs_gmac_dev, (uint8_t *) gs_uc_eth_buffer, sizeof(gs_uc_eth_buffer), &ul_rcv_size);
+	/* With no block to read into, frames wait in the GMAC receive ring */
+	if (rx_block == NULL)
+	{
+		rx_block = pktbuf_alloc(PKTBUF_RX);
+		if (rx_block == NULL) return;
+	}
+
+	uint8_t *p_frame = pktbuf_frame(rx_block);
+	uint32_t dev_read = gmac_dev_read(&gs_gmac_dev, p_frame, GMAC_FRAME_LENTGH_MAX, &ul_rcv_size);
 	if (dev_read == GMAC_OK)
 	{		
 		// Process packet
 		if (ul_rcv_size > 0)
 		{
-			uint8_t* tail_tag = (uint8_t*)(gs_uc_eth_buffer + (int)(ul_rcv_size)-1);
+			switch_rx_ns = sys_get_ns();
+			if (!first_frame)
+			{
+				first_frame = true;
+				boot_mark("First frame");
+			}
+			uint8_t* tail_tag = p_frame + (int)(ul_rcv_size)-1;
 			uint8_t tag = *tail_tag + 1;
 			ul_rcv_size--; // remove the tail first
-			packet_in((uint8_t *) gs_uc_eth_buffer, ul_rcv_size, tag);
+
+			mgmt = mgmt_classify(p_frame, ul_rcv_size);
+			if (mgmt == MGMT_LOCAL)
+			{
+				mgmt_stats.frames++;
+				mgmt_input(netif, p_frame, ul_rcv_size, false);
+				return;
+			}
+			if (mgmt == MGMT_SHARED)
+			{
+				/* lwIP writes its reply over the request it is given, the request itself is still flooded */
+				mgmt_stats.arp++;
+				mgmt_input(netif, p_frame, ul_rcv_size, true);
+			}
+			if (vm_active != NULL)
+			{
+				vm_run(vm_active, p_frame, ul_rcv_size, tag);
+			} else {
+				packet_in(p_frame, ul_rcv_size, tag);
+			}
 			return;
 		}
 	}
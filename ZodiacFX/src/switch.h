@@ -34,12 +34,71 @@
 #define SPI_IRQn        SPI_IRQn
 #define SHARED_BUFFER_LEN 2048
 
+/* VLAN tag actions the deparser can request on egress */
+#define VLAN_ACTION_NONE	0
+#define VLAN_ACTION_PUSH	1
+#define VLAN_ACTION_POP		2
+
+#define VLAN_TAG_LEN	4	// Size of an 802.1Q tag
+#define VLAN_TABLE_ID	7	// P4 table VLANs added at runtime are saved in, after the generated tables
+#define VLAN_TABLE_ACTION_MEMBERS	0	// Action data is the members and tagged bitmaps
+#define CPU_PORT	5	// KSZ8795 port connected to the GMAC
+
+/* Runtime view of one entry in the KSZ8795 VLAN table */
+struct vlan_entry {
+	uint16_t vid;
+	uint8_t members;	// Port membership bitmap, bit 0 = port 1 ... bit 4 = CPU port
+	uint8_t tagged;		// Member ports that egress this VLAN tagged
+	uint8_t fid;		// Filter ID (0 - MAX_ACTIVE_VLANS-1)
+	uint8_t active;
+};
+
+/* Frames steered from the CPU port to lwIP */
+struct mgmt_stats {
+	uint32_t frames;	// Frames addressed to the switch
+	uint32_t arp;		// Broadcast ARP requests for the switch, also forwarded
+	uint32_t copied;	// Frames copied because lwIP was at its buffer pool quota
+	uint32_t dropped;	// Frames dropped with no pbuf available
+	uint32_t tx_frames;	// Frames sent from lwIP pbufs without a copy
+	uint32_t tx_copied;	// TCP segments and frames with too many pbufs, copied into one pool block
+	uint32_t tx_busy;	// Frames dropped with no free TX descriptors
+};
+
+extern struct mgmt_stats mgmt_stats;
+
+#define RX_BENCH_DESCRIPTORS	((GMAC_FRAME_LENTGH_MAX / GMAC_RX_UNITSIZE) + 1)	// Enough for a full size frame in the smallest buffers
+#define LATENCY_BUCKETS	12	// Bucket 0 is under 1 us, bucket n is under 2^n us, the last is everything above
+
+/* Time from a frame being read from the GMAC to its transmit, in sys_get_ns() time */
+struct latency_stats {
+	uint32_t frames;
+	uint32_t last_ns;
+	uint32_t max_ns;
+	uint32_t buckets[LATENCY_BUCKETS];
+};
+
+extern struct latency_stats latency_stats;
+extern uint64_t switch_rx_ns;
+
+struct pktbuf;
+
 void spi_init(void);
 void switch_init(void);
 void task_switch(struct netif *netif);
 void gmac_write(uint8_t *p_buffer, uint16_t ul_size, uint8_t port);
+bool gmac_send_pktbuf(struct pktbuf *b, uint16_t ul_size, uint8_t port);
+void gmac_write_vlan(uint8_t *p_buffer, uint16_t ul_size, uint8_t port, uint8_t action, uint16_t tci);
+int switch_vlan_add(uint16_t vid, uint8_t members, uint8_t tagged);
+int switch_vlan_delete(uint16_t vid);
+int switch_vlan_set(uint16_t vid, uint8_t members, uint8_t tagged);
+void switch_vlan_restore(void);
+struct vlan_entry *switch_vlan_find(uint16_t vid);
+void switch_set_port_tagging(uint8_t port, uint8_t insert, uint8_t remove);
 int switch_read(uint8_t param1);
 int switch_write(uint8_t param1, uint8_t param2);
+void switch_write_burst(uint8_t param1, const uint8_t *data, uint8_t len);
+void switch_latency(uint64_t ingress_ns, uint64_t egress_ns);
+uint32_t switch_rx_bench(uint16_t size, uint16_t unit, uint32_t runs);
 void update_port_stats(void);
 void update_port_status(void);
 void disableOF(void);
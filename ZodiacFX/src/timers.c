@@ -31,12 +31,24 @@
 #include "board.h"
 #include "tc.h"
 #include "timers.h"
+#include "config_zodiac.h"
 #include "lwip/init.h"
 #include "lwip/sys.h"
 
 /* Clock tick count. */
 static volatile uint32_t gs_ul_clk_tick;
 
+/* Nanosecond clock, the 1ms tick interpolated with the DWT cycle counter.
+ * TC0_Handler writes the tick state between two increments of gs_ul_clk_seq
+ * so a reader can tell it was interrupted and retry. */
+static volatile uint32_t gs_ul_clk_seq;
+static volatile uint32_t gs_ul_clk_epoch;	// Times gs_ul_clk_tick has wrapped
+static volatile uint32_t gs_ul_clk_cycles;	// CYCCNT when the tick last moved
+static volatile uint32_t gs_ul_clk_mult;	// ns per cycle << CLK_MULT_SHIFT
+static uint32_t gs_ul_clk_window;		// CYCCNT at the start of the discipline window
+
+struct clock_stats clock_stats;
+
 #include "pmc.h"
 #include "sysclk.h"
 
@@ -53,7 +65,25 @@ void TC0_Handler(void)
 	ul_dummy = TC0->TC_CHANNEL[0].TC_SR;
 
 	/* Increase tick. */
+	uint32_t cycles = DWT->CYCCNT;
+	gs_ul_clk_seq++;
 	gs_ul_clk_tick++;
+	if (gs_ul_clk_tick == 0) gs_ul_clk_epoch++;
+	gs_ul_clk_cycles = cycles;
+	gs_ul_clk_seq++;
+
+	/* Discipline the cycle rate against TC0 so crystal and PLL error
+	 * doesn't turn into drift between sys_get_ns() and sys_get_ms() */
+	if ((gs_ul_clk_tick & (CLK_DISCIPLINE_MS - 1)) == 0)
+	{
+		uint32_t window = cycles - gs_ul_clk_window;
+		gs_ul_clk_window = cycles;
+		if (window != 0 && clock_stats.windows++ != 0)	// The first window started mid-tick
+		{
+			gs_ul_clk_mult = (uint32_t)((((uint64_t)1000000 * CLK_DISCIPLINE_MS) << CLK_MULT_SHIFT) / window);
+			clock_stats.cycles_per_ms = window / CLK_DISCIPLINE_MS;
+		}
+	}
 }
 
 /**
@@ -68,6 +98,11 @@ void sys_init_timing(void)
 
 	/* Clear tick value. */
 	gs_ul_clk_tick = 0;
+	gs_ul_clk_epoch = 0;
+	gs_ul_clk_cycles = DWT->CYCCNT;
+	gs_ul_clk_window = gs_ul_clk_cycles;
+	gs_ul_clk_mult = (uint32_t)(((uint64_t)1000000000 << CLK_MULT_SHIFT) / ul_sysclk);
+	clock_stats.cycles_per_ms = ul_sysclk / 1000;
 
 	/* Configure PMC. */
 	pmc_enable_periph_clk(ID_TC0);
@@ -94,6 +129,36 @@ uint32_t sys_get_ms(void)
 	return gs_ul_clk_tick;
 }
 
+/**
+ * Return the time since sys_init_timing() in nanoseconds.
+ *
+ * The millisecond part is the TC0 tick and the rest is the cycles counted
+ * since it, so the result never runs ahead of sys_get_ms(). Holding the
+ * remainder under 1ms keeps it monotonic when the tick interrupt is late.
+ *
+ */
+HOT_PATH
+uint64_t sys_get_ns(void)
+{
+	uint32_t seq, epoch, tick, cycles, mult, ns;
+
+	do {
+		seq = gs_ul_clk_seq;
+		epoch = gs_ul_clk_epoch;
+		tick = gs_ul_clk_tick;
+		cycles = gs_ul_clk_cycles;
+		mult = gs_ul_clk_mult;
+	} while ((seq & 1) || seq != gs_ul_clk_seq);
+
+	ns = (uint32_t)(((uint64_t)(DWT->CYCCNT - cycles) * mult) >> CLK_MULT_SHIFT);
+	if (ns > 999999)
+	{
+		ns = 999999;
+		clock_stats.held++;
+	}
+	return (((uint64_t)epoch << 32) | tick) * 1000000 + ns;
+}
+
 #if ((LWIP_VERSION) != ((1U << 24) | (3U << 16) | (2U << 8) | (LWIP_VERSION_RC)))
 u32_t sys_now(void)
 {
@@ -30,7 +30,22 @@
 #ifndef TIMER_MGT_H_INCLUDED
 #define TIMER_MGT_H_INCLUDED
 
+#define CLK_MULT_SHIFT		24	// Fraction bits in the ns per cycle multiplier
+#define CLK_DISCIPLINE_MS	1024	// Ticks between cycle rate measurements, a power of 2
+
+/* sys_get_ns() is the one time base for packet timestamps, meters and
+ * latency histograms; its millisecond part is the sys_get_ms() tick that
+ * flow timeouts and the timing wheel run from. */
+struct clock_stats {
+	uint32_t cycles_per_ms;	// Measured over the last discipline window
+	uint32_t windows;	// Discipline windows completed
+	uint32_t held;		// Reads held at the next tick because TC0 was late
+};
+
+extern struct clock_stats clock_stats;
+
 void sys_init_timing(void);
 uint32_t sys_get_ms(void);
+uint64_t sys_get_ns(void);
 
 #endif /* TIMER_MGT_H_INCLUDED */
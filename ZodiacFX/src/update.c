@@ -0,0 +1,612 @@
+/**
+ * @file
+ * update.c
+ *
+ * This file contains the firmware update functions
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX P4 firmware.
+ * Copyright (c) 2019 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Paul Zanna <paul@northboundnetworks.com>
+ *
+ */
+
+#include <asf.h>
+#include <string.h>
+#include "update.h"
+#include "command.h"
+#include "common.h"
+#include "config_log.h"
+#include "console.h"
+#include "timers.h"
+#include "cache.h"
+#include "lwip/tcp.h"
+#include "lwip/def.h"
+#include "P4/zodiacfx-hash.h"
+
+/* General purpose backup registers, kept across a reset but not a power cycle */
+#define UPDATE_GPBR_STATE	0
+#define UPDATE_GPBR_LENGTH	1	// Bytes swapped, the same swap reverts the update
+#define UPDATE_GPBR_TRIAL	0x54524900	// "TRI", trial boots in the low byte
+#define UPDATE_GPBR_REVERTED	0x52455654	// "REVT"
+#define UPDATE_GPBR_MASK	0xFFFFFF00
+
+#define UPDATE_CRC_CHUNK	0x8000	// Bytes per hash_crc32_update() call when checking an image
+
+/*
+*	Swap journal, the first page of UPDATE_JOURNAL. Words 1 - 3 hold the
+*	length, its complement and the backup register state to set once the
+*	swap is done, word 0 the magic number, written last. Each copy that
+*	completes sets the next word to its number and complement, so a copy
+*	cut off by a power failure is just done again at the next boot.
+*/
+#define UPDATE_JOURNAL_MAGIC	0x4A465A53	// "SZFJ"
+#define UPDATE_JOURNAL_HEADER	4	// Words before the first record
+#define UPDATE_JOURNAL_RECORD(n)	(((n) & 0xFFFF) | (~(n) << 16))
+#define UPDATE_COPIES		3	// Copies per part of the slots, A to scratch, B to A, scratch to B
+
+#if UPDATE_JOURNAL_HEADER + UPDATE_COPIES * (UPDATE_IMAGE_MAX / UPDATE_ERASE_SIZE) > IFLASH_PAGE_SIZE / 4
+#error "The swap journal does not fit in one page"
+#endif
+
+#define UPDATE_SLOT_A		((uint32_t)&_sfixed)
+
+/* Start and end of the running image, from the linker script */
+extern uint32_t _sfixed;
+extern uint32_t _etext;
+extern uint32_t _srelocate;
+extern uint32_t _erelocate;
+
+// Global variables
+struct update_stats update_stats;
+
+// Local variables
+static struct tcp_pcb *update_listen_pcb = NULL;
+static struct tcp_pcb *update_pcb = NULL;
+static struct pbuf *update_rx = NULL;	// Received data not yet written
+static bool update_header_done = false;
+static bool update_closed = false;	// The uploader has sent everything it is going to
+static bool update_wdt = false;		// The watchdog is running and must be restarted
+static uint32_t update_addr;		// Next page of slot B to write
+static uint32_t update_erased;		// Slot B has been erased below this address
+static uint32_t update_start;
+static uint16_t update_fill = 0;
+static uint8_t update_page[IFLASH_PAGE_SIZE];
+
+static err_t update_accept(void *arg, struct tcp_pcb *pcb, err_t err);
+static err_t update_recv(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err);
+static void update_error(void *arg, err_t err);
+static void update_swap(uint32_t length, uint32_t state, uint32_t done);
+
+/*
+*	Check for an update on trial, called before anything else at boot
+*
+*	The watchdog is left running by board_init(). On a trial boot it
+*	resets the switch if the new image hangs, and after UPDATE_TRIES
+*	boots without confirming, the previous image is swapped back. On
+*	any other boot it is turned off. A swap that was cut off by a power
+*	failure is finished first.
+*
+*/
+void update_boot(void)
+{
+	const volatile uint32_t *journal = (const volatile uint32_t *)UPDATE_JOURNAL;
+	uint32_t state = GPBR->SYS_GPBR[UPDATE_GPBR_STATE];
+	uint32_t done = 0;
+
+	if (journal[0] == UPDATE_JOURNAL_MAGIC && journal[2] == ~journal[1] && journal[1] <= UPDATE_IMAGE_MAX)
+	{
+		while (done < UPDATE_COPIES * (journal[1] / UPDATE_ERASE_SIZE) && journal[UPDATE_JOURNAL_HEADER + done] == UPDATE_JOURNAL_RECORD(done + 1)) done++;
+		update_swap(journal[1], journal[3], done);
+	}
+
+	if ((state & UPDATE_GPBR_MASK) == UPDATE_GPBR_TRIAL)
+	{
+		if ((state & ~UPDATE_GPBR_MASK) >= UPDATE_TRIES)
+		{
+			update_swap(GPBR->SYS_GPBR[UPDATE_GPBR_LENGTH], UPDATE_GPBR_REVERTED, 0);
+		}
+		GPBR->SYS_GPBR[UPDATE_GPBR_STATE] = state + 1;
+		update_stats.trial = true;
+		update_stats.boots = (state & ~UPDATE_GPBR_MASK) + 1;
+		WDT->WDT_MR = WDT_MR_WDV(0xFFF) | WDT_MR_WDD(0xFFF) | WDT_MR_WDRSTEN | WDT_MR_WDDBGHLT | WDT_MR_WDIDLEHLT;	// 16 seconds
+		update_wdt = true;
+		return;
+	}
+
+	if (state == UPDATE_GPBR_REVERTED) update_stats.reverted = true;
+	GPBR->SYS_GPBR[UPDATE_GPBR_STATE] = 0;
+	WDT->WDT_MR = WDT_MR_WDDIS;
+	return;
+}
+
+/*
+*	Start listening for image uploads
+*
+*/
+void update_init(void)
+{
+	struct tcp_pcb *pcb;
+
+	if (update_image_size() > UPDATE_IMAGE_MAX) return;	// This image does not leave room for a second one
+	pcb = tcp_new();
+	if (pcb == NULL) return;
+	if (tcp_bind(pcb, IP_ADDR_ANY, UPDATE_PORT) != ERR_OK)
+	{
+		tcp_close(pcb);
+		return;
+	}
+	update_listen_pcb = tcp_listen(pcb);
+	tcp_accept(update_listen_pcb, update_accept);
+	return;
+}
+
+/*
+*	Size of the running image, code and initialised data
+*
+*/
+uint32_t update_image_size(void)
+{
+	return ((uint32_t)&_etext - (uint32_t)&_sfixed) + ((uint32_t)&_erelocate - (uint32_t)&_srelocate);
+}
+
+/*
+*	Send a one line result to the uploader and close the connection
+*
+*/
+static void update_close(const char *msg)
+{
+	if (update_rx != NULL)
+	{
+		pbuf_free(update_rx);
+		update_rx = NULL;
+	}
+	if (update_pcb == NULL) return;
+
+	tcp_write(update_pcb, msg, strlen(msg), TCP_WRITE_FLAG_COPY);
+	tcp_output(update_pcb);
+	tcp_arg(update_pcb, NULL);
+	tcp_recv(update_pcb, NULL);
+	tcp_err(update_pcb, NULL);
+	tcp_close(update_pcb);
+	update_pcb = NULL;
+	return;
+}
+
+/*
+*	Give up on an upload
+*
+*	@param *reason - why the upload failed.
+*
+*/
+static void update_fail(const char *reason)
+{
+	char msg[64];
+
+	TRACE("update.c: upload failed, %s", reason);
+	update_stats.state = UPDATE_FAILED;
+	update_stats.error = reason;
+	update_stats.errors++;
+	snprintf(msg, sizeof(msg), "ERROR: %s\r\n", reason);
+	update_close(msg);
+	return;
+}
+
+/*
+*	Accept an upload connection, only one upload runs at a time
+*
+*/
+static err_t update_accept(void *arg, struct tcp_pcb *pcb, err_t err)
+{
+	LWIP_UNUSED_ARG(arg);
+	LWIP_UNUSED_ARG(err);
+
+	tcp_accepted(update_listen_pcb);
+	if (update_pcb != NULL || update_stats.trial)
+	{
+		/* Slot B holds the image to go back to until this one is confirmed */
+		tcp_abort(pcb);
+		return ERR_ABRT;
+	}
+
+	update_pcb = pcb;
+	update_header_done = false;
+	update_closed = false;
+	update_addr = UPDATE_SLOT_B;
+	update_erased = UPDATE_SLOT_B;
+	update_fill = 0;
+	update_start = sys_get_ms();
+	update_stats.state = UPDATE_RECEIVING;
+	update_stats.length = 0;
+	update_stats.received = 0;
+	update_stats.error = NULL;
+	tcp_recv(pcb, update_recv);
+	tcp_err(pcb, update_error);
+	TRACE("update.c: upload started");
+	return ERR_OK;
+}
+
+/*
+*	Data received from the uploader
+*
+*	Nothing is written here. update_task() writes one flash page per
+*	main loop pass and only opens the TCP window for bytes it has
+*	written, so the uploader is paced by the flash.
+*
+*/
+static err_t update_recv(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err)
+{
+	LWIP_UNUSED_ARG(arg);
+	LWIP_UNUSED_ARG(err);
+	LWIP_UNUSED_ARG(pcb);
+
+	if (p == NULL)
+	{
+		update_closed = true;
+		return ERR_OK;
+	}
+
+	if (update_rx == NULL)
+	{
+		update_rx = p;
+	} else {
+		pbuf_cat(update_rx, p);
+	}
+	return ERR_OK;
+}
+
+/*
+*	Connection error, the pcb has already been freed by lwIP
+*
+*/
+static void update_error(void *arg, err_t err)
+{
+	LWIP_UNUSED_ARG(arg);
+	LWIP_UNUSED_ARG(err);
+
+	update_pcb = NULL;
+	if (update_stats.state == UPDATE_RECEIVING) update_fail("connection lost");
+	return;
+}
+
+/*
+*	Drop written bytes from the front of the received data and open the window
+*
+*	@param len - number of bytes written.
+*
+*/
+static void update_consume(uint16_t len)
+{
+	struct pbuf *next;
+
+	if (update_pcb != NULL) tcp_recved(update_pcb, len);
+	while (len > 0)
+	{
+		if (len >= update_rx->len)
+		{
+			len -= update_rx->len;
+			next = update_rx->next;
+			if (next != NULL) pbuf_ref(next);	// Keep the rest of the chain
+			pbuf_free(update_rx);
+			update_rx = next;
+		} else {
+			pbuf_header(update_rx, -(s16_t)len);
+			len = 0;
+		}
+	}
+	return;
+}
+
+/*
+*	Check the image in slot B
+*
+*	Returns NULL if the image can be activated, or the reason it cannot.
+*
+*/
+static const char *update_verify(void)
+{
+	const uint32_t *vectors = (const uint32_t *)UPDATE_SLOT_B;
+	uint32_t crc = 0xFFFFFFFF;
+	uint32_t len;
+
+	for (uint32_t offset = 0; offset < update_stats.length; offset += len)
+	{
+		len = update_stats.length - offset;
+		if (len > UPDATE_CRC_CHUNK) len = UPDATE_CRC_CHUNK;
+		crc = hash_crc32_update(crc, (const uint8_t *)(UPDATE_SLOT_B + offset), len);
+	}
+	if (~crc != update_stats.crc32) return "CRC mismatch";
+
+	/* Initial stack pointer in SRAM, reset handler inside the image once it is in slot A */
+	if (update_stats.length < 8 || vectors[0] <= IRAM_ADDR || vectors[0] > IRAM_ADDR + IRAM_SIZE) return "not a firmware image";
+	if (vectors[1] < UPDATE_SLOT_A || vectors[1] >= UPDATE_SLOT_A + update_stats.length) return "not a firmware image";
+	return NULL;
+}
+
+/*
+*	Move an upload on by one step: read the header, fill the page
+*	buffer, erase the next part of slot B or write one page
+*
+*/
+static void update_upload(void)
+{
+	struct update_header header;
+	const char *error;
+	char msg[64];
+	uint16_t len;
+
+	if (update_stats.state != UPDATE_RECEIVING) return;
+
+	if (!update_header_done)
+	{
+		if (update_rx == NULL || update_rx->tot_len < sizeof(struct update_header))
+		{
+			if (update_closed) update_fail("no header");
+			return;
+		}
+		pbuf_copy_partial(update_rx, &header, sizeof(struct update_header), 0);
+		update_consume(sizeof(struct update_header));
+		if (ntohl(header.magic) != UPDATE_MAGIC)
+		{
+			update_fail("bad header");
+			return;
+		}
+		update_stats.length = ntohl(header.length);
+		update_stats.crc32 = ntohl(header.crc32);
+		if (update_stats.length == 0 || update_stats.length > UPDATE_IMAGE_MAX)
+		{
+			update_fail("image too large");
+			return;
+		}
+		if (ntohl(header.address) != UPDATE_SLOT_A)
+		{
+			update_fail("image linked for another address");
+			return;
+		}
+		update_header_done = true;
+	}
+
+	/* Fill the page buffer */
+	while (update_rx != NULL && update_fill < IFLASH_PAGE_SIZE && update_stats.received < update_stats.length)
+	{
+		len = IFLASH_PAGE_SIZE - update_fill;
+		if (len > update_stats.length - update_stats.received) len = update_stats.length - update_stats.received;
+		if (len > update_rx->tot_len) len = update_rx->tot_len;
+		pbuf_copy_partial(update_rx, &update_page[update_fill], len, 0);
+		update_consume(len);
+		update_fill += len;
+		update_stats.received += len;
+	}
+
+	if (update_fill == IFLASH_PAGE_SIZE || (update_fill > 0 && update_stats.received == update_stats.length))
+	{
+		if (update_addr >= update_erased)
+		{
+			if (cache_flash_erase(update_erased, IFLASH_ERASE_PAGES_8) != FLASH_RC_OK)
+			{
+				update_fail("flash erase failed");
+				return;
+			}
+			update_erased += UPDATE_ERASE_SIZE;
+			return;
+		}
+		memset(&update_page[update_fill], 0xFF, IFLASH_PAGE_SIZE - update_fill);
+		if (cache_flash_write(update_addr, update_page, IFLASH_PAGE_SIZE) != FLASH_RC_OK || memcmp((const void *)update_addr, update_page, IFLASH_PAGE_SIZE) != 0)
+		{
+			update_fail("flash write failed");
+			return;
+		}
+		update_addr += IFLASH_PAGE_SIZE;
+		update_fill = 0;
+		return;
+	}
+
+	if (update_stats.received < update_stats.length)
+	{
+		if (update_closed && update_rx == NULL) update_fail("image truncated");
+		return;
+	}
+
+	/* Everything is in flash */
+	error = update_verify();
+	if (error != NULL)
+	{
+		update_fail(error);
+		return;
+	}
+	update_stats.state = UPDATE_READY;
+	update_stats.uploads++;
+	update_stats.upload_ms = sys_get_ms() - update_start;
+	TRACE("update.c: %lu byte image verified", update_stats.length);
+	snprintf(msg, sizeof(msg), "OK: %lu bytes, type 'update' to activate\r\n", update_stats.length);
+	update_close(msg);
+	return;
+}
+
+/*
+*	Move uploads on and confirm a new image, called from the main loop
+*
+*/
+void update_task(void)
+{
+	if (update_wdt) WDT->WDT_CR = WDT_CR_KEY_PASSWD | WDT_CR_WDRSTT;
+
+	if (update_stats.trial && sys_get_ms() >= UPDATE_CONFIRM_TIME)
+	{
+		/* Up and forwarding for long enough, keep this image */
+		GPBR->SYS_GPBR[UPDATE_GPBR_STATE] = 0;
+		update_stats.trial = false;
+		TRACE("update.c: new image confirmed");
+	}
+	update_upload();
+	return;
+}
+
+/*
+*	Swap in the verified image from slot B and restart
+*
+*	Only returns if there is no verified image. The swap covers the
+*	larger of the two images, and the count is kept in a backup register
+*	so the next boot can swap them back if the new image fails.
+*
+*/
+void update_activate(void)
+{
+	uint32_t length = update_image_size();
+
+	if (update_stats.state != UPDATE_READY) return;
+	if (update_stats.length > length) length = update_stats.length;
+	length = (length + UPDATE_ERASE_SIZE - 1) & ~(UPDATE_ERASE_SIZE - 1);
+
+	while (cfglog_busy()) cfglog_task();	// Finish writing a saved configuration
+	console_flush();	// Let the last message get sent to the terminal before detaching
+	udc_detach();
+	update_swap(length, UPDATE_GPBR_TRIAL, 0);
+}
+
+/*
+*	Run a flash command and wait for it to finish
+*
+*	Runs from SRAM like everything called by update_swap(), the code in
+*	flash may be the code being erased.
+*
+*/
+__no_inline
+RAMFUNC
+static void update_efc(uint32_t command, uint32_t argument)
+{
+	EFC->EEFC_FCR = EEFC_FCR_FKEY_PASSWD | EEFC_FCR_FARG(argument) | command;
+	while ((EFC->EEFC_FSR & EEFC_FSR_FRDY) == 0);
+	return;
+}
+
+/*
+*	Erase UPDATE_ERASE_SIZE bytes of flash and copy another part of the flash into them
+*
+*	Each page is copied to SRAM before it is loaded into the write latch.
+*
+*	@param dst - flash address to program, a multiple of UPDATE_ERASE_SIZE.
+*	@param src - flash address to copy from.
+*
+*/
+__no_inline
+RAMFUNC
+static void update_copy(uint32_t dst, uint32_t src)
+{
+	volatile uint32_t *latch = (volatile uint32_t *)dst;
+	volatile const uint32_t *data = (volatile const uint32_t *)src;
+	uint32_t page = (dst - IFLASH_ADDR) / IFLASH_PAGE_SIZE;
+	uint32_t buf[IFLASH_PAGE_SIZE / 4];
+
+	update_efc(EEFC_FCR_FCMD_EPA, page | IFLASH_ERASE_PAGES_8);
+	for (uint32_t p = 0; p < UPDATE_ERASE_SIZE / IFLASH_PAGE_SIZE; p++)
+	{
+		for (uint32_t x = 0; x < IFLASH_PAGE_SIZE / 4; x++) buf[x] = data[x];
+		for (uint32_t x = 0; x < IFLASH_PAGE_SIZE / 4; x++) latch[x] = buf[x];
+		update_efc(EEFC_FCR_FCMD_WP, page + p);
+		data += IFLASH_PAGE_SIZE / 4;
+		latch += IFLASH_PAGE_SIZE / 4;
+	}
+	return;
+}
+
+/*
+*	Program one word of the swap journal
+*
+*	The other words in the write latch are left erased, so the words
+*	already programmed in the page keep their values.
+*
+*	@param index - word of the journal page.
+*	@param value - value to program.
+*
+*/
+__no_inline
+RAMFUNC
+static void update_journal(uint32_t index, uint32_t value)
+{
+	volatile uint32_t *latch = (volatile uint32_t *)UPDATE_JOURNAL;
+
+	latch[index] = value;
+	update_efc(EEFC_FCR_FCMD_WP, (UPDATE_JOURNAL - IFLASH_ADDR) / IFLASH_PAGE_SIZE);
+	return;
+}
+
+/*
+*	Exchange the first length bytes of slot A and slot B, then restart
+*
+*	Interrupts stay off and nothing runs from flash until the reset.
+*	Every copy is recorded in the journal, so a power cut during the
+*	swap resumes it from update_boot() instead of leaving neither image
+*	complete. The journal is retired by clearing its magic number once
+*	the last copy is recorded.
+*
+*	@param length - bytes to swap.
+*	@param state - backup register state to set before the restart.
+*	@param done - copies already recorded in the journal, 0 to start a new swap.
+*
+*/
+__no_inline
+RAMFUNC
+static void update_swap(uint32_t length, uint32_t state, uint32_t done)
+{
+	uint32_t slot_a = UPDATE_SLOT_A;
+	uint32_t offset;
+
+	cpu_irq_disable();
+	CMCC->CMCC_CTRL = 0;	// The scratch copy is read back after every write
+	while (CMCC->CMCC_SR & CMCC_SR_CSTS);
+	if (length > UPDATE_IMAGE_MAX) length = UPDATE_IMAGE_MAX;
+	length &= ~(UPDATE_ERASE_SIZE - 1);
+
+	if (done == 0)
+	{
+		update_efc(EEFC_FCR_FCMD_EPA, ((UPDATE_JOURNAL - IFLASH_ADDR) / IFLASH_PAGE_SIZE) | IFLASH_ERASE_PAGES_8);
+		update_journal(1, length);
+		update_journal(2, ~length);
+		update_journal(3, state);
+		update_journal(0, UPDATE_JOURNAL_MAGIC);
+	}
+
+	for (; done < UPDATE_COPIES * (length / UPDATE_ERASE_SIZE); done++)
+	{
+		WDT->WDT_CR = WDT_CR_KEY_PASSWD | WDT_CR_WDRSTT;
+		offset = (done / UPDATE_COPIES) * UPDATE_ERASE_SIZE;
+		switch (done % UPDATE_COPIES)
+		{
+			case 0:
+			update_copy(UPDATE_SCRATCH, slot_a + offset);
+			break;
+
+			case 1:
+			update_copy(slot_a + offset, UPDATE_SLOT_B + offset);
+			break;
+
+			case 2:
+			update_copy(UPDATE_SLOT_B + offset, UPDATE_SCRATCH);
+			break;
+		}
+		update_journal(UPDATE_JOURNAL_HEADER + done, UPDATE_JOURNAL_RECORD(done + 1));
+	}
+
+	update_journal(0, 0);
+	GPBR->SYS_GPBR[UPDATE_GPBR_LENGTH] = length;
+	GPBR->SYS_GPBR[UPDATE_GPBR_STATE] = state;
+	RSTC->RSTC_CR = RSTC_CR_KEY_PASSWD | RSTC_CR_PROCRST | RSTC_CR_PERRST;
+	while (1);
+}
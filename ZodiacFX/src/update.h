@@ -0,0 +1,96 @@
+/**
+ * @file
+ * update.h
+ *
+ * This file contains the firmware update functions
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX P4 firmware.
+ * Copyright (c) 2019 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Paul Zanna <paul@northboundnetworks.com>
+ *
+ */
+
+#ifndef UPDATE_H_
+#define UPDATE_H_
+
+#include <asf.h>
+#include <arch/cc.h>
+
+/*
+*	Images run where they were linked (slot A), at the start of flash or
+*	after the boot loader. An upload is written to slot B while slot A
+*	keeps running. Activating it swaps the two slots, so slot B then
+*	holds the previous image and the same swap puts it back. The end of
+*	slot B holds the scratch copy of each part of slot A while it is
+*	being swapped, and the journal a power cut resumes the swap from.
+*/
+#define UPDATE_PORT		9560		// TCP port images are uploaded to
+#define UPDATE_SLOT_B		0x00438000	// Ends where the table snapshots start
+#define UPDATE_SLOT_SIZE	0x28000
+#define UPDATE_ERASE_SIZE	(8 * IFLASH_PAGE_SIZE)	// Erased per main loop pass, also the unit the slots are swapped in
+#define UPDATE_JOURNAL		(UPDATE_SLOT_B + UPDATE_SLOT_SIZE - UPDATE_ERASE_SIZE)
+#define UPDATE_SCRATCH		(UPDATE_JOURNAL - UPDATE_ERASE_SIZE)
+#define UPDATE_IMAGE_MAX	(UPDATE_SLOT_SIZE - 2 * UPDATE_ERASE_SIZE)	// Largest image
+#define UPDATE_MAGIC		0x5A465855	// "ZFXU"
+#define UPDATE_TRIES		3		// Boots a new image gets to confirm itself before it is reverted
+#define UPDATE_CONFIRM_TIME	60000		// Time a new image has to run before it confirms itself (ms)
+
+/* Sent ahead of the image on the upload connection, all fields are network byte order */
+PACK_STRUCT_BEGIN
+struct update_header {
+	uint32_t magic;
+	uint32_t length;	// Bytes of image that follow
+	uint32_t crc32;		// CRC-32 of the image
+	uint32_t address;	// Address the image was linked to run at, must match the running image
+} PACK_STRUCT_STRUCT;
+PACK_STRUCT_END
+
+/* State of slot B */
+enum update_state {
+	UPDATE_EMPTY,		// Nothing uploaded since the last boot
+	UPDATE_RECEIVING,
+	UPDATE_READY,		// Verified image waiting to be activated
+	UPDATE_FAILED
+};
+
+/* Firmware update state and counters */
+struct update_stats {
+	uint8_t state;		// enum update_state
+	bool trial;		// Running a new image that has not confirmed itself yet
+	bool reverted;		// The last new image did not confirm itself and was replaced
+	uint8_t boots;		// Trial boots so far
+	uint32_t length;	// Image being received or waiting in slot B
+	uint32_t crc32;
+	uint32_t received;
+	uint32_t upload_ms;	// Time taken by the last upload
+	uint32_t uploads;	// Images received and verified
+	uint32_t errors;	// Uploads that failed
+	const char *error;	// Reason the last upload failed
+};
+
+extern struct update_stats update_stats;
+
+void update_boot(void);
+void update_init(void);
+uint32_t update_image_size(void);
+void update_activate(void);
+void update_task(void);
+
+#endif /* UPDATE_H_ */
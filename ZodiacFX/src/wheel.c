@@ -0,0 +1,233 @@
+/**
+ * @file
+ * wheel.c
+ *
+ * This file contains the timing wheel functions
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX P4 firmware.
+ * Copyright (c) 2019 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Paul Zanna <paul@northboundnetworks.com>
+ *
+ */
+
+#include <asf.h>
+#include <string.h>
+#include "wheel.h"
+#include "timers.h"
+
+#define WHEEL_MASK	(WHEEL_SLOTS - 1)
+
+// Global variables
+struct wheel_stats wheel_stats;
+
+// Local variables
+static struct wheel_timer *wheel_slots[WHEEL_LEVELS][WHEEL_SLOTS];
+static uint32_t wheel_now = 0;		// Tick being expired, timers due at or before it are in its level 0 slot
+static bool wheel_cascaded = false;	// The levels above have been spread out for wheel_now
+
+/*
+*	Put a timer in the slot for its expiry time
+*
+*	@param *timer - pointer to the timer.
+*
+*/
+static void wheel_link(struct wheel_timer *timer)
+{
+	uint32_t expires = timer->expires;
+	uint32_t delta = expires - wheel_now;
+	uint8_t level = 0;
+	struct wheel_timer **slot;
+
+	if ((int32_t)delta < 0)
+	{
+		/* Already due */
+		expires = wheel_now;
+		delta = 0;
+	} else if (delta > WHEEL_MAX_DELAY)
+	{
+		/* Beyond the top level, the timer is put back when it reaches the end */
+		expires = wheel_now + WHEEL_MAX_DELAY;
+		delta = WHEEL_MAX_DELAY;
+	}
+
+	while (delta >= (1UL << (WHEEL_BITS * (level + 1)))) level++;
+	slot = &wheel_slots[level][(expires >> (WHEEL_BITS * level)) & WHEEL_MASK];
+
+	timer->next = *slot;
+	if (timer->next != NULL) timer->next->pprev = &timer->next;
+	*slot = timer;
+	timer->pprev = slot;
+	return;
+}
+
+/*
+*	Take a timer out of its slot
+*
+*	@param *timer - pointer to the timer.
+*
+*/
+static void wheel_unlink(struct wheel_timer *timer)
+{
+	*timer->pprev = timer->next;
+	if (timer->next != NULL) timer->next->pprev = timer->pprev;
+	timer->next = NULL;
+	timer->pprev = NULL;
+	return;
+}
+
+/*
+*	Spread the current slot of each level that has come round over the
+*	levels below, called once per tick before it is expired
+*
+*/
+static void wheel_cascade(void)
+{
+	struct wheel_timer *list;
+	struct wheel_timer *timer;
+
+	for (int level=1;level<WHEEL_LEVELS;level++)
+	{
+		/* A level only moves on when the level below wraps */
+		if (((wheel_now >> (WHEEL_BITS * (level - 1))) & WHEEL_MASK) != 0) break;
+
+		list = wheel_slots[level][(wheel_now >> (WHEEL_BITS * level)) & WHEEL_MASK];
+		wheel_slots[level][(wheel_now >> (WHEEL_BITS * level)) & WHEEL_MASK] = NULL;
+		while (list != NULL)
+		{
+			timer = list;
+			list = timer->next;
+			wheel_link(timer);
+			wheel_stats.cascaded++;
+		}
+	}
+	return;
+}
+
+/*
+*	Start the wheel at the current time, called once the 1 ms timer is running
+*
+*/
+void wheel_init(void)
+{
+	memset(wheel_slots, 0, sizeof(wheel_slots));
+	memset(&wheel_stats, 0, sizeof(wheel_stats));
+	wheel_now = sys_get_ms();
+	wheel_cascaded = false;
+	return;
+}
+
+/*
+*	Start a timer, or restart it if it is already running
+*
+*	@param *timer - pointer to the timer.
+*	@param delay_ms - time until it expires.
+*	@param fn - function called when it expires.
+*
+*/
+void wheel_add(struct wheel_timer *timer, uint32_t delay_ms, wheel_fn_t fn)
+{
+	if (wheel_running(timer))
+	{
+		wheel_unlink(timer);
+	} else {
+		wheel_stats.running++;
+	}
+
+	timer->fn = fn;
+	timer->expires = sys_get_ms() + delay_ms;
+	wheel_link(timer);
+	return;
+}
+
+/*
+*	Stop a timer, nothing happens if it is not running
+*
+*	@param *timer - pointer to the timer.
+*
+*/
+void wheel_cancel(struct wheel_timer *timer)
+{
+	if (!wheel_running(timer)) return;
+	wheel_unlink(timer);
+	wheel_stats.running--;
+	return;
+}
+
+/*
+*	Expire the timers that are due, called from the main loop
+*
+*	Ticks with nothing due cost a slot check each, so catching up after
+*	a long pass is cheap. If WHEEL_BUDGET timers expire the wheel stops
+*	part way through the tick and carries on from there next pass.
+*
+*/
+void wheel_task(void)
+{
+	uint32_t now = sys_get_ms();
+	uint8_t budget = WHEEL_BUDGET;
+	struct wheel_timer **slot;
+	struct wheel_timer *timer;
+
+	if (wheel_stats.running == 0)
+	{
+		wheel_now = now;
+		wheel_cascaded = false;
+		return;
+	}
+
+	while ((int32_t)(now - wheel_now) >= 0)
+	{
+		if (!wheel_cascaded)
+		{
+			wheel_cascade();
+			wheel_cascaded = true;
+		}
+
+		slot = &wheel_slots[0][wheel_now & WHEEL_MASK];
+		while ((timer = *slot) != NULL)
+		{
+			if (budget == 0)
+			{
+				wheel_stats.held++;
+				return;
+			}
+			budget--;
+			wheel_unlink(timer);
+
+			/* Timers further ahead than the top level go round again */
+			if ((int32_t)(timer->expires - wheel_now) > 0)
+			{
+				wheel_link(timer);
+				continue;
+			}
+
+			wheel_stats.running--;
+			wheel_stats.expired++;
+			if (now - timer->expires > wheel_stats.late_max) wheel_stats.late_max = now - timer->expires;
+			timer->fn(timer);
+		}
+
+		/* Timers added for the current tick are expired on the next pass */
+		if (wheel_now == now) break;
+		wheel_now++;
+		wheel_cascaded = false;
+	}
+	return;
+}
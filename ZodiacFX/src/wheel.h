@@ -0,0 +1,90 @@
+/**
+ * @file
+ * wheel.h
+ *
+ * This file contains the timing wheel functions
+ *
+ */
+
+/*
+ * This file is part of the Zodiac FX P4 firmware.
+ * Copyright (c) 2019 Northbound Networks.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Paul Zanna <paul@northboundnetworks.com>
+ *
+ */
+
+#ifndef WHEEL_H_
+#define WHEEL_H_
+
+#include <asf.h>
+
+/*
+*	Hierarchical timing wheel with a 1 ms tick. Level 0 has one slot per
+*	ms for the next 64 ms, each level above has slots 64 times as wide.
+*	When the level 0 index wraps, the current slot of the level above is
+*	spread over the levels below. Adding, cancelling and expiring a
+*	timer are O(1), timers are part of the entries they time so nothing
+*	is allocated. At most WHEEL_BUDGET timers expire per main loop pass,
+*	the rest expire on the passes after.
+*/
+#define WHEEL_BITS	6
+#define WHEEL_SLOTS	(1 << WHEEL_BITS)
+#define WHEEL_LEVELS	4	// Timers up to 2^24 ms (4.6 hours) ahead, longer ones are checked again then
+#define WHEEL_BUDGET	16	// Timers expired per main loop pass
+#define WHEEL_MAX_DELAY	((1UL << (WHEEL_BITS * WHEEL_LEVELS)) - 1)
+
+/* Get the entry a timer is part of */
+#define WHEEL_ENTRY(timer, type, member)	((type *)((uint8_t *)(timer) - offsetof(type, member)))
+
+struct wheel_timer;
+typedef void (*wheel_fn_t)(struct wheel_timer *timer);
+
+/* Part of each entry that is timed, zero it before first use */
+struct wheel_timer {
+	struct wheel_timer *next;
+	struct wheel_timer **pprev;	// Link pointing at this timer, NULL when the timer is not running
+	uint32_t expires;		// sys_get_ms() time
+	wheel_fn_t fn;			// Called from the main loop when the timer expires
+};
+
+struct wheel_stats {
+	uint32_t running;	// Timers waiting to expire
+	uint32_t expired;
+	uint32_t cascaded;	// Timers moved down a level
+	uint32_t late_max;	// Most time a timer has expired after it was due (ms)
+	uint32_t held;		// Passes that reached WHEEL_BUDGET
+};
+
+extern struct wheel_stats wheel_stats;
+
+void wheel_init(void);
+void wheel_add(struct wheel_timer *timer, uint32_t delay_ms, wheel_fn_t fn);
+void wheel_cancel(struct wheel_timer *timer);
+void wheel_task(void);
+
+/*
+*	Check if a timer is running
+*
+*	@param *timer - pointer to the timer.
+*
+*/
+static inline bool wheel_running(const struct wheel_timer *timer)
+{
+	return timer->pprev != NULL;
+}
+
+#endif /* WHEEL_H_ */
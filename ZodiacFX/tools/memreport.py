@@ -0,0 +1,160 @@
+#!/usr/bin/env python3
+#
+# memreport.py
+#
+# Post-link SRAM report for the Zodiac FX P4 firmware. Reads the linker
+# map file and breaks .ramfunc, .data and .bss down by subsystem, so the
+# 128 KB SRAM budget can be checked after every build.
+#
+# USE
+#
+#   $ python3 tools/memreport.py Debug/ZodiacFX-P4.map
+#   $ python3 tools/memreport.py -v Debug/ZodiacFX-P4.map    (also list each object)
+#
+# Compare the "Free" line with "show memory" on a running switch, which
+# adds the stack high water mark and the heap used at runtime.
+#
+# This file is part of the Zodiac FX P4 firmware.
+# Copyright (c) 2019 Northbound Networks.
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+import re
+import sys
+
+RAM_START = 0x20000000
+RAM_SIZE = 0x20000
+
+# First match wins, paths use forward slashes
+SUBSYSTEMS = [
+    ('gmac_raw', 'GMAC rings'),
+    ('lwip/core/memp', 'lwIP memp pools'),
+    ('lwip/core/mem.', 'lwIP heap'),
+    ('lwip/', 'lwIP other'),
+    ('services/usb/', 'USB CDC'),
+    ('drivers/udp/', 'USB CDC'),
+    ('pktbuf', 'Packet pool'),
+    ('egress', 'Egress queues'),
+    ('console', 'Console ring'),
+    ('P4/zodiacfx-flow', 'Flow cache'),
+    ('P4/', 'P4 tables and state'),
+    ('lib_a-', 'C library'),
+    ('libc', 'C library'),
+    ('libgcc', 'C library'),
+]
+
+COLUMNS = ['.ramfunc', '.data', '.bss']
+
+INPUT_RE = re.compile(r'^ (\S+)?\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)\s+(\S.*)$')
+
+
+def subsystem(obj):
+    obj = obj.replace('\\', '/')
+    for pattern, name in SUBSYSTEMS:
+        if pattern in obj:
+            return name
+    return 'Other'
+
+
+def parse(path):
+    """Return (column, object, size) for every input section placed in SRAM"""
+    sections = []
+    output = None
+    pending = None
+    stack = 0
+    in_map = False
+
+    with open(path) as f:
+        for line in f:
+            line = line.rstrip('\n')
+            if line.startswith('Linker script and memory map'):
+                in_map = True
+                continue
+            if not in_map or not line:
+                continue
+            if not line.startswith(' '):
+                output = line.split()[0]
+                if output == '.stack':
+                    fields = line.split()
+                    if len(fields) >= 3:
+                        stack = int(fields[2], 16)
+                pending = None
+                continue
+            if output not in ('.relocate', '.bss', '.stack'):
+                continue
+
+            # Long section names put the address and size on the next line
+            fields = line.split()
+            if len(fields) == 1 and (line.startswith(' .') or line.startswith(' COMMON')):
+                pending = fields[0]
+                continue
+            m = INPUT_RE.match(line)
+            if m is None:
+                pending = None
+                continue
+            name = m.group(1) or pending
+            pending = None
+            if name is None:
+                continue
+            addr = int(m.group(2), 16)
+            size = int(m.group(3), 16)
+            if size == 0 or addr < RAM_START or addr >= RAM_START + RAM_SIZE:
+                continue
+            if output == '.stack':
+                stack = max(stack, size)
+                continue
+            if name.startswith('.ramfunc'):
+                column = '.ramfunc'
+            elif output == '.relocate':
+                column = '.data'
+            else:
+                column = '.bss'
+            sections.append((column, m.group(4).strip(), size))
+    return sections, stack
+
+
+def main(argv):
+    verbose = '-v' in argv
+    args = [a for a in argv if a != '-v']
+    if len(args) != 1:
+        print('usage: memreport.py [-v] <map file>')
+        return 1
+
+    sections, stack = parse(args[0])
+    totals = {}
+    objects = {}
+    for column, obj, size in sections:
+        name = subsystem(obj)
+        totals.setdefault(name, dict.fromkeys(COLUMNS, 0))[column] += size
+        objects.setdefault(name, {}).setdefault(obj, 0)
+        objects[name][obj] += size
+
+    print('%-22s %9s %9s %9s %9s' % ('Subsystem', '.ramfunc', '.data', '.bss', 'Total'))
+    used = 0
+    for name in sorted(totals, key=lambda n: -sum(totals[n].values())):
+        row = totals[name]
+        total = sum(row.values())
+        used += total
+        print('%-22s %9d %9d %9d %9d' % (name, row['.ramfunc'], row['.data'], row['.bss'], total))
+        if verbose:
+            for obj, size in sorted(objects[name].items(), key=lambda o: -o[1]):
+                print('    %-40s %9d' % (obj, size))
+    print('%-22s %39d' % ('Stack', stack))
+    used += stack
+    print('%-22s %39d' % ('Free (heap and tables)', RAM_SIZE - used))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv[1:]))